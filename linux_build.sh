@@ -17,6 +17,7 @@ src/platform.c
 src/platform_linux.c
 src/plugin_manager.c
 src/stretchy_buffer.c
+src/string_intern.c
 src/util.c
 "
 
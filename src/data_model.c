@@ -1,470 +1,8679 @@
 #include "data_model.h"
 #include "assert.h"
+#include "hash.h"
 #include "memory.h"
 #include "stretchy_buffer.h"
+#include "string_intern.h"
+#include "util.h"
 
 #include "plugin_sdk.h"
 
+#include <math.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#if defined(__SSE2__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define DATABASE_SIMD_X86
+#endif
+
 typedef struct mem_allocator_i mem_allocator_i;
 
+#define POOL_PAGE_SIZE Kibi(64)
+#define POOL_MAX_ELEMENT_SIZE (POOL_PAGE_SIZE / 8)
+#define POOL_PAGE_NONE UINT32_MAX
+#define POOL_PAGE_FILE (UINT32_MAX - 1) // payload lives in the loaded file
+#define POOL_PAGE_SHARED (UINT32_MAX - 2) // see shared_payload_t
+#define POOL_PAGE_INSTANCE (UINT32_MAX - 3) // see create_instance
+
+// Blobs of a loaded database keep the file offset of their data, tagged
+// with this bit, until they are resized. See blob_bytes.
+#define BLOB_FILE_OFFSET 1ull
+
 typedef struct blob_t
 {
     uint64_t size;
     void* data;
 } blob_t;
 
+typedef struct index_entry_t
+{
+    uint64_t key;
+    object_id_t id;
+
+    // chain of entries in the same hash bucket, or free list, +1
+    uint32_t next;
+    uint32_t prev;
+} index_entry_t;
+
+typedef struct ordered_entry_t
+{
+    uint64_t key;
+    object_id_t id;
+} ordered_entry_t;
+
+// Secondary index over the values of a property. Keys are the values
+// mapped to uint64_t in an order preserving way, see index_key.
+typedef struct property_index_t
+{
+    // PROPERTY_INDEX_HASH
+    hash_t chains; // hash_mix(key) -> first entry + 1
+    hash_t entry_of_slot; // object slot -> entry + 1
+    /* array */ index_entry_t* entries;
+    uint32_t first_free;
+    uint32_t live_count; // entries not on the free list
+
+    // PROPERTY_INDEX_ORDERED, sorted by key then id
+    /* array */ ordered_entry_t* sorted;
+    bool deferred; // sorted is left alone until rebuild_ordered_index
+
+    uint64_t update_count;
+    uint64_t update_nanoseconds;
+} property_index_t;
+
 typedef struct property_layout_t
 {
     property_definition_t def;
-    uint32_t offset;
+    string_id_t name; // of def.name, compared by find_property
+    object_type_t owner;
+    uint32_t offset; // in the hot or cold block
+    uint32_t size;
+    uint32_t alignment;
+    bool cold;
+
+    void* column; // OBJECT_TYPE_COLUMNAR only, indexed by row
+    property_index_t* index;
+    /* array */ uint64_t* row_versions; // PROPERTY_TRACK_CHANGES only
 } property_layout_t;
 
+// Fixed size allocator for the payloads of one object type. Pages
+// come from the page allocator of the database and are handed back as
+// soon as they are empty, except for the last partially used one.
+typedef struct pool_page_t
+{
+    uint8_t* base;
+
+    uint32_t used;
+    uint32_t untouched; // first element never handed out yet
+    uint32_t first_free; // free list threaded through the elements, +1
+
+    // list of pages with room left, or of released pages, +1
+    uint32_t next;
+    uint32_t prev;
+} pool_page_t;
+
+typedef struct object_pool_t
+{
+    uint32_t element_size;
+    uint32_t elements_per_page;
+
+    uint32_t first_partial;
+    uint32_t first_released;
+    /* array */ pool_page_t* pages;
+} object_pool_t;
+
 typedef struct object_type_definition_t
 {
     uint32_t first_property;
     uint32_t property_count;
-    uint32_t bytes;
+    uint32_t bytes; // of the payload, holding the hot properties
+    uint32_t flags;
+    uint32_t cold_bytes;
+
+    // Live objects of the type, packed : row_slots[row] is the slot of
+    // the object stored in that row. Columnar types store their
+    // properties in the same row of every column.
+    uint32_t row_capacity;
+    void* cold; // blocks of the PROPERTY_COLD properties, by row
+    /* array */ uint32_t* row_slots;
+    /* array */ uint64_t* row_versions; // last change of each row
+    /* array */ uint64_t* changed_rows; // chunk bits, see mark_changed
+
+    uint64_t version; // last create, change or destroy of any object
+
+    object_pool_t pool;
 } object_type_definition_t;
 
-typedef union object_slot_t object_slot_t;
+typedef struct object_t object_t;
+typedef struct database_journal_t database_journal_t;
+typedef struct database_replica_t database_replica_t;
+
+// Payload replaced or destroyed while a snapshot could still read it.
+// Dropped once every snapshot acquired at needed_until or before is
+// released.
+typedef struct retired_payload_t
+{
+    void* data;
+    uint32_t page;
+    uint32_t type;
+    uint64_t needed_until;
+} retired_payload_t;
+
+// One PTYPE_REFERENCE property, or one element of a
+// PTYPE_REFERENCE_ARRAY, of source pointing to the object in target_slot.
+// Links to the same target form a doubly linked list.
+typedef struct reference_link_t
+{
+    object_id_t source;
+    uint32_t property;
+    uint32_t target_slot;
+
+    uint32_t next; // +1, also used for the free list
+    uint32_t prev;
+    uint32_t element; // index in the array
+    uint32_t padding;
+} reference_link_t;
+
+// Value of a hot property written to an instance, large enough for any
+// property type. Free cells are chained through next_free, +1.
+typedef union override_cell_t
+{
+    uint8_t bytes[sizeof(blob_t)];
+    blob_t blob;
+    uint32_t next_free;
+} override_cell_t;
 
 struct database_o
 {
     mem_allocator_i* alloc;
+    // Pool pages and the slot table, mem_vm_alloc unless the database
+    // lives in a file heap.
+    mem_allocator_i* page_alloc;
+    mem_file_heap_o* heap; // see open_heap
     /* array */ property_layout_t* properties;
     /* array */ object_type_definition_t* object_types;
-    /* array */ object_slot_t* objects;
+    /* array */ object_t* objects; // from page_alloc
+
+    // Free slots, reused lowest first : bit s of free_slots is set when
+    // slot s is free, bit w of free_words when free_slots[w] isn't 0.
+    /* array */ uint64_t* free_slots;
+    /* array */ uint64_t* free_words;
+    uint32_t free_slot_count;
+    uint32_t first_free_word; // no bit of free_words below it is set
+    // Highest generation of the slots dropped by compact_slots, which
+    // the slots added back start from.
+    uint16_t tail_generation;
+    hash_t moved_ids; // old id -> new id, see compact_slots
+
+    // Bumped on every change, and stamped on what changed.
+    uint64_t version;
+
+    /* array */ reference_link_t* links;
+    uint32_t first_free_link;
+    hash_t first_referrer; // target slot -> link + 1
+    hash_t link_of_reference; // source slot << 32 | property -> link + 1
+    hash_t links_of_array; // property_slot_key -> array of link + 1
+
+    // see create_instance
+    /* array */ override_cell_t* overrides;
+    /* array */ uint32_t* override_properties; // by cell, 0 when free
+    uint32_t first_free_override;
+    uint32_t override_count;
+    uint32_t instance_count;
+    hash_t override_of_property; // property_slot_key -> cell + 1
+    hash_t instances_of; // prototype slot -> array of instance slots
+
+    // File the database was loaded from. Payloads, columns and blobs
+    // point into it until they are reallocated.
+    uint8_t* file_base;
+    uint64_t file_size;
+    bool file_mapped;
+
+    database_journal_t* journal; // see open_journal
+    database_replica_t* replica; // see publish_replica and open_replica
+
+    hash_t blob_store; // content hash -> blob_header_t*
+    blob_store_stats_t blob_stats;
+
+    // see acquire_snapshot
+    /* array */ database_snapshot_o** snapshots;
+    uint64_t newest_snapshot; // version, 0 without snapshots
+    /* array */ retired_payload_t* retired;
+    database_snapshot_o* snapshot_base; // newest acquired, even if released
+    _Atomic uint32_t released_snapshots; // since the last collection
+    /* array */ uint64_t* changed_slots; // chunk bits, see mark_changed
+    /* array */ uint64_t* changed_cells;
+    /* array */ uint64_t* changed_buckets; // of override_of_property
 };
 
-typedef struct object_t
+// Free slots keep their id with a null type, so that the generation
+// carries over to the next object.
+struct object_t
 {
     object_id_t id;
-    void* data;
-} object_t;
+    union
+    {
+        void* data;
+        object_id_t prototype; // POOL_PAGE_INSTANCE, see create_instance
+    };
+    uint32_t row;
+    uint32_t page; // pool page holding data, or POOL_PAGE_NONE
+};
 
-union object_slot_t
+static bool in_file(const database_o* db, const void* ptr)
 {
-    uint32_t next_free;
-    object_t object;
-};
+    return (const uint8_t*)ptr >= db->file_base
+           && (const uint8_t*)ptr < db->file_base + db->file_size;
+}
 
-static database_o* create(mem_allocator_i* alloc)
+static uint8_t* blob_bytes(const database_o* db, const blob_t* blob)
 {
-    database_o* db = mem_alloc(alloc, sizeof(database_o));
+    uint64_t data = (uint64_t)blob->data;
+    if (data & BLOB_FILE_OFFSET)
+    {
+        return db->file_base + (data & ~BLOB_FILE_OFFSET);
+    }
+    return blob->data;
+}
 
-    *db = (database_o){0};
-    db->alloc = alloc;
+// Blob payloads are allocated with a blob_header_t in front of them and
+// shared between blob properties holding the same bytes. Shared payloads
+// are copied before being written to. Payloads found in the blob store
+// are hashed and immutable, writing to one removes it from the store.
+typedef struct blob_header_t
+{
+    uint64_t hash;
+    uint64_t size; // allocated after the header
+    uint32_t refcount;
+    uint32_t hashed; // in db->blob_store
+    uint64_t used; // blob->size of every blob using it, arrays keep room
+} blob_header_t;
 
-    array_push(db->alloc, db->object_types, (object_type_definition_t){0});
-    array_push(db->alloc, db->properties, (property_layout_t){0});
-    array_push(db->alloc, db->objects, (object_slot_t){0});
+static blob_header_t* blob_header(const blob_t* blob)
+{
+    if (!blob->data || ((uint64_t)blob->data & BLOB_FILE_OFFSET))
+    {
+        return 0;
+    }
+    return (blob_header_t*)blob->data - 1;
+}
 
-    return db;
+static uint64_t blob_key(uint64_t hash)
+{
+    // hash_t reserves 0 and UINT64_MAX
+    return hash == 0 ? 1 : hash == UINT64_MAX ? UINT64_MAX - 1 : hash;
 }
 
-static void destroy(database_o* db)
+static blob_header_t* blob_alloc(database_o* db, uint64_t size)
 {
-    // TODO(octave) : check that all objects have been freed
+    blob_header_t* header = mem_alloc(db->alloc, sizeof(*header) + size);
+    *header = (blob_header_t){.size = size, .refcount = 1, .used = size};
 
-    array_free(db->alloc, db->object_types);
-    array_free(db->alloc, db->properties);
-    array_free(db->alloc, db->objects);
+    db->blob_stats.reference_count++;
+    db->blob_stats.unique_count++;
+    db->blob_stats.logical_bytes += size;
+    db->blob_stats.stored_bytes += size;
+    db->blob_stats.reserved_bytes += size;
+    return header;
+}
 
-    db->object_types = 0;
-    db->properties = 0;
-    db->objects = 0;
+static void blob_unhash(database_o* db, blob_header_t* header)
+{
+    if (header->hashed)
+    {
+        hash_remove(&db->blob_store, blob_key(header->hash));
+        header->hashed = false;
+    }
+}
 
-    mem_free(db->alloc, db, sizeof(database_o));
+static void blob_retain(database_o* db, blob_header_t* header)
+{
+    header->refcount++;
+    db->blob_stats.reference_count++;
+    db->blob_stats.logical_bytes += header->used;
 }
 
-#define DO_SIZE_SWITCH_CASE(upper, lower, type)                                \
-    case PTYPE_##upper:                                                        \
-        return sizeof(type);
+static void blob_release(database_o* db, blob_header_t* header)
+{
+    ASSERT(header->refcount);
+    db->blob_stats.reference_count--;
+    db->blob_stats.logical_bytes -= header->used;
 
-static uint32_t property_size(const property_definition_t* property)
+    if (!--header->refcount)
+    {
+        blob_unhash(db, header);
+        db->blob_stats.unique_count--;
+        db->blob_stats.stored_bytes -= header->used;
+        db->blob_stats.reserved_bytes -= header->size;
+        mem_free(db->alloc, header, sizeof(*header) + header->size);
+    }
+}
+
+static void blob_assign(database_o* db, blob_t* blob, blob_header_t* header)
 {
-    switch (property->type)
+    blob_header_t* old = blob_header(blob);
+    if (old)
     {
-        FOR_ALL_BASE_PROPERTY_TYPES(DO_SIZE_SWITCH_CASE)
-    case PTYPE_BLOB:
-        return sizeof(blob_t);
-    case PTYPE_OBJECT:
-        return sizeof(object_id_t);
-    case PTYPE_REFERENCE:
-        return sizeof(object_id_t);
+        blob_release(db, old);
+    }
+
+    blob->data = header ? header + 1 : 0;
+    blob->size = header ? header->used : 0;
+}
+
+// Sets the size of a private array payload, within its capacity.
+static void blob_set_used(database_o* db, blob_t* blob, uint64_t used)
+{
+    blob_header_t* header = blob_header(blob);
+    ASSERT(header && header->refcount == 1 && used <= header->size);
+    db->blob_stats.logical_bytes += used - header->used;
+    db->blob_stats.stored_bytes += used - header->used;
+    header->used = used;
+    blob->size = used;
+}
+
+// Returns the payload in the store holding the same bytes, or 0.
+static blob_header_t*
+blob_find(database_o* db, uint64_t hash, const void* data, uint64_t size)
+{
+    blob_header_t* found =
+        (blob_header_t*)hash_find(&db->blob_store, blob_key(hash), 0);
+    if (found && found->used == size && !memcmp(found + 1, data, size))
+    {
+        return found;
     }
-    ASSERT_MSG(false, "Unknown property type %u", property->type);
     return 0;
 }
 
-static object_type_t add_object_type(database_o* db,
-                                     uint32_t property_count,
-                                     property_definition_t* properties)
+static void blob_insert(database_o* db, blob_header_t* header)
 {
-    object_type_definition_t def;
-    def.first_property = array_count(db->properties);
-    def.property_count = property_count;
+    if (!hash_find(&db->blob_store, blob_key(header->hash), 0))
+    {
+        // on a hash collision, the payload simply isn't shared
+        hash_set(db->alloc,
+                 &db->blob_store,
+                 blob_key(header->hash),
+                 (uint64_t)header);
+        header->hashed = true;
+    }
+}
 
-    // TODO(octave) : handle alignment
-    uint32_t offset = 0;
-    for (uint32_t i = 0; i < property_count; i++)
+// Makes the payload of blob safe to write to in place.
+static void blob_make_private(database_o* db, blob_t* blob)
+{
+    blob_header_t* header = blob_header(blob);
+    if (header && header->refcount == 1)
     {
-        property_layout_t layout;
-        layout.def = properties[i];
-        layout.offset = offset;
+        blob_unhash(db, header);
+    }
+    else if (blob->size)
+    {
+        // shared, or still in the loaded file
+        blob_header_t* copy = blob_alloc(db, blob->size);
+        memcpy(copy + 1, blob_bytes(db, blob), blob->size);
+        blob_assign(db, blob, copy);
+    }
+}
 
-        array_push(db->alloc, db->properties, layout);
-        offset += property_size(&properties[i]);
+static bool is_array(uint32_t type)
+{
+    return type == PTYPE_REFERENCE_ARRAY || type == PTYPE_OBJECT_ARRAY;
+}
+
+// Arrays keep their ids in a blob payload, with room for more ids past
+// blob->size : the header holds the capacity.
+static bool holds_blob(uint32_t type)
+{
+    return type == PTYPE_BLOB || is_array(type);
+}
+
+// Returns the ids of an array, private to blob and with room for count
+// ids, doubling the capacity when it runs out.
+static object_id_t*
+array_items_mut(database_o* db, blob_t* blob, uint64_t count)
+{
+    blob_header_t* header = blob_header(blob);
+    uint64_t size = count * sizeof(object_id_t);
+    if (!header || header->refcount > 1 || header->size < size)
+    {
+        uint64_t capacity = 2 * blob->size > size ? 2 * blob->size : size;
+        capacity = capacity < 64 ? 64 : capacity;
+        blob_header_t* grown = blob_alloc(db, capacity);
+        uint64_t used = blob->size;
+        if (used)
+        {
+            memcpy(grown + 1, blob_bytes(db, blob), used);
+        }
+        blob_assign(db, blob, grown);
+        blob_set_used(db, blob, used);
+    }
+    return blob->data;
+}
+
+static void pool_init(object_pool_t* pool, uint32_t element_size)
+{
+    *pool = (object_pool_t){0};
+
+    // room for the free list link
+    pool->element_size = element_size < sizeof(uint64_t) //
+                             ? sizeof(uint64_t)
+                             : (element_size + 7) & ~7u;
+    pool->elements_per_page = POOL_PAGE_SIZE / pool->element_size;
+}
+
+static bool pool_accepts(const object_pool_t* pool)
+{
+    return pool->element_size <= POOL_MAX_ELEMENT_SIZE;
+}
+
+static void pool_link(object_pool_t* pool, uint32_t* head, uint32_t index)
+{
+    pool_page_t* page = &pool->pages[index];
+    page->prev = 0;
+    page->next = *head;
+    if (*head)
+    {
+        pool->pages[*head - 1].prev = index + 1;
+    }
+    *head = index + 1;
+}
+
+static void pool_unlink(object_pool_t* pool, uint32_t* head, uint32_t index)
+{
+    pool_page_t* page = &pool->pages[index];
+    if (page->prev)
+    {
+        pool->pages[page->prev - 1].next = page->next;
+    }
+    else
+    {
+        *head = page->next;
+    }
+    if (page->next)
+    {
+        pool->pages[page->next - 1].prev = page->prev;
+    }
+    page->next = 0;
+    page->prev = 0;
+}
+
+static void* pool_alloc(mem_allocator_i* alloc,
+                        mem_allocator_i* page_alloc,
+                        object_pool_t* pool,
+                        uint32_t* page_index)
+{
+    if (!pool->first_partial)
+    {
+        uint32_t index;
+        if (pool->first_released)
+        {
+            index = pool->first_released - 1;
+            pool_unlink(pool, &pool->first_released, index);
+        }
+        else
+        {
+            array_push(alloc, pool->pages, (pool_page_t){0});
+            index = array_count(pool->pages) - 1;
+        }
+
+        pool_page_t* page = &pool->pages[index];
+        *page = (pool_page_t){0};
+        page->base = mem_alloc(page_alloc, POOL_PAGE_SIZE);
+
+        pool_link(pool, &pool->first_partial, index);
+    }
+
+    uint32_t index = pool->first_partial - 1;
+    pool_page_t* page = &pool->pages[index];
+
+    uint8_t* element;
+    if (page->first_free)
+    {
+        element = page->base + (page->first_free - 1) * pool->element_size;
+        page->first_free = *(uint32_t*)element;
+    }
+    else
+    {
+        ASSERT(page->untouched < pool->elements_per_page);
+        element = page->base + page->untouched * pool->element_size;
+        page->untouched++;
+    }
+
+    page->used++;
+    if (page->used == pool->elements_per_page)
+    {
+        pool_unlink(pool, &pool->first_partial, index);
+    }
+
+    *page_index = index;
+    return element;
+}
+
+static void pool_free(mem_allocator_i* page_alloc,
+                      object_pool_t* pool,
+                      uint32_t page_index,
+                      void* ptr)
+{
+    pool_page_t* page = &pool->pages[page_index];
+    uint32_t element = ((uint8_t*)ptr - page->base) / pool->element_size;
+
+    ASSERT(page->used);
+    if (page->used == pool->elements_per_page)
+    {
+        pool_link(pool, &pool->first_partial, page_index);
+    }
+
+    *(uint32_t*)ptr = page->first_free;
+    page->first_free = element + 1;
+    page->used--;
+
+    // keep a single empty page around so that create/destroy churn
+    // doesn't map and unmap the same page over and over.
+    if (!page->used
+        && (page->next || pool->first_partial != page_index + 1))
+    {
+        pool_unlink(pool, &pool->first_partial, page_index);
+        mem_free(page_alloc, page->base, POOL_PAGE_SIZE);
+        page->base = 0;
+        pool_link(pool, &pool->first_released, page_index);
+    }
+}
+
+static void pool_release(mem_allocator_i* alloc,
+                         mem_allocator_i* page_alloc,
+                         object_pool_t* pool)
+{
+    for (uint32_t i = 0; i < array_count(pool->pages); i++)
+    {
+        if (pool->pages[i].base)
+        {
+            mem_free(page_alloc, pool->pages[i].base, POOL_PAGE_SIZE);
+        }
+    }
+
+    if (pool->pages)
+    {
+        array_free(alloc, pool->pages);
+    }
+    *pool = (object_pool_t){0};
+}
+
+// Payload of copy on write clones, allocated in front of the data and
+// shared until one of the objects is written to. The shared payload owns
+// one reference to each of the blobs it holds.
+typedef struct shared_payload_t
+{
+    uint32_t refcount;
+    uint32_t padding;
+} shared_payload_t;
+
+static void*
+payload_alloc(database_o* db, object_type_definition_t* type, uint32_t* page)
+{
+    if (pool_accepts(&type->pool))
+    {
+        return pool_alloc(db->alloc, db->page_alloc, &type->pool, page);
+    }
+    *page = POOL_PAGE_NONE;
+    return mem_alloc(db->alloc, type->bytes);
+}
+
+static void payload_free(database_o* db,
+                         object_type_definition_t* type,
+                         void* data,
+                         uint32_t page)
+{
+    if (page == POOL_PAGE_FILE)
+    {
+        ASSERT(in_file(db, data));
+    }
+    else if (page == POOL_PAGE_SHARED)
+    {
+        shared_payload_t* shared = (shared_payload_t*)data - 1;
+        if (!--shared->refcount)
+        {
+            mem_free(db->alloc, shared, sizeof(*shared) + type->bytes);
+        }
+    }
+    else if (page != POOL_PAGE_NONE)
+    {
+        pool_free(db->page_alloc, &type->pool, page, data);
+    }
+    else
+    {
+        ASSERT(data);
+        mem_free(db->alloc, data, type->bytes);
+    }
+}
+
+static bool payload_shared(const object_t* object)
+{
+    return object->page == POOL_PAGE_SHARED
+           && ((shared_payload_t*)object->data - 1)->refcount > 1;
+}
+
+// A payload unchanged since the newest snapshot was acquired may be read
+// by snapshots, so it is copied instead of being written in place.
+static bool payload_in_snapshot(const database_o* db, const object_t* object)
+{
+    const object_type_definition_t* type =
+        &db->object_types[object->id.info.type.index];
+    return db->newest_snapshot && !(type->flags & OBJECT_TYPE_COLUMNAR)
+           && type->row_versions[object->row] <= db->newest_snapshot;
+}
+
+// Snapshots copy the slot table, the rows of every type and the override
+// cells by chunks of SNAPSHOT_CHUNK elements, and share with the previous
+// snapshot the chunks that weren't written since it was acquired.
+#define SNAPSHOT_CHUNK 1024
+
+// Flags the chunk of element index in bits as written since the previous
+// snapshot. Without one, the next snapshot copies every chunk anyway.
+static void
+mark_changed(database_o* db, /* array */ uint64_t** bits, uint32_t index)
+{
+    if (!db->snapshot_base)
+    {
+        return;
+    }
+
+    uint32_t chunk = index / SNAPSHOT_CHUNK;
+    uint64_t* words = *bits;
+    while (array_count(words) <= chunk / 64)
+    {
+        array_push(db->alloc, words, 0);
+    }
+    words[chunk / 64] |= 1ull << (chunk % 64);
+    *bits = words;
+}
+
+static bool chunk_changed(/* array */ uint64_t* bits, uint32_t chunk)
+{
+    return chunk / 64 < array_count(bits)
+           && (bits[chunk / 64] >> (chunk % 64)) & 1;
+}
+
+static void retain_payload_blobs(database_o* db,
+                                 const object_type_definition_t* type,
+                                 void* data)
+{
+    for (uint32_t i = 0; i < type->property_count; i++)
+    {
+        const property_layout_t* prop =
+            &db->properties[type->first_property + i];
+        if (holds_blob(prop->def.type) && !prop->cold)
+        {
+            blob_header_t* header =
+                blob_header((blob_t*)((uint8_t*)data + prop->offset));
+            if (header)
+            {
+                blob_retain(db, header);
+            }
+        }
+    }
+}
+
+// Frees a payload along with its references to blobs, which a shared
+// payload only gives up with its last holder.
+static void drop_payload(database_o* db,
+                         object_type_definition_t* type,
+                         void* data,
+                         uint32_t page)
+{
+    if (page != POOL_PAGE_SHARED
+        || ((shared_payload_t*)data - 1)->refcount == 1)
+    {
+        for (uint32_t i = 0; i < type->property_count; i++)
+        {
+            const property_layout_t* prop =
+                &db->properties[type->first_property + i];
+            if (holds_blob(prop->def.type) && !prop->cold)
+            {
+                blob_assign(db, (blob_t*)((uint8_t*)data + prop->offset), 0);
+            }
+        }
+    }
+    payload_free(db, type, data, page);
+}
+
+static void retire_payload(database_o* db, const object_t* object)
+{
+    retired_payload_t retired = {
+        .data = object->data,
+        .page = object->page,
+        .type = object->id.info.type.index,
+        .needed_until = db->version,
+    };
+    array_push(db->alloc, db->retired, retired);
+}
+
+// Moves the payload of object to a shared_payload_t if it isn't in one
+// yet, and returns it with one more reference.
+static void* share_payload(database_o* db,
+                           object_type_definition_t* type,
+                           object_t* object)
+{
+    if (object->page != POOL_PAGE_SHARED)
+    {
+        shared_payload_t* shared =
+            mem_alloc(db->alloc, sizeof(*shared) + type->bytes);
+        *shared = (shared_payload_t){.refcount = 1};
+        memcpy(shared + 1, object->data, type->bytes);
+        if (payload_in_snapshot(db, object))
+        {
+            retain_payload_blobs(db, type, shared + 1);
+            retire_payload(db, object);
+        }
+        else
+        {
+            // the blob references move to the shared payload
+            payload_free(db, type, object->data, object->page);
+        }
+        object->data = shared + 1;
+        object->page = POOL_PAGE_SHARED;
+        mark_changed(db, &db->changed_slots, object->id.info.slot);
+    }
+
+    ((shared_payload_t*)object->data - 1)->refcount++;
+    return object->data;
+}
+
+static void index_free(mem_allocator_i* alloc, property_index_t* index)
+{
+    hash_free(alloc, &index->chains);
+    hash_free(alloc, &index->entry_of_slot);
+    if (index->entries)
+    {
+        array_free(alloc, index->entries);
+    }
+    if (index->sorted)
+    {
+        array_free(alloc, index->sorted);
+    }
+    mem_free(alloc, index, sizeof(property_index_t));
+}
+
+static database_o* create_with(mem_allocator_i* alloc,
+                               mem_allocator_i* page_alloc)
+{
+    database_o* db = mem_alloc(alloc, sizeof(database_o));
+
+    *db = (database_o){0};
+    db->alloc = alloc;
+    db->page_alloc = page_alloc;
+
+    array_push(db->alloc, db->object_types, (object_type_definition_t){0});
+    array_push(db->alloc, db->properties, (property_layout_t){0});
+    array_push(db->page_alloc, db->objects, (object_t){0});
+
+    return db;
+}
+
+static database_o* create(mem_allocator_i* alloc)
+{
+    return create_with(alloc, mem_vm_alloc);
+}
+
+static void close_journal(database_o* db);
+static void close_replica(database_o* db);
+static void collect_snapshots(database_o* db, bool all);
+static void free_hash_of_arrays(mem_allocator_i* alloc, hash_t* hash);
+static void close_heap(database_o* db);
+
+static void destroy(database_o* db)
+{
+    if (db->heap)
+    {
+        close_heap(db);
+        return;
+    }
+
+    // TODO(octave) : check that all objects have been freed
+
+    close_replica(db);
+    close_journal(db);
+
+    collect_snapshots(db, true);
+    if (db->snapshots)
+    {
+        array_free(db->alloc, db->snapshots);
+    }
+    if (db->retired)
+    {
+        array_free(db->alloc, db->retired);
+    }
+
+    if (db->links)
+    {
+        array_free(db->alloc, db->links);
+    }
+    hash_free(db->alloc, &db->first_referrer);
+    hash_free(db->alloc, &db->link_of_reference);
+    free_hash_of_arrays(db->alloc, &db->links_of_array);
+    if (db->overrides)
+    {
+        array_free(db->alloc, db->overrides);
+        array_free(db->alloc, db->override_properties);
+    }
+    hash_free(db->alloc, &db->override_of_property);
+    free_hash_of_arrays(db->alloc, &db->instances_of);
+    hash_free(db->alloc, &db->blob_store);
+
+    for (uint32_t i = 1; i < array_count(db->properties); i++)
+    {
+        if (db->properties[i].index)
+        {
+            index_free(db->alloc, db->properties[i].index);
+        }
+        if (db->properties[i].row_versions)
+        {
+            array_free(db->alloc, db->properties[i].row_versions);
+        }
+    }
+
+    for (uint32_t i = 1; i < array_count(db->object_types); i++)
+    {
+        object_type_definition_t* type = &db->object_types[i];
+        if (type->flags & OBJECT_TYPE_COLUMNAR)
+        {
+            for (uint32_t p = 0; p < type->property_count; p++)
+            {
+                property_layout_t* prop =
+                    &db->properties[type->first_property + p];
+                if (prop->column && !in_file(db, prop->column))
+                {
+                    mem_free(db->alloc,
+                             prop->column,
+                             (uint64_t)prop->size * type->row_capacity);
+                }
+            }
+        }
+        if (type->cold && !in_file(db, type->cold))
+        {
+            mem_free(db->alloc,
+                     type->cold,
+                     (uint64_t)type->cold_bytes * type->row_capacity);
+        }
+        if (type->row_slots)
+        {
+            array_free(db->alloc, type->row_slots);
+            array_free(db->alloc, type->row_versions);
+        }
+        pool_release(db->alloc, db->page_alloc, &type->pool);
+    }
+
+    array_free(db->alloc, db->object_types);
+    array_free(db->alloc, db->properties);
+    array_free(db->page_alloc, db->objects);
+    if (db->free_slots)
+    {
+        array_free(db->alloc, db->free_slots);
+        array_free(db->alloc, db->free_words);
+    }
+    hash_free(db->alloc, &db->moved_ids);
+
+    db->object_types = 0;
+    db->properties = 0;
+    db->objects = 0;
+
+    if (db->file_mapped)
+    {
+        platform_unmap_file(db->file_base, db->file_size);
+    }
+    else if (db->file_base)
+    {
+        mem_free(db->alloc, db->file_base, db->file_size);
+    }
+
+    mem_free(db->alloc, db, sizeof(database_o));
+}
+
+#define DO_SIZE_SWITCH_CASE(upper, lower, type)                                \
+    case PTYPE_##upper:                                                        \
+        return sizeof(type);
+
+static uint32_t property_size(const property_definition_t* property)
+{
+    switch (property->type)
+    {
+        FOR_ALL_BASE_PROPERTY_TYPES(DO_SIZE_SWITCH_CASE)
+    case PTYPE_BLOB:
+        return sizeof(blob_t);
+    case PTYPE_OBJECT:
+        return sizeof(object_id_t);
+    case PTYPE_REFERENCE:
+        return sizeof(object_id_t);
+    case PTYPE_REFERENCE_ARRAY:
+    case PTYPE_OBJECT_ARRAY:
+        return sizeof(blob_t);
+    case PTYPE_STRING:
+        return sizeof(string_id_t);
+    }
+    ASSERT_MSG(false, "Unknown property type %u", property->type);
+    return 0;
+}
+
+// Hash indexes apply to numbers and strings, ordered ones to numbers.
+static bool property_indexable(const property_definition_t* def)
+{
+    bool hashed = def->type == PTYPE_STRING
+                  && !(def->flags & PROPERTY_INDEX_ORDERED);
+    return hashed || (def->type > PTYPE_NONE && def->type < PTYPE_BLOB);
+}
+
+static object_type_t add_object_type_ex(database_o* db,
+                                        uint32_t property_count,
+                                        property_definition_t* properties,
+                                        uint32_t flags)
+{
+    object_type_definition_t def = {0};
+    def.first_property = array_count(db->properties);
+    def.property_count = property_count;
+    def.flags = flags;
+
+    for (uint32_t i = 0; i < property_count; i++)
+    {
+        property_layout_t layout = {0};
+        layout.def = properties[i];
+        layout.name = string_intern_n(
+            layout.def.name,
+            strnlen(layout.def.name, sizeof(layout.def.name)));
+        layout.owner = (object_type_t){array_count(db->object_types)};
+        layout.size = property_size(&properties[i]);
+        // every property type is a power of two or a multiple of 8
+        layout.alignment = layout.size < 8 ? layout.size : 8;
+        layout.cold = (layout.def.flags & PROPERTY_COLD)
+                      && !(flags & OBJECT_TYPE_COLUMNAR);
+
+        if (layout.def.flags & (PROPERTY_INDEX_HASH | PROPERTY_INDEX_ORDERED))
+        {
+            ASSERT_MSG(property_indexable(&layout.def),
+                       "Property '%s' of type %u can't be indexed",
+                       layout.def.name,
+                       layout.def.type);
+
+            layout.index = mem_alloc(db->alloc, sizeof(property_index_t));
+            *layout.index = (property_index_t){0};
+        }
+
+        array_push(db->alloc, db->properties, layout);
+    }
+
+    // Handles stay in declaration order, but the offsets go by
+    // decreasing alignment so that no padding is needed.
+    uint32_t hot_offset = 0;
+    uint32_t cold_offset = 0;
+    for (uint32_t alignment = 8; alignment; alignment /= 2)
+    {
+        for (uint32_t i = 0; i < property_count; i++)
+        {
+            property_layout_t* layout = &db->properties[def.first_property + i];
+            if (layout->alignment != alignment)
+            {
+                continue;
+            }
+
+            uint32_t* offset = layout->cold ? &cold_offset : &hot_offset;
+            layout->offset = *offset;
+            *offset += layout->size;
+        }
+    }
+    def.bytes = hot_offset;
+    def.cold_bytes = (cold_offset + 7) & ~7u;
+    pool_init(&def.pool, def.bytes);
+
+    array_push(db->alloc, db->object_types, def);
+
+    ASSERT(array_count(db->object_types) - 1 <= UINT16_MAX);
+
+    return (object_type_t){array_count(db->object_types) - 1};
+}
+
+static object_type_t add_object_type(database_o* db,
+                                     uint32_t property_count,
+                                     property_definition_t* properties)
+{
+    return add_object_type_ex(db, property_count, properties, 0);
+}
+
+static object_t* get_object(database_o* db, object_id_t id)
+{
+    ASSERT(id.index);
+
+    if (id.info.slot >= array_count(db->objects))
+    {
+        return 0; // dropped by compact_slots
+    }
+
+    object_t* object = &db->objects[id.info.slot];
+    if (!object->id.info.type.index)
+    {
+        return 0; // free slot
+    }
+    ASSERT(id.info.slot == object->id.info.slot);
+
+    if (object->id.info.generation == id.info.generation)
+    {
+        if (object->id.info.type.index == id.info.type.index)
+        {
+            return object;
+        }
+        else
+        {
+            log_warning("Found an object of type %u when type %u was requested",
+                        object->id.info.type.index,
+                        id.info.type.index);
+        }
+    }
+    return 0;
+}
+
+// The slot is in the low bits, where hash_t picks the buckets.
+static uint64_t property_slot_key(object_id_t id, uint32_t property)
+{
+    return ((uint64_t)property << 32) | id.info.slot;
+}
+
+static void mark_slot_free(database_o* db, uint32_t slot)
+{
+    uint32_t word = slot / 64;
+    while (array_count(db->free_slots) <= word)
+    {
+        array_push(db->alloc, db->free_slots, 0);
+    }
+    while (array_count(db->free_words) <= word / 64)
+    {
+        array_push(db->alloc, db->free_words, 0);
+    }
+
+    db->free_slots[word] |= 1ull << (slot % 64);
+    db->free_words[word / 64] |= 1ull << (word % 64);
+    db->free_slot_count++;
+    if (word / 64 < db->first_free_word)
+    {
+        db->first_free_word = word / 64;
+    }
+}
+
+static void unmark_slot_free(database_o* db, uint32_t slot)
+{
+    uint32_t word = slot / 64;
+    db->free_slots[word] &= ~(1ull << (slot % 64));
+    if (!db->free_slots[word])
+    {
+        db->free_words[word / 64] &= ~(1ull << (word % 64));
+    }
+    db->free_slot_count--;
+}
+
+// Returns 0 when no slot is free.
+static uint32_t lowest_free_slot(database_o* db)
+{
+    if (!db->free_slot_count)
+    {
+        return 0;
+    }
+
+    uint32_t i = db->first_free_word;
+    while (!db->free_words[i])
+    {
+        i++;
+    }
+    db->first_free_word = i;
+
+    uint32_t word = i * 64 + __builtin_ctzll(db->free_words[i]);
+    return word * 64 + __builtin_ctzll(db->free_slots[word]);
+}
+
+// Instances read the hot properties they don't override from their
+// prototype, the ones written to them live in override cells.
+static object_t* prototype_of(database_o* db, const object_t* instance)
+{
+    return &db->objects[instance->prototype.info.slot];
+}
+
+static void add_instance(database_o* db, const object_t* instance)
+{
+    uint64_t key = instance->prototype.info.slot;
+    uint32_t* instances = (uint32_t*)hash_find(&db->instances_of, key, 0);
+    array_push(db->alloc, instances, instance->id.info.slot);
+    hash_set(db->alloc, &db->instances_of, key, (uint64_t)instances);
+}
+
+static void remove_instance(database_o* db, const object_t* instance)
+{
+    uint64_t key = instance->prototype.info.slot;
+    uint32_t* instances = (uint32_t*)hash_find(&db->instances_of, key, 0);
+    uint32_t count = array_count(instances);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (instances[i] == instance->id.info.slot)
+        {
+            instances[i] = instances[--count];
+            break;
+        }
+    }
+    array_header(instances)->count = count;
+    if (!count)
+    {
+        array_free(db->alloc, instances);
+        hash_remove(&db->instances_of, key);
+    }
+}
+
+static override_cell_t* find_override(database_o* db,
+                                      const object_t* object,
+                                      const property_layout_t* prop)
+{
+    uint32_t cell = hash_find(&db->override_of_property,
+                              property_slot_key(object->id,
+                                           (uint32_t)(prop - db->properties)),
+                              0);
+    return cell ? &db->overrides[cell - 1] : 0;
+}
+
+// Changes to override_of_property, marking the buckets they write for
+// snapshots. Growing the table moves every key.
+static void set_override_key(database_o* db, uint64_t key, uint32_t cell)
+{
+    hash_t* hash = &db->override_of_property;
+    uint64_t* keys = hash->keys;
+    hash_set(db->alloc, hash, key, cell);
+    for (uint32_t i = 0; hash->keys != keys && i < hash->bucket_count;
+         i += SNAPSHOT_CHUNK)
+    {
+        mark_changed(db, &db->changed_buckets, i);
+    }
+    mark_changed(db, &db->changed_buckets, hash_bucket(hash, key));
+}
+
+static void remove_override_key(database_o* db, uint64_t key)
+{
+    mark_changed(db,
+                 &db->changed_buckets,
+                 hash_bucket(&db->override_of_property, key));
+    hash_remove(&db->override_of_property, key);
+}
+
+// Stores value in a new override cell, which takes a reference to blobs.
+static override_cell_t* add_override(database_o* db,
+                                     const object_t* object,
+                                     const property_layout_t* prop,
+                                     const void* value)
+{
+    override_cell_t cell_value = {0};
+    memcpy(cell_value.bytes, value, prop->size);
+    if (holds_blob(prop->def.type))
+    {
+        blob_header_t* header = blob_header(&cell_value.blob);
+        if (header)
+        {
+            blob_retain(db, header);
+        }
+    }
+
+    uint32_t cell = db->first_free_override;
+    if (cell)
+    {
+        db->first_free_override = db->overrides[cell - 1].next_free;
+    }
+    else
+    {
+        array_push(db->alloc, db->overrides, (override_cell_t){0});
+        array_push(db->alloc, db->override_properties, 0);
+        cell = array_count(db->overrides);
+    }
+    uint32_t property = (uint32_t)(prop - db->properties);
+    db->overrides[cell - 1] = cell_value;
+    db->override_properties[cell - 1] = property;
+    db->override_count++;
+    mark_changed(db, &db->changed_cells, cell - 1);
+    set_override_key(db, property_slot_key(object->id, property), cell);
+    return &db->overrides[cell - 1];
+}
+
+static void drop_overrides(database_o* db, const object_t* object)
+{
+    const object_type_definition_t* type =
+        &db->object_types[object->id.info.type.index];
+    for (uint32_t i = 0; i < type->property_count; i++)
+    {
+        uint32_t index = type->first_property + i;
+        uint64_t key = property_slot_key(object->id, index);
+        uint32_t cell = hash_find(&db->override_of_property, key, 0);
+        if (!cell)
+        {
+            continue;
+        }
+
+        if (holds_blob(db->properties[index].def.type))
+        {
+            blob_assign(db, &db->overrides[cell - 1].blob, 0);
+        }
+        db->overrides[cell - 1].next_free = db->first_free_override;
+        db->override_properties[cell - 1] = 0;
+        db->first_free_override = cell;
+        db->override_count--;
+        mark_changed(db, &db->changed_cells, cell - 1);
+        remove_override_key(db, key);
+    }
+}
+
+static void* get_property_data(database_o* db,
+                               const object_t* object,
+                               const property_layout_t* prop)
+{
+    const object_type_definition_t* type =
+        &db->object_types[object->id.info.type.index];
+
+    if (type->flags & OBJECT_TYPE_COLUMNAR)
+    {
+        return (uint8_t*)prop->column + (uint64_t)object->row * prop->size;
+    }
+    else if (prop->cold)
+    {
+        return (uint8_t*)type->cold + (uint64_t)object->row * type->cold_bytes
+               + prop->offset;
+    }
+    else if (object->page == POOL_PAGE_INSTANCE)
+    {
+        override_cell_t* cell = find_override(db, object, prop);
+        return cell ? cell->bytes
+                    : get_property_data(db, prototype_of(db, object), prop);
+    }
+    else
+    {
+        return (uint8_t*)object->data + prop->offset;
+    }
+}
+
+static property_handle_t
+find_property(database_o* db, object_type_t type, const char* prop_name)
+{
+    if (!type.index || type.index >= array_count(db->object_types))
+    {
+        return (property_handle_t){0};
+    }
+
+    string_id_t name = string_id_n(
+        prop_name,
+        strnlen(prop_name, sizeof(((property_definition_t*)0)->name)));
+    const object_type_definition_t* type_def = &db->object_types[type.index];
+    for (uint32_t i = 0; i < type_def->property_count; i++)
+    {
+        uint32_t index = type_def->first_property + i;
+        const property_layout_t* prop = &db->properties[index];
+
+        if (prop->name.hash == name.hash)
+        {
+            return (property_handle_t){index};
+        }
+    }
+
+    return (property_handle_t){0};
+}
+
+static property_handle_t
+find_object_property(database_o* db, object_id_t id, const char* name)
+{
+    return find_property(db, id.info.type, name);
+}
+
+static const property_layout_t* get_property(database_o* db,
+                                             object_type_t type,
+                                             property_handle_t property)
+{
+    if (!property.index || property.index >= array_count(db->properties))
+    {
+        return 0;
+    }
+
+    const property_layout_t* prop = &db->properties[property.index];
+    if (prop->owner.index != type.index)
+    {
+        return 0;
+    }
+
+    return prop;
+}
+
+typedef struct property_ref_t
+{
+    object_t* object;
+    const property_layout_t* prop;
+    void* data;
+} property_ref_t;
+
+static bool resolve_property(database_o* db,
+                             object_id_t id,
+                             uint16_t property_type,
+                             object_type_t object_type,
+                             property_handle_t property,
+                             property_ref_t* ref)
+{
+    const property_layout_t* prop = get_property(db, id.info.type, property);
+
+    if (!prop //
+        || prop->def.type != property_type
+        || (object_type.index
+            && prop->def.object_type.index != object_type.index))
+    {
+        return false;
+    }
+
+    object_t* object = get_object(db, id);
+    if (!object)
+    {
+        return false;
+    }
+
+    ref->object = object;
+    ref->prop = prop;
+    ref->data = get_property_data(db, object, prop);
+    return true;
+}
+
+// Gives an object its own copy of its payload before it is written to,
+// when it shares it with copy on write clones or snapshots.
+static void own_payload(database_o* db, object_t* object)
+{
+    bool retire = payload_in_snapshot(db, object);
+    if (!retire && !payload_shared(object))
+    {
+        return;
+    }
+
+    object_type_definition_t* type =
+        &db->object_types[object->id.info.type.index];
+
+    uint32_t page;
+    void* data = payload_alloc(db, type, &page);
+    memcpy(data, object->data, type->bytes);
+    retain_payload_blobs(db, type, data);
+    if (retire)
+    {
+        retire_payload(db, object);
+    }
+    else
+    {
+        ((shared_payload_t*)object->data - 1)->refcount--;
+    }
+    object->data = data;
+    object->page = page;
+    mark_changed(db, &db->changed_slots, object->id.info.slot);
+}
+
+// get_property_data for the callers writing to the property. Instances
+// get an override cell instead of their own payload.
+static void* get_property_data_mut(database_o* db,
+                                   object_t* object,
+                                   const property_layout_t* prop)
+{
+    object_type_definition_t* type =
+        &db->object_types[object->id.info.type.index];
+    if (prop->cold || (type->flags & OBJECT_TYPE_COLUMNAR))
+    {
+        // Written in place, in rows snapshots copy. The write stamps the
+        // row version payload_in_snapshot reads though, so a payload
+        // snapshots read is given up first.
+        if (object->page != POOL_PAGE_INSTANCE
+            && payload_in_snapshot(db, object))
+        {
+            own_payload(db, object);
+        }
+        mark_changed(db, &type->changed_rows, object->row);
+        return get_property_data(db, object, prop);
+    }
+    else if (object->page == POOL_PAGE_INSTANCE)
+    {
+        override_cell_t* cell = find_override(db, object, prop);
+        if (!cell)
+        {
+            cell = add_override(db,
+                                object,
+                                prop,
+                                get_property_data(db, object, prop));
+        }
+        mark_changed(db, &db->changed_cells, cell - db->overrides);
+        return cell->bytes;
+    }
+
+    own_payload(db, object);
+    return get_property_data(db, object, prop);
+}
+
+// resolve_property for the callers writing to the property.
+static bool resolve_property_mut(database_o* db,
+                                 object_id_t id,
+                                 uint16_t property_type,
+                                 object_type_t object_type,
+                                 property_handle_t property,
+                                 property_ref_t* ref)
+{
+    if (!resolve_property(db, id, property_type, object_type, property, ref))
+    {
+        return false;
+    }
+
+    ref->data = get_property_data_mut(db, ref->object, ref->prop);
+    return true;
+}
+
+static void* get_property_ptr_full(database_o* db,
+                                   object_id_t id,
+                                   uint16_t property_type,
+                                   object_type_t object_type,
+                                   property_handle_t property)
+{
+    property_ref_t ref;
+    if (resolve_property(db, id, property_type, object_type, property, &ref))
+    {
+        return ref.data;
+    }
+    else
+    {
+        return 0;
+    }
+}
+
+static void* get_property_ptr(database_o* db,
+                              object_id_t id,
+                              uint32_t property_type,
+                              property_handle_t property)
+{
+    return get_property_ptr_full(db,
+                                 id,
+                                 property_type,
+                                 (object_type_t){0},
+                                 property);
+}
+
+#define SIGN_BIT (1ull << 63)
+
+static uint64_t float_key(double value)
+{
+    if (value == 0.)
+    {
+        value = 0.; // -0. == 0.
+    }
+
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    return (bits & SIGN_BIT) ? ~bits : bits | SIGN_BIT;
+}
+
+static uint64_t index_key(uint16_t type, const void* data)
+{
+    switch (type)
+    {
+    case PTYPE_BOOL:
+        return *(const bool*)data != 0;
+    case PTYPE_INT8:
+        return (uint64_t)(int64_t)(*(const int8_t*)data) ^ SIGN_BIT;
+    case PTYPE_INT16:
+        return (uint64_t)(int64_t)(*(const int16_t*)data) ^ SIGN_BIT;
+    case PTYPE_INT32:
+        return (uint64_t)(int64_t)(*(const int32_t*)data) ^ SIGN_BIT;
+    case PTYPE_INT64:
+        return (uint64_t)(*(const int64_t*)data) ^ SIGN_BIT;
+    case PTYPE_UINT8:
+        return *(const uint8_t*)data;
+    case PTYPE_UINT16:
+        return *(const uint16_t*)data;
+    case PTYPE_UINT32:
+        return *(const uint32_t*)data;
+    case PTYPE_UINT64:
+        return *(const uint64_t*)data;
+    case PTYPE_FLOAT32:
+        return float_key(*(const float*)data);
+    case PTYPE_FLOAT64:
+        return float_key(*(const double*)data);
+    case PTYPE_STRING:
+        return ((const string_id_t*)data)->hash;
+    }
+    ASSERT_MSG(false, "Property type %u has no index key", type);
+    return 0;
+}
+
+static uint64_t chain_key(uint64_t key)
+{
+    // hash_t reserves 0 and UINT64_MAX, the two values colliding with
+    // others are filtered out by comparing keys when walking the chain.
+    uint64_t h = hash_mix(key);
+    if (h == 0)
+    {
+        return 1;
+    }
+    else if (h == UINT64_MAX)
+    {
+        return UINT64_MAX - 1;
+    }
+    return h;
+}
+
+static uint32_t ordered_lower_bound(const property_index_t* index,
+                                    uint64_t key,
+                                    uint64_t id)
+{
+    uint32_t lo = 0;
+    uint32_t hi = array_count(index->sorted);
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        const ordered_entry_t* e = &index->sorted[mid];
+        if (e->key < key || (e->key == key && e->id.index < id))
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static void index_insert(database_o* db,
+                         const property_layout_t* prop,
+                         object_id_t id,
+                         const void* data)
+{
+    property_index_t* index = prop->index;
+    uint64_t t0 = platform_get_nanoseconds();
+    uint64_t key = index_key(prop->def.type, data);
+
+    if (prop->def.flags & PROPERTY_INDEX_HASH)
+    {
+        uint32_t entry = index->first_free;
+        if (entry)
+        {
+            index->first_free = index->entries[entry - 1].next;
+        }
+        else
+        {
+            array_push(db->alloc, index->entries, (index_entry_t){0});
+            entry = array_count(index->entries);
+        }
+        index->live_count++;
+
+        uint64_t bucket = chain_key(key);
+        uint32_t head = hash_find(&index->chains, bucket, 0);
+
+        index->entries[entry - 1] = (index_entry_t){
+            .key = key,
+            .id = id,
+            .next = head,
+        };
+        if (head)
+        {
+            index->entries[head - 1].prev = entry;
+        }
+
+        hash_set(db->alloc, &index->chains, bucket, entry);
+        hash_set(db->alloc, &index->entry_of_slot, id.info.slot, entry);
+    }
+
+    if ((prop->def.flags & PROPERTY_INDEX_ORDERED) && !index->deferred)
+    {
+        uint32_t pos = ordered_lower_bound(index, key, id.index);
+        uint32_t count = array_count(index->sorted);
+
+        array_push(db->alloc, index->sorted, (ordered_entry_t){0});
+        memmove(&index->sorted[pos + 1],
+                &index->sorted[pos],
+                sizeof(ordered_entry_t) * (count - pos));
+        index->sorted[pos] = (ordered_entry_t){.key = key, .id = id};
+    }
+
+    index->update_count++;
+    index->update_nanoseconds += platform_get_nanoseconds() - t0;
+}
+
+static void index_remove(database_o* db,
+                         const property_layout_t* prop,
+                         object_id_t id,
+                         const void* data)
+{
+    property_index_t* index = prop->index;
+    uint64_t t0 = platform_get_nanoseconds();
+
+    if (prop->def.flags & PROPERTY_INDEX_HASH)
+    {
+        uint32_t entry = hash_find(&index->entry_of_slot, id.info.slot, 0);
+        ASSERT(entry);
+
+        index_entry_t* e = &index->entries[entry - 1];
+        if (e->prev)
+        {
+            index->entries[e->prev - 1].next = e->next;
+        }
+        else if (e->next)
+        {
+            hash_set(db->alloc, &index->chains, chain_key(e->key), e->next);
+        }
+        else
+        {
+            hash_remove(&index->chains, chain_key(e->key));
+        }
+        if (e->next)
+        {
+            index->entries[e->next - 1].prev = e->prev;
+        }
+
+        hash_remove(&index->entry_of_slot, id.info.slot);
+
+        *e = (index_entry_t){.next = index->first_free};
+        index->first_free = entry;
+        index->live_count--;
+    }
+
+    if ((prop->def.flags & PROPERTY_INDEX_ORDERED) && !index->deferred)
+    {
+        uint64_t key = index_key(prop->def.type, data);
+        uint32_t pos = ordered_lower_bound(index, key, id.index);
+        uint32_t count = array_count(index->sorted);
+
+        ASSERT(pos < count && index->sorted[pos].id.index == id.index);
+        memmove(&index->sorted[pos],
+                &index->sorted[pos + 1],
+                sizeof(ordered_entry_t) * (count - pos - 1));
+        array_header(index->sorted)->count--;
+    }
+
+    index->update_count++;
+    index->update_nanoseconds += platform_get_nanoseconds() - t0;
+}
+
+// Bulk changes touching more than 1 / ORDERED_REBUILD_RATIO of the
+// objects of a type sort the ordered indexes once at the end, instead
+// of moving entries around for every object.
+#define ORDERED_REBUILD_RATIO 8
+
+static int compare_ordered_entries(const void* a, const void* b)
+{
+    const ordered_entry_t* x = a;
+    const ordered_entry_t* y = b;
+    if (x->key != y->key)
+    {
+        return x->key < y->key ? -1 : 1;
+    }
+    return x->id.index < y->id.index ? -1 : x->id.index > y->id.index;
+}
+
+static bool defer_ordered_index(property_layout_t* prop,
+                                uint32_t row_count,
+                                uint32_t change_count)
+{
+    if (prop->index && (prop->def.flags & PROPERTY_INDEX_ORDERED)
+        && (uint64_t)change_count * ORDERED_REBUILD_RATIO >= row_count)
+    {
+        prop->index->deferred = true;
+    }
+    return prop->index && prop->index->deferred;
+}
+
+static void rebuild_ordered_index(database_o* db, property_layout_t* prop)
+{
+    property_index_t* index = prop->index;
+    if (!index || !index->deferred)
+    {
+        return;
+    }
+
+    uint64_t t0 = platform_get_nanoseconds();
+    const object_type_definition_t* type = &db->object_types[prop->owner.index];
+    uint32_t row_count = array_count(type->row_slots);
+
+    index->deferred = false;
+    if (index->sorted)
+    {
+        array_header(index->sorted)->count = 0;
+    }
+    array_reserve(db->alloc, index->sorted, row_count);
+    for (uint32_t row = 0; row < row_count; row++)
+    {
+        const object_t* object = &db->objects[type->row_slots[row]];
+        ordered_entry_t entry = {
+            .key = index_key(prop->def.type,
+                             get_property_data(db, object, prop)),
+            .id = object->id,
+        };
+        array_push(db->alloc, index->sorted, entry);
+    }
+    if (row_count)
+    {
+        qsort(index->sorted,
+              row_count,
+              sizeof(ordered_entry_t),
+              compare_ordered_entries);
+    }
+
+    index->update_nanoseconds += platform_get_nanoseconds() - t0;
+}
+
+static bool is_alive(database_o* db, object_id_t id)
+{
+    return id.index && id.info.slot < array_count(db->objects)
+           && db->objects[id.info.slot].id.index == id.index;
+}
+
+static uint64_t reference_key(object_id_t source, uint32_t property)
+{
+    return ((uint64_t)source.info.slot << 32) | property;
+}
+
+// Returns the new link, or 0 for dangling references, which aren't
+// tracked.
+static uint32_t add_link(database_o* db,
+                         object_id_t source,
+                         uint32_t property,
+                         object_id_t target)
+{
+    if (!is_alive(db, target))
+    {
+        return 0;
+    }
+
+    uint32_t link = db->first_free_link;
+    if (link)
+    {
+        db->first_free_link = db->links[link - 1].next;
+    }
+    else
+    {
+        array_push(db->alloc, db->links, (reference_link_t){0});
+        link = array_count(db->links);
+    }
+
+    uint32_t head = hash_find(&db->first_referrer, target.info.slot, 0);
+    db->links[link - 1] = (reference_link_t){
+        .source = source,
+        .property = property,
+        .target_slot = target.info.slot,
+        .next = head,
+    };
+    if (head)
+    {
+        db->links[head - 1].prev = link;
+    }
+
+    hash_set(db->alloc, &db->first_referrer, target.info.slot, link);
+    return link;
+}
+
+static void link_reference(database_o* db,
+                           object_id_t source,
+                           uint32_t property,
+                           object_id_t target)
+{
+    uint32_t link = add_link(db, source, property, target);
+    if (link)
+    {
+        hash_set(db->alloc,
+                 &db->link_of_reference,
+                 reference_key(source, property),
+                 link);
+    }
+}
+
+// Links the element appended at the end of a PTYPE_REFERENCE_ARRAY.
+static void link_element(database_o* db,
+                         object_id_t source,
+                         uint32_t property,
+                         object_id_t target)
+{
+    uint64_t key = property_slot_key(source, property);
+    uint32_t* links = (uint32_t*)hash_find(&db->links_of_array, key, 0);
+    uint32_t link = add_link(db, source, property, target);
+    ASSERT(link);
+    db->links[link - 1].element = array_count(links);
+    array_push(db->alloc, links, link);
+    hash_set(db->alloc, &db->links_of_array, key, (uint64_t)links);
+}
+
+// Links every element of a PTYPE_REFERENCE_ARRAY copied from another
+// object.
+static void link_elements(database_o* db,
+                          object_id_t source,
+                          uint32_t property,
+                          const blob_t* blob)
+{
+    const object_id_t* ids = (const object_id_t*)blob_bytes(db, blob);
+    for (uint32_t i = 0; i < blob->size / sizeof(object_id_t); i++)
+    {
+        link_element(db, source, property, ids[i]);
+    }
+}
+
+static void unlink_reference(database_o* db, uint32_t link)
+{
+    reference_link_t* l = &db->links[link - 1];
+
+    if (l->prev)
+    {
+        db->links[l->prev - 1].next = l->next;
+    }
+    else if (l->next)
+    {
+        hash_set(db->alloc, &db->first_referrer, l->target_slot, l->next);
+    }
+    else
+    {
+        hash_remove(&db->first_referrer, l->target_slot);
+    }
+    if (l->next)
+    {
+        db->links[l->next - 1].prev = l->prev;
+    }
+
+    if (db->properties[l->property].def.type == PTYPE_REFERENCE)
+    {
+        hash_remove(&db->link_of_reference,
+                    reference_key(l->source, l->property));
+    }
+
+    *l = (reference_link_t){.next = db->first_free_link};
+    db->first_free_link = link;
+}
+
+static void
+unlink_elements(database_o* db, object_id_t source, uint32_t property)
+{
+    uint64_t key = property_slot_key(source, property);
+    uint32_t* links = (uint32_t*)hash_find(&db->links_of_array, key, 0);
+    if (links)
+    {
+        for (uint32_t i = 0; i < array_count(links); i++)
+        {
+            unlink_reference(db, links[i]);
+        }
+        array_free(db->alloc, links);
+        hash_remove(&db->links_of_array, key);
+    }
+}
+
+// Frees a hash whose values are arrays, such as db->links_of_array.
+static void free_hash_of_arrays(mem_allocator_i* alloc, hash_t* hash)
+{
+    for (uint32_t i = 0; i < hash->bucket_count; i++)
+    {
+        uint64_t key = hash->keys[i];
+        if (key && key != UINT64_MAX)
+        {
+            uint32_t* array = (uint32_t*)hash->values[i];
+            array_free(alloc, array);
+        }
+    }
+    hash_free(alloc, hash);
+}
+
+// Rebuilds the lookups of db->links, which are keyed by slot.
+static void index_links(database_o* db)
+{
+    hash_free(db->alloc, &db->first_referrer);
+    hash_free(db->alloc, &db->link_of_reference);
+    free_hash_of_arrays(db->alloc, &db->links_of_array);
+
+    for (uint32_t i = 0; i < array_count(db->links); i++)
+    {
+        const reference_link_t* l = &db->links[i];
+        if (!l->source.index)
+        {
+            continue; // free link
+        }
+        if (!l->prev)
+        {
+            hash_set(db->alloc, &db->first_referrer, l->target_slot, i + 1);
+        }
+        if (db->properties[l->property].def.type == PTYPE_REFERENCE)
+        {
+            hash_set(db->alloc,
+                     &db->link_of_reference,
+                     reference_key(l->source, l->property),
+                     i + 1);
+            continue;
+        }
+
+        uint64_t key = property_slot_key(l->source, l->property);
+        uint32_t* links = (uint32_t*)hash_find(&db->links_of_array, key, 0);
+        while (array_count(links) <= l->element)
+        {
+            array_push(db->alloc, links, 0);
+        }
+        links[l->element] = i + 1;
+        hash_set(db->alloc, &db->links_of_array, key, (uint64_t)links);
+    }
+}
+
+static void
+unlink_outgoing_reference(database_o* db, object_id_t source, uint32_t property)
+{
+    uint32_t link = hash_find(&db->link_of_reference,
+                              reference_key(source, property),
+                              0);
+    if (link)
+    {
+        unlink_reference(db, link);
+    }
+}
+
+static void begin_write(database_o* db, const property_ref_t* ref);
+static void end_write(database_o* db, const property_ref_t* ref);
+
+// A write to a hot property of a prototype changes the value of every
+// instance reading it, which begin_write and end_write pass on to them.
+// The element links of their arrays are redone as a whole.
+static void
+write_inherited(database_o* db, const property_ref_t* ref, bool begin)
+{
+    if (!db->instance_count || ref->prop->cold)
+    {
+        return;
+    }
+
+    uint32_t* instances =
+        (uint32_t*)hash_find(&db->instances_of, ref->object->id.info.slot, 0);
+    uint32_t property = ref->prop - db->properties;
+    for (uint32_t i = 0; i < array_count(instances); i++)
+    {
+        object_t* instance = &db->objects[instances[i]];
+        if (find_override(db, instance, ref->prop))
+        {
+            continue;
+        }
+
+        property_ref_t inherited = {instance, ref->prop, ref->data};
+        if (begin)
+        {
+            begin_write(db, &inherited);
+        }
+        else
+        {
+            end_write(db, &inherited);
+        }
+
+        if (ref->prop->def.type == PTYPE_REFERENCE_ARRAY && begin)
+        {
+            unlink_elements(db, instance->id, property);
+        }
+        else if (ref->prop->def.type == PTYPE_REFERENCE_ARRAY)
+        {
+            link_elements(db, instance->id, property, ref->data);
+        }
+    }
+}
+
+// Snapshots are released from any thread, the next write collects them
+// and the payloads only they could read.
+static void collect_released(database_o* db)
+{
+    if (atomic_load_explicit(&db->released_snapshots, memory_order_relaxed))
+    {
+        collect_snapshots(db, false);
+    }
+}
+
+// Every change to the value of a property goes through begin_write and
+// end_write, which keep the derived data structures up to date.
+static void begin_write(database_o* db, const property_ref_t* ref)
+{
+    collect_released(db);
+    if (ref->prop->index)
+    {
+        index_remove(db, ref->prop, ref->object->id, ref->data);
+    }
+
+    if (ref->prop->def.type == PTYPE_REFERENCE)
+    {
+        unlink_outgoing_reference(db,
+                                  ref->object->id,
+                                  ref->prop - db->properties);
+    }
+    write_inherited(db, ref, true);
+}
+
+static void end_write(database_o* db, const property_ref_t* ref)
+{
+    uint64_t version = ++db->version;
+    object_type_definition_t* type =
+        &db->object_types[ref->object->id.info.type.index];
+
+    type->version = version;
+    type->row_versions[ref->object->row] = version;
+    if (ref->prop->row_versions)
+    {
+        ref->prop->row_versions[ref->object->row] = version;
+    }
+
+    if (ref->prop->index)
+    {
+        index_insert(db, ref->prop, ref->object->id, ref->data);
+    }
+
+    if (ref->prop->def.type == PTYPE_REFERENCE)
+    {
+        link_reference(db,
+                       ref->object->id,
+                       ref->prop - db->properties,
+                       *(object_id_t*)ref->data);
+    }
+    write_inherited(db, ref, false);
+}
+
+static void
+write_property(database_o* db, const property_ref_t* ref, const void* value)
+{
+    begin_write(db, ref);
+    memcpy(ref->data, value, ref->prop->size);
+    end_write(db, ref);
+}
+
+static uint32_t scan_objects(database_o* db,
+                             const property_layout_t* prop,
+                             uint64_t min_key,
+                             uint64_t max_key,
+                             object_id_t* results,
+                             uint32_t max_results)
+{
+    const object_type_definition_t* type = &db->object_types[prop->owner.index];
+
+    uint32_t found = 0;
+    for (uint32_t row = 0; row < array_count(type->row_slots); row++)
+    {
+        const object_t* object = &db->objects[type->row_slots[row]];
+        uint64_t key =
+            index_key(prop->def.type, get_property_data(db, object, prop));
+
+        if (key >= min_key && key <= max_key)
+        {
+            if (found < max_results)
+            {
+                results[found] = object->id;
+            }
+            found++;
+        }
+    }
+
+    return found;
+}
+
+static uint32_t find_objects_in_range(database_o* db,
+                                      const property_layout_t* prop,
+                                      uint64_t min_key,
+                                      uint64_t max_key,
+                                      object_id_t* results,
+                                      uint32_t max_results)
+{
+    if (min_key > max_key)
+    {
+        return 0;
+    }
+
+    property_index_t* index = prop->index;
+    if (index && (prop->def.flags & PROPERTY_INDEX_HASH) && min_key == max_key)
+    {
+        uint32_t found = 0;
+        uint32_t entry = hash_find(&index->chains, chain_key(min_key), 0);
+        while (entry)
+        {
+            const index_entry_t* e = &index->entries[entry - 1];
+            if (e->key == min_key)
+            {
+                if (found < max_results)
+                {
+                    results[found] = e->id;
+                }
+                found++;
+            }
+            entry = e->next;
+        }
+        return found;
+    }
+    else if (index && (prop->def.flags & PROPERTY_INDEX_ORDERED))
+    {
+        uint32_t first = ordered_lower_bound(index, min_key, 0);
+        uint32_t found = 0;
+        for (uint32_t i = first; i < array_count(index->sorted)
+                                 && index->sorted[i].key <= max_key;
+             i++)
+        {
+            if (found < max_results)
+            {
+                results[found] = index->sorted[i].id;
+            }
+            found++;
+        }
+        return found;
+    }
+    else
+    {
+        return scan_objects(db, prop, min_key, max_key, results, max_results);
+    }
+}
+
+static const property_layout_t* get_property_of_type(database_o* db,
+                                                     property_handle_t property,
+                                                     uint16_t property_type)
+{
+    if (!property.index || property.index >= array_count(db->properties)
+        || db->properties[property.index].def.type != property_type)
+    {
+        return 0;
+    }
+
+    return &db->properties[property.index];
+}
+
+static bool get_index_stats(database_o* db,
+                            property_handle_t property,
+                            property_index_stats_t* stats)
+{
+    if (!property.index || property.index >= array_count(db->properties)
+        || !db->properties[property.index].index)
+    {
+        return false;
+    }
+
+    const property_index_t* index = db->properties[property.index].index;
+    *stats = (property_index_stats_t){
+        .update_count = index->update_count,
+        .update_nanoseconds = index->update_nanoseconds,
+    };
+
+    if (index->entries)
+    {
+        uint32_t capacity = array_header(index->entries)->capacity;
+        stats->entry_count = index->live_count;
+        stats->bytes += sizeof(index_entry_t) * capacity;
+        stats->bytes += 2 * sizeof(uint64_t) * index->chains.bucket_count;
+        stats->bytes +=
+            2 * sizeof(uint64_t) * index->entry_of_slot.bucket_count;
+    }
+    if (index->sorted)
+    {
+        uint32_t capacity = array_header(index->sorted)->capacity;
+        stats->entry_count = array_count(index->sorted);
+        stats->bytes += sizeof(ordered_entry_t) * capacity;
+    }
+
+    return true;
+}
+
+#define DO_DEFINE_FIND(upper, lower, type)                                     \
+    static uint32_t find_##lower(database_o* db,                               \
+                                 property_handle_t property,                   \
+                                 type value,                                   \
+                                 object_id_t* results,                         \
+                                 uint32_t max_results)                         \
+    {                                                                          \
+        const property_layout_t* prop =                                        \
+            get_property_of_type(db, property, PTYPE_##upper);                 \
+        if (!prop)                                                             \
+        {                                                                      \
+            return 0;                                                          \
+        }                                                                      \
+        uint64_t key = index_key(PTYPE_##upper, &value);                       \
+        return find_objects_in_range(db,                                       \
+                                     prop,                                     \
+                                     key,                                      \
+                                     key,                                      \
+                                     results,                                  \
+                                     max_results);                             \
+    }                                                                          \
+                                                                               \
+    static uint32_t find_##lower##_range(database_o* db,                       \
+                                         property_handle_t property,           \
+                                         type min,                             \
+                                         type max,                             \
+                                         object_id_t* results,                 \
+                                         uint32_t max_results)                 \
+    {                                                                          \
+        const property_layout_t* prop =                                        \
+            get_property_of_type(db, property, PTYPE_##upper);                 \
+        if (!prop)                                                             \
+        {                                                                      \
+            return 0;                                                          \
+        }                                                                      \
+        return find_objects_in_range(db,                                       \
+                                     prop,                                     \
+                                     index_key(PTYPE_##upper, &min),           \
+                                     index_key(PTYPE_##upper, &max),           \
+                                     results,                                  \
+                                     max_results);                             \
+    }
+
+FOR_ALL_BASE_PROPERTY_TYPES(DO_DEFINE_FIND)
+
+static uint32_t find_string(database_o* db,
+                            property_handle_t property,
+                            string_id_t value,
+                            object_id_t* results,
+                            uint32_t max_results)
+{
+    const property_layout_t* prop =
+        get_property_of_type(db, property, PTYPE_STRING);
+    if (!prop)
+    {
+        return 0;
+    }
+    return find_objects_in_range(db,
+                                 prop,
+                                 value.hash,
+                                 value.hash,
+                                 results,
+                                 max_results);
+}
+
+// Reductions over a numeric property of every live object of its type.
+// Kernels work on contiguous arrays of values : the column of
+// OBJECT_TYPE_COLUMNAR types, or blocks of AGGREGATE_BLOCK values
+// gathered from the payloads otherwise. Values are widened to double,
+// which is also what sums are accumulated in.
+#define AGGREGATE_BLOCK 1024
+
+typedef struct reduction_t
+{
+    double sum;
+    double min;
+    double max;
+} reduction_t;
+
+typedef void reduce_kernel_t(const void* values,
+                             uint32_t count,
+                             reduction_t* r);
+typedef uint32_t count_kernel_t(const void* values,
+                                uint32_t count,
+                                double min,
+                                double max);
+
+typedef struct aggregate_kernels_t
+{
+    reduce_kernel_t* reduce;
+    count_kernel_t* count_in_range;
+} aggregate_kernels_t;
+
+// By PTYPE_*, filled by select_aggregate_kernels for the running CPU.
+static aggregate_kernels_t aggregate_kernels[PTYPE_FLOAT64 + 1];
+
+#define DO_DEFINE_SCALAR_KERNELS(upper, lower, type)                           \
+    static void reduce_##lower##_scalar(const void* data,                      \
+                                         uint32_t count,                       \
+                                         reduction_t* r)                       \
+    {                                                                          \
+        const type* values = data;                                             \
+        double sum = 0.;                                                       \
+        double lo = r->min;                                                    \
+        double hi = r->max;                                                    \
+        for (uint32_t i = 0; i < count; i++)                                   \
+        {                                                                      \
+            double v = (double)values[i];                                      \
+            sum += v;                                                          \
+            lo = v < lo ? v : lo;                                              \
+            hi = v > hi ? v : hi;                                              \
+        }                                                                      \
+        r->sum += sum;                                                         \
+        r->min = lo;                                                           \
+        r->max = hi;                                                           \
+    }                                                                          \
+                                                                               \
+    static uint32_t count_##lower##_scalar(const void* data,                   \
+                                           uint32_t count,                     \
+                                           double min,                         \
+                                           double max)                         \
+    {                                                                          \
+        const type* values = data;                                             \
+        uint32_t found = 0;                                                    \
+        for (uint32_t i = 0; i < count; i++)                                   \
+        {                                                                      \
+            double v = (double)values[i];                                      \
+            found += v >= min && v <= max;                                     \
+        }                                                                      \
+        return found;                                                          \
+    }
+
+FOR_ALL_BASE_PROPERTY_TYPES(DO_DEFINE_SCALAR_KERNELS)
+
+#ifdef DATABASE_SIMD_X86
+// Types with a vector conversion to double below AVX-512. The loads
+// widen 2 (SSE2) or 4 (AVX2) values starting at p.
+#define FOR_ALL_SIMD_PROPERTY_TYPES(X)                                         \
+    X(INT32, int32, int32_t)                                                   \
+    X(UINT32, uint32, uint32_t)                                                \
+    X(FLOAT32, float32, float)                                                 \
+    X(FLOAT64, float64, double)
+
+static inline __m128d load_int32_sse2(const int32_t* p)
+{
+    return _mm_cvtepi32_pd(_mm_loadl_epi64((const __m128i*)p));
+}
+
+static inline __m128d load_uint32_sse2(const uint32_t* p)
+{
+    // Shifted into the int32 range for the conversion, and back.
+    __m128i v = _mm_loadl_epi64((const __m128i*)p);
+    v = _mm_xor_si128(v, _mm_set1_epi32(INT32_MIN));
+    return _mm_add_pd(_mm_cvtepi32_pd(v), _mm_set1_pd(2147483648.));
+}
+
+static inline __m128d load_float32_sse2(const float* p)
+{
+    return _mm_cvtps_pd(
+        _mm_castsi128_ps(_mm_loadl_epi64((const __m128i*)p)));
+}
+
+static inline __m128d load_float64_sse2(const double* p)
+{
+    return _mm_loadu_pd(p);
+}
+
+__attribute__((target("avx2"))) static inline __m256d
+load_int32_avx2(const int32_t* p)
+{
+    return _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i*)p));
+}
+
+__attribute__((target("avx2"))) static inline __m256d
+load_uint32_avx2(const uint32_t* p)
+{
+    __m128i v = _mm_loadu_si128((const __m128i*)p);
+    v = _mm_xor_si128(v, _mm_set1_epi32(INT32_MIN));
+    return _mm256_add_pd(_mm256_cvtepi32_pd(v), _mm256_set1_pd(2147483648.));
+}
+
+__attribute__((target("avx2"))) static inline __m256d
+load_float32_avx2(const float* p)
+{
+    return _mm256_cvtps_pd(_mm_loadu_ps(p));
+}
+
+__attribute__((target("avx2"))) static inline __m256d
+load_float64_avx2(const double* p)
+{
+    return _mm256_loadu_pd(p);
+}
+
+// Two accumulators per loop to hide the latency of the additions, the
+// remaining values go through the scalar kernel.
+#define DO_DEFINE_SSE2_KERNELS(upper, lower, type)                             \
+    static void reduce_##lower##_sse2(const void* data,                        \
+                                       uint32_t count,                         \
+                                       reduction_t* r)                         \
+    {                                                                          \
+        const type* values = data;                                             \
+        __m128d sum0 = _mm_setzero_pd();                                       \
+        __m128d sum1 = _mm_setzero_pd();                                       \
+        __m128d lo = _mm_set1_pd(r->min);                                      \
+        __m128d hi = _mm_set1_pd(r->max);                                      \
+        uint32_t i = 0;                                                        \
+        for (; i + 4 <= count; i += 4)                                         \
+        {                                                                      \
+            __m128d a = load_##lower##_sse2(values + i);                       \
+            __m128d b = load_##lower##_sse2(values + i + 2);                   \
+            sum0 = _mm_add_pd(sum0, a);                                        \
+            sum1 = _mm_add_pd(sum1, b);                                        \
+            lo = _mm_min_pd(lo, _mm_min_pd(a, b));                             \
+            hi = _mm_max_pd(hi, _mm_max_pd(a, b));                             \
+        }                                                                      \
+        double sums[2], mins[2], maxs[2];                                      \
+        _mm_storeu_pd(sums, _mm_add_pd(sum0, sum1));                           \
+        _mm_storeu_pd(mins, lo);                                               \
+        _mm_storeu_pd(maxs, hi);                                               \
+        r->sum += sums[0] + sums[1];                                           \
+        r->min = mins[0] < mins[1] ? mins[0] : mins[1];                        \
+        r->max = maxs[0] > maxs[1] ? maxs[0] : maxs[1];                        \
+        reduce_##lower##_scalar(values + i, count - i, r);                     \
+    }                                                                          \
+                                                                               \
+    static uint32_t count_##lower##_sse2(const void* data,                     \
+                                         uint32_t count,                       \
+                                         double min,                           \
+                                         double max)                           \
+    {                                                                          \
+        const type* values = data;                                             \
+        __m128d lo = _mm_set1_pd(min);                                         \
+        __m128d hi = _mm_set1_pd(max);                                         \
+        uint32_t found = 0;                                                    \
+        uint32_t i = 0;                                                        \
+        for (; i + 2 <= count; i += 2)                                         \
+        {                                                                      \
+            __m128d v = load_##lower##_sse2(values + i);                       \
+            __m128d in = _mm_and_pd(_mm_cmpge_pd(v, lo), _mm_cmple_pd(v, hi)); \
+            found += __builtin_popcount(_mm_movemask_pd(in));                  \
+        }                                                                      \
+        found += count_##lower##_scalar(values + i, count - i, min, max);      \
+        return found;                                                          \
+    }
+
+#define DO_DEFINE_AVX2_KERNELS(upper, lower, type)                             \
+    __attribute__((target("avx2"))) static void reduce_##lower##_avx2(         \
+        const void* data, uint32_t count, reduction_t* r)                      \
+    {                                                                          \
+        const type* values = data;                                             \
+        __m256d sum0 = _mm256_setzero_pd();                                    \
+        __m256d sum1 = _mm256_setzero_pd();                                    \
+        __m256d lo = _mm256_set1_pd(r->min);                                   \
+        __m256d hi = _mm256_set1_pd(r->max);                                   \
+        uint32_t i = 0;                                                        \
+        for (; i + 8 <= count; i += 8)                                         \
+        {                                                                      \
+            __m256d a = load_##lower##_avx2(values + i);                       \
+            __m256d b = load_##lower##_avx2(values + i + 4);                   \
+            sum0 = _mm256_add_pd(sum0, a);                                     \
+            sum1 = _mm256_add_pd(sum1, b);                                     \
+            lo = _mm256_min_pd(lo, _mm256_min_pd(a, b));                       \
+            hi = _mm256_max_pd(hi, _mm256_max_pd(a, b));                       \
+        }                                                                      \
+        double sums[4], mins[4], maxs[4];                                      \
+        _mm256_storeu_pd(sums, _mm256_add_pd(sum0, sum1));                     \
+        _mm256_storeu_pd(mins, lo);                                            \
+        _mm256_storeu_pd(maxs, hi);                                            \
+        r->sum += (sums[0] + sums[1]) + (sums[2] + sums[3]);                   \
+        for (uint32_t j = 0; j < 4; j++)                                       \
+        {                                                                      \
+            r->min = mins[j] < r->min ? mins[j] : r->min;                      \
+            r->max = maxs[j] > r->max ? maxs[j] : r->max;                      \
+        }                                                                      \
+        reduce_##lower##_scalar(values + i, count - i, r);                     \
+    }                                                                          \
+                                                                               \
+    __attribute__((target("avx2"))) static uint32_t count_##lower##_avx2(      \
+        const void* data, uint32_t count, double min, double max)              \
+    {                                                                          \
+        const type* values = data;                                             \
+        __m256d lo = _mm256_set1_pd(min);                                      \
+        __m256d hi = _mm256_set1_pd(max);                                      \
+        uint32_t found = 0;                                                    \
+        uint32_t i = 0;                                                        \
+        for (; i + 4 <= count; i += 4)                                         \
+        {                                                                      \
+            __m256d v = load_##lower##_avx2(values + i);                       \
+            __m256d in = _mm256_and_pd(_mm256_cmp_pd(v, lo, _CMP_GE_OQ),       \
+                                       _mm256_cmp_pd(v, hi, _CMP_LE_OQ));      \
+            found += __builtin_popcount(_mm256_movemask_pd(in));               \
+        }                                                                      \
+        found += count_##lower##_scalar(values + i, count - i, min, max);      \
+        return found;                                                          \
+    }
+
+FOR_ALL_SIMD_PROPERTY_TYPES(DO_DEFINE_SSE2_KERNELS)
+FOR_ALL_SIMD_PROPERTY_TYPES(DO_DEFINE_AVX2_KERNELS)
+#endif
+
+#define DO_SELECT_KERNELS(upper, lower, isa)                                   \
+    aggregate_kernels[PTYPE_##upper] = (aggregate_kernels_t){                  \
+        .reduce = reduce_##lower##_##isa,                                      \
+        .count_in_range = count_##lower##_##isa,                               \
+    };
+#define DO_SELECT_SCALAR_KERNELS(upper, lower, type)                           \
+    DO_SELECT_KERNELS(upper, lower, scalar)
+#define DO_SELECT_SSE2_KERNELS(upper, lower, type)                             \
+    DO_SELECT_KERNELS(upper, lower, sse2)
+#define DO_SELECT_AVX2_KERNELS(upper, lower, type)                             \
+    DO_SELECT_KERNELS(upper, lower, avx2)
+
+static void select_aggregate_kernels(void)
+{
+    FOR_ALL_BASE_PROPERTY_TYPES(DO_SELECT_SCALAR_KERNELS)
+
+#ifdef DATABASE_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        FOR_ALL_SIMD_PROPERTY_TYPES(DO_SELECT_AVX2_KERNELS)
+    }
+    else
+    {
+        FOR_ALL_SIMD_PROPERTY_TYPES(DO_SELECT_SSE2_KERNELS)
+    }
+#endif
+}
+
+static const property_layout_t* get_numeric_property(database_o* db,
+                                                     property_handle_t property)
+{
+    if (!property.index || property.index >= array_count(db->properties))
+    {
+        return 0;
+    }
+
+    const property_layout_t* prop = &db->properties[property.index];
+    return prop->def.type >= PTYPE_BOOL && prop->def.type <= PTYPE_FLOAT64
+               ? prop
+               : 0;
+}
+
+// Values of prop for count rows starting at first_row, contiguous.
+static const void* aggregate_block(database_o* db,
+                                   const property_layout_t* prop,
+                                   uint32_t first_row,
+                                   uint32_t count,
+                                   void* buffer)
+{
+    const object_type_definition_t* type = &db->object_types[prop->owner.index];
+    if (type->flags & OBJECT_TYPE_COLUMNAR)
+    {
+        return (const uint8_t*)prop->column + (uint64_t)first_row * prop->size;
+    }
+
+    uint8_t* values = buffer;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const object_t* object = &db->objects[type->row_slots[first_row + i]];
+        memcpy(values + i * prop->size,
+               get_property_data(db, object, prop),
+               prop->size);
+    }
+    return buffer;
+}
+
+static bool aggregate_h(database_o* db,
+                        property_handle_t property,
+                        property_aggregate_t* result)
+{
+    const property_layout_t* prop = get_numeric_property(db, property);
+    if (!prop)
+    {
+        return false;
+    }
+
+    const object_type_definition_t* type = &db->object_types[prop->owner.index];
+    reduce_kernel_t* reduce = aggregate_kernels[prop->def.type].reduce;
+    uint32_t row_count = array_count(type->row_slots);
+
+    reduction_t r = {.min = INFINITY, .max = -INFINITY};
+    uint64_t buffer[AGGREGATE_BLOCK];
+    for (uint32_t row = 0; row < row_count; row += AGGREGATE_BLOCK)
+    {
+        uint32_t count = row_count - row < AGGREGATE_BLOCK ? row_count - row
+                                                           : AGGREGATE_BLOCK;
+        reduce(aggregate_block(db, prop, row, count, buffer), count, &r);
+    }
+
+    *result = (property_aggregate_t){.count = row_count};
+    if (row_count)
+    {
+        result->sum = r.sum;
+        result->min = r.min;
+        result->max = r.max;
+        result->mean = r.sum / row_count;
+    }
+    return true;
+}
+
+static uint32_t count_in_range_h(database_o* db,
+                                 property_handle_t property,
+                                 double min,
+                                 double max)
+{
+    const property_layout_t* prop = get_numeric_property(db, property);
+    if (!prop)
+    {
+        return 0;
+    }
+
+    const object_type_definition_t* type = &db->object_types[prop->owner.index];
+    count_kernel_t* count_in_range =
+        aggregate_kernels[prop->def.type].count_in_range;
+    uint32_t row_count = array_count(type->row_slots);
+
+    uint32_t found = 0;
+    uint64_t buffer[AGGREGATE_BLOCK];
+    for (uint32_t row = 0; row < row_count; row += AGGREGATE_BLOCK)
+    {
+        uint32_t count = row_count - row < AGGREGATE_BLOCK ? row_count - row
+                                                           : AGGREGATE_BLOCK;
+        found += count_in_range(aggregate_block(db, prop, row, count, buffer),
+                                count,
+                                min,
+                                max);
+    }
+    return found;
+}
+
+// Changes made through the API while a journal is open are appended to
+// it as records, and written to disk in batches by commit_journal. A
+// batch ends with a JOURNAL_COMMIT record holding its checksum, so that
+// a batch torn by a crash is ignored by replay_journal.
+#define JOURNAL_MAGIC 0x4c4e524a49554f /* "OUIJRNL" */
+#define JOURNAL_VERSION 1
+#define JOURNAL_MIN_COMPACT_SIZE Mebi(1)
+
+typedef enum journal_record_kind_e
+{
+    JOURNAL_CREATE = 1,
+    JOURNAL_DESTROY,
+    JOURNAL_SET,
+    JOURNAL_BLOB_SIZE,
+    JOURNAL_BLOB_WRITE,
+    JOURNAL_COMMIT,
+    JOURNAL_BLOB_SET,
+    JOURNAL_SUB_OBJECT,
+    JOURNAL_CREATE_BATCH, // ids in the payload
+    JOURNAL_DESTROY_BATCH,
+    JOURNAL_SET_BATCH, // ids then values in the payload
+    JOURNAL_CLONE, // property is true for a copy on write clone
+    JOURNAL_INSTANCE, // id is the prototype
+    JOURNAL_ARRAY_APPEND, // reference in the payload, or sub-object
+    JOURNAL_ARRAY_REMOVE, // offset is the index
+    JOURNAL_STRING, // text in the payload, offset is its id
+    JOURNAL_COMPACT, // offset is the count of moved objects
+} journal_record_kind_e;
+
+typedef struct journal_header_t
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t padding;
+    uint64_t base_version; // of the snapshot the journal applies to
+} journal_header_t;
+
+// Followed by size bytes of payload, padded to 8 bytes.
+typedef struct journal_record_t
+{
+    uint32_t kind;
+    uint32_t property; // object type for JOURNAL_CREATE
+    object_id_t id; // JOURNAL_COMMIT : database version after the batch
+    uint64_t offset; // blob offset or size, sub-object, commit checksum
+    uint64_t size;
+} journal_record_t;
+
+struct database_journal_t
+{
+    platform_file_o* file;
+    char snapshot_path[1024];
+    char journal_path[1024];
+
+    /* array */ uint8_t* pending; // records of the next batch
+    uint64_t file_size; // end of the last committed batch
+    uint64_t compact_size; // file_size triggering a compaction
+};
+
+// Adds record to an array of records, returns where to write its
+// record.size bytes of payload.
+static uint8_t* record_reserve(mem_allocator_i* alloc,
+                               uint8_t** records,
+                               journal_record_t record)
+{
+    uint64_t padded = (record.size + 7) & ~7ull;
+    uint64_t at = array_count(*records);
+
+    ASSERT(at + sizeof(record) + padded <= UINT32_MAX);
+    array_reserve(alloc, *records, at + sizeof(record) + padded);
+    array_header(*records)->count += sizeof(record) + padded;
+
+    uint8_t* dst = *records + at;
+    memcpy(dst, &record, sizeof(record));
+    memset(dst + sizeof(record) + record.size, 0, padded - record.size);
+    return dst + sizeof(record);
+}
+
+static uint8_t* journal_reserve(database_o* db, journal_record_t record)
+{
+    return record_reserve(db->alloc, &db->journal->pending, record);
+}
+
+static void journal_append(database_o* db,
+                           journal_record_t record,
+                           const void* payload)
+{
+    // records without payload pass null, with a size of 0
+    ASSERT(payload || !record.size);
+    uint8_t* dst = journal_reserve(db, record);
+    if (payload)
+    {
+        memcpy(dst, payload, record.size);
+    }
+}
+
+// Ids don't carry their text : it's journaled before the records writing
+// the id, for replay_journal to intern it.
+static void journal_string(database_o* db, string_id_t id)
+{
+    const char* text = string_text(id);
+    if (db->journal && text)
+    {
+        journal_append(db,
+                       (journal_record_t){
+                           .kind = JOURNAL_STRING,
+                           .offset = id.hash,
+                           .size = strlen(text) + 1,
+                       },
+                       text);
+    }
+}
+
+// Only interned ids can be written, the others couldn't be saved.
+static bool is_valid_value(const property_layout_t* prop, const void* value)
+{
+    const string_id_t* id = value;
+    return prop->def.type != PTYPE_STRING || !id->hash || string_text(*id);
+}
+
+static void journal_set(database_o* db,
+                        object_id_t id,
+                        property_handle_t property,
+                        const void* value,
+                        uint64_t size)
+{
+    if (db->journal)
+    {
+        if (db->properties[property.index].def.type == PTYPE_STRING)
+        {
+            journal_string(db, *(const string_id_t*)value);
+        }
+        journal_append(db,
+                       (journal_record_t){
+                           .kind = JOURNAL_SET,
+                           .property = property.index,
+                           .id = id,
+                           .size = size,
+                       },
+                       value);
+    }
+}
+
+#define DO_DEFINE_GETTER_SETTER(upper, lower, type)                            \
+    static type get_##lower##_or_h(database_o* db,                             \
+                                   object_id_t object,                         \
+                                   property_handle_t property,                 \
+                                   type fallback)                              \
+    {                                                                          \
+        type* ptr = get_property_ptr(db, object, PTYPE_##upper, property);     \
+        return ptr ? *ptr : fallback;                                          \
+    }                                                                          \
+                                                                               \
+    static type get_##lower##_h(database_o* db,                                \
+                                object_id_t object,                            \
+                                property_handle_t property)                    \
+    {                                                                          \
+        type* ptr = get_property_ptr(db, object, PTYPE_##upper, property);     \
+        ASSERT(ptr);                                                           \
+        return *ptr;                                                           \
+    }                                                                          \
+                                                                               \
+    static bool set_##lower##_h(database_o* db,                                \
+                                object_id_t object,                            \
+                                property_handle_t property,                    \
+                                type value)                                    \
+    {                                                                          \
+        property_ref_t ref;                                                    \
+        if (!resolve_property_mut(db,                                          \
+                                  object,                                      \
+                                  PTYPE_##upper,                               \
+                                  (object_type_t){0},                          \
+                                  property,                                    \
+                                  &ref))                                       \
+        {                                                                      \
+            return false;                                                      \
+        }                                                                      \
+        else                                                                   \
+        {                                                                      \
+            write_property(db, &ref, &value);                                  \
+            journal_set(db, object, property, &value, sizeof(value));          \
+            return true;                                                       \
+        }                                                                      \
+    }                                                                          \
+                                                                               \
+    static type get_##lower##_or(database_o* db,                               \
+                                 object_id_t object,                           \
+                                 const char* name,                             \
+                                 type fallback)                                \
+    {                                                                          \
+        return get_##lower##_or_h(db,                                          \
+                                  object,                                      \
+                                  find_object_property(db, object, name),      \
+                                  fallback);                                   \
+    }                                                                          \
+                                                                               \
+    static type get_##lower(database_o* db,                                    \
+                            object_id_t object,                                \
+                            const char* name)                                  \
+    {                                                                          \
+        return get_##lower##_h(db,                                             \
+                               object,                                         \
+                               find_object_property(db, object, name));        \
+    }                                                                          \
+                                                                               \
+    static bool set_##lower(database_o* db,                                    \
+                            object_id_t object,                                \
+                            const char* name,                                  \
+                            type value)                                        \
+    {                                                                          \
+        return set_##lower##_h(db,                                             \
+                               object,                                         \
+                               find_object_property(db, object, name),         \
+                               value);                                         \
+    }
+
+FOR_ALL_BASE_PROPERTY_TYPES(DO_DEFINE_GETTER_SETTER)
+
+static bool reallocate_blob_h(database_o* db,
+                              object_id_t id,
+                              property_handle_t property,
+                              uint64_t size)
+{
+    property_ref_t ref;
+    if (resolve_property_mut(db,
+                             id,
+                             PTYPE_BLOB,
+                             (object_type_t){0},
+                             property,
+                             &ref))
+    {
+        blob_t* ptr = ref.data;
+        blob_header_t* header = blob_header(ptr);
+        uint64_t kept = size < ptr->size ? size : ptr->size;
+
+        begin_write(db, &ref);
+        if (!size)
+        {
+            blob_assign(db, ptr, 0);
+        }
+        else if (header && header->refcount == 1)
+        {
+            blob_unhash(db, header);
+            db->blob_stats.logical_bytes += size - header->used;
+            db->blob_stats.stored_bytes += size - header->used;
+            db->blob_stats.reserved_bytes += size - header->size;
+
+            // TODO(octave) : error check memcpy
+            header = mem_realloc(db->alloc,
+                                 header,
+                                 sizeof(*header) + header->size,
+                                 sizeof(*header) + size);
+            header->size = size;
+            header->used = size;
+            ptr->data = header + 1;
+            ptr->size = size;
+        }
+        else
+        {
+            blob_header_t* resized = blob_alloc(db, size);
+            if (kept)
+            {
+                memcpy(resized + 1, blob_bytes(db, ptr), kept);
+            }
+            blob_assign(db, ptr, resized);
+        }
+        memset(blob_bytes(db, ptr) + kept, 0, size - kept);
+        end_write(db, &ref);
+
+        if (db->journal)
+        {
+            journal_append(db,
+                           (journal_record_t){
+                               .kind = JOURNAL_BLOB_SIZE,
+                               .property = property.index,
+                               .id = id,
+                               .offset = size,
+                           },
+                           0);
+        }
+        return true;
+    }
+    else
+    {
+        return false;
+    }
+}
+
+static bool blob_range_ok(const blob_t* blob, uint64_t offset, uint64_t size)
+{
+    return offset <= blob->size && size <= blob->size - offset;
+}
+
+static bool get_blob_data_h(database_o* db,
+                            object_id_t id,
+                            property_handle_t property,
+                            uint64_t offset,
+                            uint64_t size,
+                            void* data)
+{
+    blob_t* ptr = get_property_ptr(db, id, PTYPE_BLOB, property);
+
+    if (!ptr || !blob_range_ok(ptr, offset, size))
+    {
+        // TODO(octave) : error handling.
+        return false;
+    }
+    else
+    {
+        // TODO(octave) : error check memcpy
+        memcpy(data, blob_bytes(db, ptr) + offset, size);
+        return true;
+    }
+}
+
+static bool set_blob_data_h(database_o* db,
+                            object_id_t id,
+                            property_handle_t property,
+                            uint64_t offset,
+                            uint64_t size,
+                            const void* data)
+{
+    property_ref_t ref;
+    if (!resolve_property_mut(db,
+                              id,
+                              PTYPE_BLOB,
+                              (object_type_t){0},
+                              property,
+                              &ref)
+        || !blob_range_ok(ref.data, offset, size))
+    {
+        // TODO(octave) : error handling.
+        return false;
+    }
+    else
+    {
+        blob_t* ptr = ref.data;
+
+        begin_write(db, &ref);
+        blob_make_private(db, ptr);
+        // TODO(octave) : error check memcpy
+        memcpy(blob_bytes(db, ptr) + offset, data, size);
+        end_write(db, &ref);
+
+        if (db->journal)
+        {
+            journal_append(db,
+                           (journal_record_t){
+                               .kind = JOURNAL_BLOB_WRITE,
+                               .property = property.index,
+                               .id = id,
+                               .offset = offset,
+                               .size = size,
+                           },
+                           data);
+        }
+        return true;
+    }
+}
+
+static blob_view_t
+read_blob_h(database_o* db, object_id_t id, property_handle_t property)
+{
+    blob_t* ptr = get_property_ptr(db, id, PTYPE_BLOB, property);
+
+    if (!ptr || !ptr->size)
+    {
+        return (blob_view_t){0};
+    }
+    return (blob_view_t){blob_bytes(db, ptr), ptr->size};
+}
+
+static blob_mut_view_t
+write_blob_h(database_o* db, object_id_t id, property_handle_t property)
+{
+    property_ref_t ref;
+    if (!resolve_property_mut(db,
+                              id,
+                              PTYPE_BLOB,
+                              (object_type_t){0},
+                              property,
+                              &ref)
+        || !((blob_t*)ref.data)->size)
+    {
+        return (blob_mut_view_t){0};
+    }
+
+    blob_t* ptr = ref.data;
+
+    blob_make_private(db, ptr);
+    return (blob_mut_view_t){blob_bytes(db, ptr), ptr->size};
+}
+
+static bool set_blob_h(database_o* db,
+                       object_id_t id,
+                       property_handle_t property,
+                       const void* data,
+                       uint64_t size)
+{
+    property_ref_t ref;
+    if (!resolve_property_mut(db,
+                              id,
+                              PTYPE_BLOB,
+                              (object_type_t){0},
+                              property,
+                              &ref))
+    {
+        return false;
+    }
+
+    blob_header_t* header = 0;
+    if (size)
+    {
+        uint64_t hash = hash_bytes(data, size);
+        header = blob_find(db, hash, data, size);
+        if (header)
+        {
+            blob_retain(db, header);
+        }
+        else
+        {
+            header = blob_alloc(db, size);
+            header->hash = hash;
+            memcpy(header + 1, data, size);
+            blob_insert(db, header);
+        }
+    }
+
+    begin_write(db, &ref);
+    blob_assign(db, ref.data, header);
+    end_write(db, &ref);
+
+    if (db->journal)
+    {
+        journal_append(db,
+                       (journal_record_t){
+                           .kind = JOURNAL_BLOB_SET,
+                           .property = property.index,
+                           .id = id,
+                           .size = size,
+                       },
+                       data);
+    }
+    return true;
+}
+
+static bool copy_blob_h(database_o* db,
+                        object_id_t dst,
+                        property_handle_t dst_property,
+                        object_id_t src,
+                        property_handle_t src_property)
+{
+    blob_t* from = get_property_ptr(db, src, PTYPE_BLOB, src_property);
+    property_ref_t ref;
+    if (!from
+        || !resolve_property_mut(db,
+                                 dst,
+                                 PTYPE_BLOB,
+                                 (object_type_t){0},
+                                 dst_property,
+                                 &ref))
+    {
+        return false;
+    }
+
+    blob_header_t* header = blob_header(from);
+    if (!header && from->size)
+    {
+        // still in the loaded file, which isn't reference counted
+        property_ref_t src_ref;
+        resolve_property_mut(db,
+                             src,
+                             PTYPE_BLOB,
+                             (object_type_t){0},
+                             src_property,
+                             &src_ref);
+        from = src_ref.data;
+        blob_make_private(db, from);
+        header = blob_header(from);
+    }
+    if (header)
+    {
+        blob_retain(db, header);
+    }
+
+    begin_write(db, &ref);
+    blob_assign(db, ref.data, header);
+    end_write(db, &ref);
+
+    if (db->journal)
+    {
+        journal_append(db,
+                       (journal_record_t){
+                           .kind = JOURNAL_BLOB_SET,
+                           .property = dst_property.index,
+                           .id = dst,
+                           .size = from->size,
+                       },
+                       blob_bytes(db, from));
+    }
+    return true;
+}
+
+static uint32_t deduplicate_blobs(database_o* db)
+{
+    uint32_t merged = 0;
+    for (uint32_t t = 1; t < array_count(db->object_types); t++)
+    {
+        const object_type_definition_t* type = &db->object_types[t];
+        for (uint32_t row = 0; row < array_count(type->row_slots); row++)
+        {
+            object_t* object = &db->objects[type->row_slots[row]];
+            for (uint32_t i = 0; i < type->property_count; i++)
+            {
+                const property_layout_t* prop =
+                    &db->properties[type->first_property + i];
+                if (prop->def.type != PTYPE_BLOB)
+                {
+                    continue;
+                }
+
+                blob_t* blob = get_property_data(db, object, prop);
+                blob_header_t* header = blob_header(blob);
+                if (!header || header->hashed)
+                {
+                    continue;
+                }
+
+                header->hash = hash_bytes(header + 1, header->size);
+                blob_header_t* found =
+                    blob_find(db, header->hash, header + 1, header->size);
+                if (found)
+                {
+                    blob = get_property_data_mut(db, object, prop);
+                    blob_retain(db, found);
+                    blob_assign(db, blob, found);
+                    merged++;
+                }
+                else
+                {
+                    blob_insert(db, header);
+                }
+            }
+        }
+    }
+    return merged;
+}
+
+static void get_blob_stats(database_o* db, blob_store_stats_t* stats)
+{
+    *stats = db->blob_stats;
+    stats->bytes_saved = stats->logical_bytes - stats->stored_bytes;
+    stats->dedup_ratio = stats->stored_bytes ? (double)stats->logical_bytes
+                                                   / stats->stored_bytes
+                                             : 1.;
+}
+
+static bool mark_blob_dirty_h(database_o* db,
+                              object_id_t id,
+                              property_handle_t property,
+                              uint64_t offset,
+                              uint64_t size)
+{
+    property_ref_t ref;
+    if (!resolve_property_mut(db,
+                              id,
+                              PTYPE_BLOB,
+                              (object_type_t){0},
+                              property,
+                              &ref)
+        || !blob_range_ok(ref.data, offset, size))
+    {
+        return false;
+    }
+
+    // the bytes are already in place, only the derived data is updated
+    begin_write(db, &ref);
+    end_write(db, &ref);
+
+    if (db->journal)
+    {
+        journal_append(db,
+                       (journal_record_t){
+                           .kind = JOURNAL_BLOB_WRITE,
+                           .property = property.index,
+                           .id = id,
+                           .offset = offset,
+                           .size = size,
+                       },
+                       blob_bytes(db, ref.data) + offset);
+    }
+    return true;
+}
+
+static object_id_t
+get_reference_h(database_o* db, object_id_t id, property_handle_t property)
+{
+    object_id_t* ptr = get_property_ptr(db, id, PTYPE_REFERENCE, property);
+
+    if (!ptr)
+    {
+        // TODO(octave) : error handling.
+        return (object_id_t){0};
+    }
+    else
+    {
+        return *ptr;
+    }
+}
+
+static void set_reference_h(database_o* db,
+                            object_id_t id,
+                            property_handle_t property,
+                            object_id_t value)
+{
+    property_ref_t ref;
+    if (!resolve_property_mut(db,
+                              id,
+                              PTYPE_REFERENCE,
+                              value.info.type,
+                              property,
+                              &ref))
+    {
+        // TODO(octave) : error handling.
+    }
+    else
+    {
+        write_property(db, &ref, &value);
+        journal_set(db, id, property, &value, sizeof(value));
+    }
+}
+
+static string_id_t
+get_string_h(database_o* db, object_id_t id, property_handle_t property)
+{
+    string_id_t* ptr = get_property_ptr(db, id, PTYPE_STRING, property);
+    return ptr ? *ptr : (string_id_t){0};
+}
+
+static bool set_string_h(database_o* db,
+                         object_id_t id,
+                         property_handle_t property,
+                         string_id_t value)
+{
+    property_ref_t ref;
+    if (!resolve_property_mut(db,
+                              id,
+                              PTYPE_STRING,
+                              (object_type_t){0},
+                              property,
+                              &ref)
+        || !is_valid_value(ref.prop, &value))
+    {
+        return false;
+    }
+
+    write_property(db, &ref, &value);
+    journal_set(db, id, property, &value, sizeof(value));
+    return true;
+}
+
+static bool
+reallocate_blob(database_o* db, object_id_t id, const char* name, uint64_t size)
+{
+    return reallocate_blob_h(db,
+                             id,
+                             find_object_property(db, id, name),
+                             size);
+}
+
+static bool get_blob_data(database_o* db,
+                          object_id_t id,
+                          const char* name,
+                          uint64_t offset,
+                          uint64_t size,
+                          void* data)
+{
+    return get_blob_data_h(db,
+                           id,
+                           find_object_property(db, id, name),
+                           offset,
+                           size,
+                           data);
+}
+
+static bool set_blob_data(database_o* db,
+                          object_id_t id,
+                          const char* name,
+                          uint64_t offset,
+                          uint64_t size,
+                          const void* data)
+{
+    return set_blob_data_h(db,
+                           id,
+                           find_object_property(db, id, name),
+                           offset,
+                           size,
+                           data);
+}
+
+static object_id_t
+get_reference(database_o* db, object_id_t id, const char* name)
+{
+    return get_reference_h(db, id, find_object_property(db, id, name));
+}
+
+static void set_reference(database_o* db,
+                          object_id_t id,
+                          const char* name,
+                          object_id_t value)
+{
+    set_reference_h(db, id, find_object_property(db, id, name), value);
+}
+
+static void remove_row(database_o* db,
+                       object_type_definition_t* type,
+                       uint32_t row)
+{
+    uint32_t last = array_count(type->row_slots) - 1;
+    if (row != last)
+    {
+        for (uint32_t i = 0;
+             (type->flags & OBJECT_TYPE_COLUMNAR) && i < type->property_count;
+             i++)
+        {
+            property_layout_t* prop = &db->properties[type->first_property + i];
+            uint8_t* column = prop->column;
+
+            memcpy(column + (uint64_t)row * prop->size,
+                   column + (uint64_t)last * prop->size,
+                   prop->size);
+        }
+
+        if (type->cold_bytes)
+        {
+            uint8_t* cold = type->cold;
+            memcpy(cold + (uint64_t)row * type->cold_bytes,
+                   cold + (uint64_t)last * type->cold_bytes,
+                   type->cold_bytes);
+        }
+
+        for (uint32_t i = 0; i < type->property_count; i++)
+        {
+            property_layout_t* prop = &db->properties[type->first_property + i];
+            if (prop->row_versions)
+            {
+                prop->row_versions[row] = prop->row_versions[last];
+            }
+        }
+
+        uint32_t moved_slot = type->row_slots[last];
+        type->row_slots[row] = moved_slot;
+        type->row_versions[row] = type->row_versions[last];
+        db->objects[moved_slot].row = row;
+        mark_changed(db, &type->changed_rows, row);
+        mark_changed(db, &db->changed_slots, moved_slot);
+    }
+    mark_changed(db, &type->changed_rows, last);
+
+    for (uint32_t i = 0; i < type->property_count; i++)
+    {
+        property_layout_t* prop = &db->properties[type->first_property + i];
+        if (prop->row_versions)
+        {
+            array_header(prop->row_versions)->count--;
+        }
+    }
+
+    array_header(type->row_slots)->count--;
+    array_header(type->row_versions)->count--;
+    type->version = ++db->version;
+}
+
+static void grow_rows(database_o* db,
+                      void** rows,
+                      uint32_t row_size,
+                      uint32_t old_capacity,
+                      uint32_t new_capacity)
+{
+    uint64_t old_bytes = (uint64_t)row_size * old_capacity;
+    uint64_t new_bytes = (uint64_t)row_size * new_capacity;
+
+    if (in_file(db, *rows))
+    {
+        void* copy = mem_alloc(db->alloc, new_bytes);
+        memcpy(copy, *rows, old_bytes);
+        *rows = copy;
+    }
+    else
+    {
+        *rows = mem_realloc(db->alloc, *rows, old_bytes, new_bytes);
+    }
+}
+
+static void reserve_rows(database_o* db,
+                         object_type_definition_t* type,
+                         uint32_t capacity)
+{
+    if (capacity <= type->row_capacity)
+    {
+        return;
+    }
+
+    for (uint32_t i = 0;
+         (type->flags & OBJECT_TYPE_COLUMNAR) && i < type->property_count;
+         i++)
+    {
+        property_layout_t* prop = &db->properties[type->first_property + i];
+        grow_rows(db, &prop->column, prop->size, type->row_capacity, capacity);
+    }
+    if (type->cold_bytes)
+    {
+        grow_rows(db,
+                  &type->cold,
+                  type->cold_bytes,
+                  type->row_capacity,
+                  capacity);
+    }
+    type->row_capacity = capacity;
+}
+
+static uint32_t add_row(database_o* db,
+                        object_type_definition_t* type,
+                        uint32_t slot,
+                        uint64_t version)
+{
+    type->version = version;
+
+    uint32_t row = array_count(type->row_slots);
+    array_push(db->alloc, type->row_slots, slot);
+    array_push(db->alloc, type->row_versions, version);
+    mark_changed(db, &type->changed_rows, row);
+
+    for (uint32_t i = 0; i < type->property_count; i++)
+    {
+        property_layout_t* prop = &db->properties[type->first_property + i];
+        if (prop->def.flags & PROPERTY_TRACK_CHANGES)
+        {
+            array_push(db->alloc, prop->row_versions, version);
+        }
+    }
+
+    bool columnar = type->flags & OBJECT_TYPE_COLUMNAR;
+    if (!columnar && !type->cold_bytes)
+    {
+        return row;
+    }
+
+    if (row == type->row_capacity)
+    {
+        reserve_rows(db, type, row ? (row * 3) / 2 : 16);
+    }
+
+    for (uint32_t i = 0; columnar && i < type->property_count; i++)
+    {
+        property_layout_t* prop = &db->properties[type->first_property + i];
+        memset((uint8_t*)prop->column + (uint64_t)row * prop->size,
+               0,
+               prop->size);
+    }
+    if (type->cold_bytes)
+    {
+        memset((uint8_t*)type->cold + (uint64_t)row * type->cold_bytes,
+               0,
+               type->cold_bytes);
+    }
+
+    return row;
+}
+
+static void append_element(database_o* db,
+                           const property_ref_t* ref,
+                           object_id_t element)
+{
+    blob_t* blob = ref->data;
+    uint64_t count = blob->size / sizeof(object_id_t);
+
+    begin_write(db, ref);
+    array_items_mut(db, blob, count + 1)[count] = element;
+    blob_set_used(db, blob, blob->size + sizeof(object_id_t));
+    if (ref->prop->def.type == PTYPE_REFERENCE_ARRAY)
+    {
+        link_element(db,
+                     ref->object->id,
+                     ref->prop - db->properties,
+                     element);
+    }
+    end_write(db, ref);
+}
+
+// Moves the last element of an array in place of the removed one, and
+// the link of a reference along with it.
+static void
+remove_element(database_o* db, const property_ref_t* ref, uint32_t index)
+{
+    blob_t* blob = ref->data;
+    uint32_t last = blob->size / sizeof(object_id_t) - 1;
+
+    begin_write(db, ref);
+    object_id_t* ids = array_items_mut(db, blob, last + 1);
+    ids[index] = ids[last];
+    blob_set_used(db, blob, blob->size - sizeof(object_id_t));
+    if (ref->prop->def.type == PTYPE_REFERENCE_ARRAY)
+    {
+        uint64_t key = property_slot_key(ref->object->id,
+                                         ref->prop - db->properties);
+        uint32_t* links = (uint32_t*)hash_find(&db->links_of_array, key, 0);
+        unlink_reference(db, links[index]);
+        links[index] = links[last];
+        db->links[links[index] - 1].element = index;
+        array_header(links)->count--;
+    }
+    end_write(db, ref);
+}
+
+static void destroy_incoming_references(database_o* db, object_id_t target)
+{
+    uint32_t link = hash_find(&db->first_referrer, target.info.slot, 0);
+    while (link)
+    {
+        reference_link_t l = db->links[link - 1];
+        const property_layout_t* prop = &db->properties[l.property];
+        object_t* source = &db->objects[l.source.info.slot];
+
+        if (prop->def.type == PTYPE_REFERENCE_ARRAY)
+        {
+            property_ref_t ref = {
+                .object = source,
+                .prop = prop,
+                .data = get_property_data_mut(db, source, prop),
+            };
+
+            // unlinks this link
+            remove_element(db, &ref, l.element);
+        }
+        else if (prop->def.flags & PROPERTY_NULL_ON_DESTROY)
+        {
+            property_ref_t ref = {
+                .object = source,
+                .prop = prop,
+                .data = get_property_data_mut(db, source, prop),
+            };
+            object_id_t null_id = {0};
+
+            // unlinks this link in begin_write
+            write_property(db, &ref, &null_id);
+        }
+        else
+        {
+            unlink_reference(db, link);
+        }
+
+        // Every branch unlinks this link, writes passed on to instances
+        // may unlink others.
+        link = hash_find(&db->first_referrer, target.info.slot, 0);
+    }
+}
+
+static uint32_t get_referrers(database_o* db,
+                              object_id_t id,
+                              object_id_t* results,
+                              property_handle_t* properties,
+                              uint32_t max_results)
+{
+    if (!is_alive(db, id))
+    {
+        return 0;
+    }
+
+    uint32_t found = 0;
+    uint32_t link = hash_find(&db->first_referrer, id.info.slot, 0);
+    while (link)
+    {
+        const reference_link_t* l = &db->links[link - 1];
+        if (found < max_results)
+        {
+            results[found] = l->source;
+            if (properties)
+            {
+                properties[found] = (property_handle_t){l->property};
+            }
+        }
+        found++;
+        link = l->next;
+    }
+
+    return found;
+}
+
+// Copies the values of the hot properties of object to payload, those
+// of an instance included.
+static void
+read_payload(database_o* db, const object_t* object, uint8_t* payload)
+{
+    const object_type_definition_t* type =
+        &db->object_types[object->id.info.type.index];
+    if (object->page != POOL_PAGE_INSTANCE)
+    {
+        memcpy(payload, object->data, type->bytes);
+        return;
+    }
+
+    for (uint32_t i = 0; i < type->property_count; i++)
+    {
+        const property_layout_t* prop =
+            &db->properties[type->first_property + i];
+        if (!prop->cold)
+        {
+            memcpy(payload + prop->offset,
+                   get_property_data(db, object, prop),
+                   prop->size);
+        }
+    }
+}
+
+// Turns the instances of object into plain objects holding the values
+// they read from it, before it is destroyed.
+static void flatten_instances(database_o* db, const object_t* object)
+{
+    uint64_t key = object->id.info.slot;
+    uint32_t* instances = (uint32_t*)hash_find(&db->instances_of, key, 0);
+    if (!instances)
+    {
+        return;
+    }
+
+    object_type_definition_t* type =
+        &db->object_types[object->id.info.type.index];
+    for (uint32_t i = 0; i < array_count(instances); i++)
+    {
+        object_t* instance = &db->objects[instances[i]];
+        uint32_t page;
+        void* data = payload_alloc(db, type, &page);
+        read_payload(db, instance, data);
+        retain_payload_blobs(db, type, data);
+        drop_overrides(db, instance);
+        instance->data = data;
+        instance->page = page;
+        mark_changed(db, &db->changed_slots, instances[i]);
+        db->instance_count--;
+    }
+    array_free(db->alloc, instances);
+    hash_remove(&db->instances_of, key);
+}
+
+static void destroy_object_tree(database_o* db, object_id_t id)
+{
+    object_t* object = get_object(db, id);
+    if (!object)
+    {
+        // already deleted.
+        return;
+    }
+
+    flatten_instances(db, object);
+    destroy_incoming_references(db, id);
+
+    object_type_definition_t* type = &db->object_types[id.info.type.index];
+    for (uint32_t i = 0; i < type->property_count; i++)
+    {
+        property_layout_t* prop = &db->properties[type->first_property + i];
+        if (prop->index)
+        {
+            index_remove(db, prop, id, get_property_data(db, object, prop));
+        }
+
+        if (prop->def.type == PTYPE_REFERENCE)
+        {
+            unlink_outgoing_reference(db, id, type->first_property + i);
+        }
+        else if (prop->def.type == PTYPE_REFERENCE_ARRAY)
+        {
+            unlink_elements(db, id, type->first_property + i);
+        }
+        else if (prop->def.type == PTYPE_OBJECT_ARRAY)
+        {
+            uint32_t count =
+                ((blob_t*)get_property_data(db, object, prop))->size
+                / sizeof(object_id_t);
+            for (uint32_t e = 0; e < count; e++)
+            {
+                // destroying a sub-object may write to the object
+                const blob_t* blob = get_property_data(db, object, prop);
+                const object_id_t* ids =
+                    (const object_id_t*)blob_bytes(db, blob);
+                destroy_object_tree(db, ids[e]);
+            }
+        }
+
+        if (holds_blob(prop->def.type)
+            && (prop->cold || (type->flags & OBJECT_TYPE_COLUMNAR)))
+        {
+            // blobs of the payload are released with it
+            blob_assign(db, get_property_data(db, object, prop), 0);
+        }
+        else if (prop->def.type == PTYPE_OBJECT)
+        {
+            object_id_t* sub_id = get_property_data(db, object, prop);
+
+            if (sub_id->index) // never accessed otherwise
+            {
+                destroy_object_tree(db, *sub_id);
+            }
+        }
+    }
+
+    if (object->page == POOL_PAGE_INSTANCE)
+    {
+        // no payload of its own
+        drop_overrides(db, object);
+        remove_instance(db, object);
+        db->instance_count--;
+    }
+    else if (type->flags & OBJECT_TYPE_COLUMNAR)
+    {
+        ASSERT(!object->data);
+    }
+    else if (payload_in_snapshot(db, object))
+    {
+        retire_payload(db, object);
+    }
+    else
+    {
+        drop_payload(db, type, object->data, object->page);
+    }
+
+    remove_row(db, type, object->row);
+
+    object->data = 0;
+    object->id.info.type = (object_type_t){0};
+    mark_changed(db, &db->changed_slots, id.info.slot);
+    mark_slot_free(db, id.info.slot);
+}
+
+// Takes a slot and a row for a new object, leaving its payload to the
+// caller.
+static object_t*
+allocate_slot(database_o* db, object_type_t type, uint64_t version)
+{
+    uint32_t slot_index = lowest_free_slot(db);
+    if (slot_index)
+    {
+        unmark_slot_free(db, slot_index);
+    }
+    else
+    {
+        object_t slot = {.id.info.generation = db->tail_generation};
+        array_push(db->page_alloc, db->objects, slot);
+        slot_index = array_count(db->objects) - 1;
+    }
+
+    object_t* object = &db->objects[slot_index];
+    object->id.info.type = type;
+    if (!++object->id.info.generation)
+    {
+        object->id.info.generation = 1; // 0 is for pending ids
+    }
+    object->id.info.slot = slot_index;
+    mark_changed(db, &db->changed_slots, slot_index);
+
+    object->row =
+        add_row(db, &db->object_types[type.index], slot_index, version);
+    return object;
+}
+
+// Takes a slot and a row for a new object. Its payload is zeroed, or is
+// shared_data for a copy on write clone.
+static object_t* allocate_object(database_o* db,
+                                 object_type_t type,
+                                 uint64_t version,
+                                 void* shared_data)
+{
+    object_t* object = allocate_slot(db, type, version);
+    object_type_definition_t* type_def = &db->object_types[type.index];
+    if (type_def->flags & OBJECT_TYPE_COLUMNAR)
+    {
+        object->data = 0;
+        object->page = POOL_PAGE_NONE;
+    }
+    else if (shared_data)
+    {
+        object->data = shared_data;
+        object->page = POOL_PAGE_SHARED;
+    }
+    else
+    {
+        object->data = payload_alloc(db, type_def, &object->page);
+        memset(object->data, 0, type_def->bytes);
+    }
+    return object;
+}
+
+static void index_object(database_o* db, object_t* object)
+{
+    const object_type_definition_t* type =
+        &db->object_types[object->id.info.type.index];
+    for (uint32_t i = 0; i < type->property_count; i++)
+    {
+        property_layout_t* prop = &db->properties[type->first_property + i];
+
+        if (prop->index)
+        {
+            index_insert(db,
+                         prop,
+                         object->id,
+                         get_property_data(db, object, prop));
+        }
+    }
+}
+
+static object_id_t
+instantiate_object_at(database_o* db, object_type_t type, uint64_t version)
+{
+    object_t* object = allocate_object(db, type, version, 0);
+
+    // NOTE(octave) : PTYPE_OBJECT sub-objects are left null, they are
+    // created by get_sub_object_h the first time they're asked for.
+    index_object(db, object);
+    return object->id;
+}
+
+static object_id_t instantiate_object(database_o* db, object_type_t type)
+{
+    if (type.index == 0 || type.index >= array_count(db->object_types))
+    {
+        return (object_id_t){0};
+    }
+
+    return instantiate_object_at(db, type, ++db->version);
+}
+
+static void destroy_object(database_o* db, object_id_t id)
+{
+    collect_released(db);
+    if (db->journal && is_alive(db, id))
+    {
+        journal_append(db,
+                       (journal_record_t){.kind = JOURNAL_DESTROY, .id = id},
+                       0);
+    }
+
+    destroy_object_tree(db, id);
+}
+
+static object_id_t create_object(database_o* db, object_type_t type)
+{
+    object_id_t id = instantiate_object(db, type);
+
+    if (db->journal && id.index)
+    {
+        journal_append(db,
+                       (journal_record_t){
+                           .kind = JOURNAL_CREATE,
+                           .property = type.index,
+                           .id = id,
+                       },
+                       0);
+    }
+    return id;
+}
+
+static uint32_t create_objects(database_o* db,
+                               object_type_t type,
+                               uint32_t count,
+                               object_id_t* ids)
+{
+    if (!count || type.index == 0
+        || type.index >= array_count(db->object_types))
+    {
+        return 0;
+    }
+
+    object_type_definition_t* type_def = &db->object_types[type.index];
+    uint32_t row_count = array_count(type_def->row_slots);
+
+    // grow every array once for the whole batch
+    array_reserve(db->page_alloc,
+                  db->objects,
+                  array_count(db->objects) + count);
+    array_reserve(db->alloc, type_def->row_slots, row_count + count);
+    array_reserve(db->alloc, type_def->row_versions, row_count + count);
+    reserve_rows(db, type_def, row_count + count);
+    for (uint32_t i = 0; i < type_def->property_count; i++)
+    {
+        property_layout_t* prop = &db->properties[type_def->first_property + i];
+        if (prop->def.flags & PROPERTY_TRACK_CHANGES)
+        {
+            array_reserve(db->alloc, prop->row_versions, row_count + count);
+        }
+        defer_ordered_index(prop, row_count, count);
+    }
+
+    uint64_t version = ++db->version;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        ids[i] = instantiate_object_at(db, type, version);
+    }
+
+    for (uint32_t i = 0; i < type_def->property_count; i++)
+    {
+        rebuild_ordered_index(db,
+                              &db->properties[type_def->first_property + i]);
+    }
+
+    if (db->journal)
+    {
+        uint8_t* payload = journal_reserve(db,
+                                           (journal_record_t){
+                                               .kind = JOURNAL_CREATE_BATCH,
+                                               .property = type.index,
+                                               .offset = count,
+                                               .size = sizeof(*ids) * count,
+                                           });
+        memcpy(payload, ids, sizeof(*ids) * count);
+    }
+    return count;
+}
+
+static void destroy_objects(database_o* db,
+                            const object_id_t* ids,
+                            uint32_t count)
+{
+    uint32_t type_count = array_count(db->object_types);
+    uint32_t* counts = mem_alloc(db->alloc, sizeof(uint32_t) * type_count);
+    memset(counts, 0, sizeof(uint32_t) * type_count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (is_alive(db, ids[i]))
+        {
+            counts[ids[i].info.type.index]++;
+        }
+    }
+    for (uint32_t t = 1; t < type_count; t++)
+    {
+        const object_type_definition_t* type = &db->object_types[t];
+        for (uint32_t i = 0; counts[t] && i < type->property_count; i++)
+        {
+            defer_ordered_index(&db->properties[type->first_property + i],
+                                array_count(type->row_slots),
+                                counts[t]);
+        }
+    }
+    mem_free(db->alloc, counts, sizeof(uint32_t) * type_count);
+
+    if (db->journal)
+    {
+        uint8_t* payload = journal_reserve(db,
+                                           (journal_record_t){
+                                               .kind = JOURNAL_DESTROY_BATCH,
+                                               .offset = count,
+                                               .size = sizeof(*ids) * count,
+                                           });
+        memcpy(payload, ids, sizeof(*ids) * count);
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        destroy_object_tree(db, ids[i]);
+    }
+
+    for (uint32_t i = 1; i < array_count(db->properties); i++)
+    {
+        rebuild_ordered_index(db, &db->properties[i]);
+    }
+}
+
+static uint32_t set_values_h(database_o* db,
+                             property_handle_t property,
+                             const object_id_t* ids,
+                             uint32_t count,
+                             const void* values)
+{
+    if (!property.index || property.index >= array_count(db->properties))
+    {
+        return 0;
+    }
+
+    property_layout_t* prop = &db->properties[property.index];
+    if (prop->def.type == PTYPE_NONE || holds_blob(prop->def.type)
+        || prop->def.type == PTYPE_OBJECT)
+    {
+        return 0;
+    }
+
+    const object_type_definition_t* type = &db->object_types[prop->owner.index];
+    defer_ordered_index(prop, array_count(type->row_slots), count);
+
+    uint32_t written = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        object_id_t id = ids[i];
+        const uint8_t* value =
+            (const uint8_t*)values + (uint64_t)i * prop->size;
+        if (id.info.type.index != prop->owner.index || !is_alive(db, id)
+            || !is_valid_value(prop, value))
+        {
+            continue;
+        }
+        if (prop->def.type == PTYPE_REFERENCE)
+        {
+            object_type_t target = ((const object_id_t*)value)->info.type;
+            if (target.index && target.index != prop->def.object_type.index)
+            {
+                continue;
+            }
+        }
+
+        object_t* object = &db->objects[id.info.slot];
+        property_ref_t ref = {
+            .object = object,
+            .prop = prop,
+            .data = get_property_data_mut(db, object, prop),
+        };
+        write_property(db, &ref, value);
+        written++;
+    }
+
+    rebuild_ordered_index(db, prop);
+
+    if (db->journal)
+    {
+        for (uint32_t i = 0; prop->def.type == PTYPE_STRING && i < count; i++)
+        {
+            journal_string(db, ((const string_id_t*)values)[i]);
+        }
+
+        uint64_t ids_size = sizeof(*ids) * count;
+        uint8_t* payload =
+            journal_reserve(db,
+                            (journal_record_t){
+                                .kind = JOURNAL_SET_BATCH,
+                                .property = property.index,
+                                .offset = count,
+                                .size = ids_size + (uint64_t)prop->size * count,
+                            });
+        memcpy(payload, ids, ids_size);
+        memcpy(payload + ids_size, values, (uint64_t)prop->size * count);
+    }
+    return written;
+}
+
+static object_id_t
+get_sub_object_h(database_o* db, object_id_t id, property_handle_t property)
+{
+    object_id_t* ptr = get_property_ptr(db, id, PTYPE_OBJECT, property);
+
+    if (!ptr)
+    {
+        // TODO(octave) : error handling.
+        return (object_id_t){0};
+    }
+    else if (ptr->index)
+    {
+        return *ptr;
+    }
+
+    const property_layout_t* prop = get_property(db, id.info.type, property);
+    object_id_t sub_id = instantiate_object(db, prop->def.object_type);
+
+    // NOTE(octave) : creating an object of the same columnar type may
+    // have moved the columns.
+    property_ref_t ref;
+    resolve_property_mut(db,
+                         id,
+                         PTYPE_OBJECT,
+                         (object_type_t){0},
+                         property,
+                         &ref);
+    *(object_id_t*)ref.data = sub_id;
+
+    if (db->journal)
+    {
+        journal_append(db,
+                       (journal_record_t){
+                           .kind = JOURNAL_SUB_OBJECT,
+                           .property = property.index,
+                           .id = id,
+                           .offset = sub_id.index,
+                       },
+                       0);
+    }
+    return sub_id;
+}
+
+static object_id_t
+get_sub_object(database_o* db, object_id_t id, const char* name)
+{
+    return get_sub_object_h(db, id, find_object_property(db, id, name));
+}
+
+// Resolves an array property of either type for writing.
+static bool resolve_array_mut(database_o* db,
+                              object_id_t id,
+                              property_handle_t property,
+                              property_ref_t* ref)
+{
+    const property_layout_t* prop = get_property(db, id.info.type, property);
+    return prop && is_array(prop->def.type)
+           && resolve_property_mut(db,
+                                   id,
+                                   prop->def.type,
+                                   (object_type_t){0},
+                                   property,
+                                   ref);
+}
+
+static object_array_view_t
+read_array_h(database_o* db, object_id_t id, property_handle_t property)
+{
+    const property_layout_t* prop = get_property(db, id.info.type, property);
+    const object_t* object = get_object(db, id);
+    if (!prop || !is_array(prop->def.type) || !object)
+    {
+        return (object_array_view_t){0};
+    }
+
+    const blob_t* blob = get_property_data(db, object, prop);
+    if (!blob->size)
+    {
+        return (object_array_view_t){0};
+    }
+    return (object_array_view_t){
+        (const object_id_t*)blob_bytes(db, blob),
+        blob->size / sizeof(object_id_t),
+    };
+}
+
+static bool append_reference_h(database_o* db,
+                               object_id_t id,
+                               property_handle_t property,
+                               object_id_t target)
+{
+    property_ref_t ref;
+    if (!is_alive(db, target)
+        || !resolve_property_mut(db,
+                                 id,
+                                 PTYPE_REFERENCE_ARRAY,
+                                 target.info.type,
+                                 property,
+                                 &ref))
+    {
+        return false;
+    }
+
+    append_element(db, &ref, target);
+    if (db->journal)
+    {
+        journal_append(db,
+                       (journal_record_t){
+                           .kind = JOURNAL_ARRAY_APPEND,
+                           .property = property.index,
+                           .id = id,
+                           .size = sizeof(target),
+                       },
+                       &target);
+    }
+    return true;
+}
+
+// Replaces the elements of a PTYPE_REFERENCE_ARRAY, linking the new ones.
+static void set_elements(database_o* db,
+                         const property_ref_t* ref,
+                         const object_id_t* ids,
+                         uint32_t count)
+{
+    blob_t* blob = ref->data;
+    uint32_t property = (uint32_t)(ref->prop - db->properties);
+
+    begin_write(db, ref);
+    unlink_elements(db, ref->object->id, property);
+    if (count)
+    {
+        memcpy(array_items_mut(db, blob, count),
+               ids,
+               sizeof(object_id_t) * count);
+        blob_set_used(db, blob, sizeof(object_id_t) * count);
+    }
+    else
+    {
+        blob_assign(db, blob, 0);
+    }
+    link_elements(db, ref->object->id, property, blob);
+    end_write(db, ref);
+}
+
+// Sets every element of a PTYPE_REFERENCE_ARRAY, as tx_set_blob_h does.
+// Journaled as a JOURNAL_BLOB_SET of the ids.
+static bool set_references_h(database_o* db,
+                             object_id_t id,
+                             property_handle_t property,
+                             const object_id_t* targets,
+                             uint32_t count)
+{
+    const property_layout_t* prop = get_property(db, id.info.type, property);
+    if (!prop || prop->def.type != PTYPE_REFERENCE_ARRAY)
+    {
+        return false;
+    }
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (!is_alive(db, targets[i])
+            || (prop->def.object_type.index
+                && targets[i].info.type.index != prop->def.object_type.index))
+        {
+            return false;
+        }
+    }
+
+    property_ref_t ref;
+    if (!resolve_property_mut(db,
+                              id,
+                              PTYPE_REFERENCE_ARRAY,
+                              (object_type_t){0},
+                              property,
+                              &ref))
+    {
+        return false;
+    }
+
+    set_elements(db, &ref, targets, count);
+    if (db->journal)
+    {
+        journal_append(db,
+                       (journal_record_t){
+                           .kind = JOURNAL_BLOB_SET,
+                           .property = property.index,
+                           .id = id,
+                           .size = sizeof(object_id_t) * count,
+                       },
+                       targets);
+    }
+    return true;
+}
+
+static object_id_t
+append_sub_object_h(database_o* db, object_id_t id, property_handle_t property)
+{
+    const property_layout_t* prop = get_property(db, id.info.type, property);
+    if (!prop || prop->def.type != PTYPE_OBJECT_ARRAY || !is_alive(db, id))
+    {
+        return (object_id_t){0};
+    }
+
+    object_id_t sub_id = instantiate_object(db, prop->def.object_type);
+
+    // creating the sub-object may have moved the columns
+    property_ref_t ref;
+    resolve_property_mut(db,
+                         id,
+                         PTYPE_OBJECT_ARRAY,
+                         (object_type_t){0},
+                         property,
+                         &ref);
+    append_element(db, &ref, sub_id);
+
+    if (db->journal)
+    {
+        journal_append(db,
+                       (journal_record_t){
+                           .kind = JOURNAL_ARRAY_APPEND,
+                           .property = property.index,
+                           .id = id,
+                           .offset = sub_id.index,
+                       },
+                       0);
+    }
+    return sub_id;
+}
+
+static bool remove_array_element_h(database_o* db,
+                                   object_id_t id,
+                                   property_handle_t property,
+                                   uint32_t index)
+{
+    property_ref_t ref;
+    if (!resolve_array_mut(db, id, property, &ref)
+        || index >= ((blob_t*)ref.data)->size / sizeof(object_id_t))
+    {
+        return false;
+    }
+
+    if (ref.prop->def.type == PTYPE_OBJECT_ARRAY)
+    {
+        const object_id_t* ids =
+            (const object_id_t*)blob_bytes(db, ref.data);
+        destroy_object_tree(db, ids[index]);
+
+        // destroying the sub-object may have written to id
+        resolve_array_mut(db, id, property, &ref);
+    }
+    remove_element(db, &ref, index);
+
+    if (db->journal)
+    {
+        journal_append(db,
+                       (journal_record_t){
+                           .kind = JOURNAL_ARRAY_REMOVE,
+                           .property = property.index,
+                           .id = id,
+                           .offset = index,
+                       },
+                       0);
+    }
+    return true;
+}
+
+// Copies the payload, cold properties and columns of id in bulk, then
+// takes a reference on the blobs and clones the sub-objects. With share,
+// the clone points to the payload of id until one of them is written.
+// Types holding sub-objects are always copied since the clone needs its
+// own sub-object ids, and so are instances, whose clones are plain
+// objects.
+static object_id_t clone_object_tree(database_o* db, object_id_t id, bool share)
+{
+    object_t* source = get_object(db, id);
+    if (!source)
+    {
+        return (object_id_t){0};
+    }
+
+    object_type_definition_t* type = &db->object_types[id.info.type.index];
+    bool columnar = type->flags & OBJECT_TYPE_COLUMNAR;
+    share = share && source->page != POOL_PAGE_INSTANCE;
+    for (uint32_t i = 0; share && i < type->property_count; i++)
+    {
+        uint32_t prop_type = db->properties[type->first_property + i].def.type;
+        share = prop_type != PTYPE_OBJECT && prop_type != PTYPE_OBJECT_ARRAY;
+    }
+
+    void* shared_data =
+        share && !columnar ? share_payload(db, type, source) : 0;
+    object_id_t clone_id =
+        allocate_object(db, id.info.type, ++db->version, shared_data)->id;
+
+    // allocate_object may have moved the objects, rows and columns
+    object_t* clone = &db->objects[clone_id.info.slot];
+    source = &db->objects[id.info.slot];
+    if (!columnar && !shared_data)
+    {
+        read_payload(db, source, clone->data);
+    }
+    if (type->cold_bytes)
+    {
+        memcpy((uint8_t*)type->cold + (uint64_t)clone->row * type->cold_bytes,
+               (uint8_t*)type->cold + (uint64_t)source->row * type->cold_bytes,
+               type->cold_bytes);
+    }
+
+    for (uint32_t i = 0; i < type->property_count; i++)
+    {
+        uint32_t index = type->first_property + i;
+        const property_layout_t* prop = &db->properties[index];
+        clone = &db->objects[clone_id.info.slot];
+        source = &db->objects[id.info.slot];
+        void* data = get_property_data(db, clone, prop);
+        if (columnar)
+        {
+            memcpy(data, get_property_data(db, source, prop), prop->size);
+        }
+
+        if (holds_blob(prop->def.type) && (prop->cold || !shared_data))
+        {
+            blob_header_t* header = blob_header(data);
+            if (header)
+            {
+                blob_retain(db, header);
+            }
+        }
+
+        if (prop->def.type == PTYPE_OBJECT && ((object_id_t*)data)->index)
+        {
+            object_id_t sub_id =
+                clone_object_tree(db, *(object_id_t*)data, share);
+            clone = &db->objects[clone_id.info.slot];
+            *(object_id_t*)get_property_data(db, clone, prop) = sub_id;
+        }
+        else if (prop->def.type == PTYPE_REFERENCE)
+        {
+            link_reference(db, clone_id, index, *(object_id_t*)data);
+        }
+        else if (prop->def.type == PTYPE_REFERENCE_ARRAY)
+        {
+            link_elements(db, clone_id, index, data);
+        }
+        else if (prop->def.type == PTYPE_OBJECT_ARRAY && ((blob_t*)data)->size)
+        {
+            // the sub-objects are cloned into a payload of the clone's own
+            uint64_t size = ((blob_t*)data)->size;
+            blob_header_t* ids = blob_alloc(db, size);
+            for (uint32_t e = 0; e < size / sizeof(object_id_t); e++)
+            {
+                source = &db->objects[id.info.slot];
+                const blob_t* from = get_property_data(db, source, prop);
+                object_id_t sub_id =
+                    ((const object_id_t*)blob_bytes(db, from))[e];
+                ((object_id_t*)(ids + 1))[e] =
+                    clone_object_tree(db, sub_id, share);
+            }
+            clone = &db->objects[clone_id.info.slot];
+            blob_assign(db, get_property_data(db, clone, prop), ids);
+        }
+    }
+
+    index_object(db, &db->objects[clone_id.info.slot]);
+    return clone_id;
+}
+
+static object_id_t clone_object_ex(database_o* db, object_id_t id, bool share)
+{
+    object_id_t clone = clone_object_tree(db, id, share);
+
+    if (db->journal && clone.index)
+    {
+        journal_append(db,
+                       (journal_record_t){
+                           .kind = JOURNAL_CLONE,
+                           .property = share,
+                           .id = id,
+                           .offset = clone.index,
+                       },
+                       0);
+    }
+    return clone;
+}
+
+static object_id_t clone_object(database_o* db, object_id_t id)
+{
+    return clone_object_ex(db, id, false);
+}
+
+static object_id_t clone_object_cow(database_o* db, object_id_t id)
+{
+    return clone_object_ex(db, id, true);
+}
+
+// The instance keeps the id of the prototype instead of a payload, and
+// copies its cold properties. Sub-object ids and object arrays are
+// overridden with empty values.
+static object_id_t create_instance(database_o* db, object_id_t prototype)
+{
+    object_t* source = get_object(db, prototype);
+    object_type_definition_t* type =
+        &db->object_types[prototype.info.type.index];
+    if (!source || (type->flags & OBJECT_TYPE_COLUMNAR))
+    {
+        return (object_id_t){0};
+    }
+
+    object_t* instance =
+        allocate_slot(db, prototype.info.type, ++db->version);
+    instance->prototype = prototype;
+    instance->page = POOL_PAGE_INSTANCE;
+    source = &db->objects[prototype.info.slot];
+    add_instance(db, instance);
+    db->instance_count++;
+    if (type->cold_bytes)
+    {
+        memcpy((uint8_t*)type->cold
+                   + (uint64_t)instance->row * type->cold_bytes,
+               (uint8_t*)type->cold + (uint64_t)source->row * type->cold_bytes,
+               type->cold_bytes);
+    }
+
+    for (uint32_t i = 0; i < type->property_count; i++)
+    {
+        uint32_t index = type->first_property + i;
+        const property_layout_t* prop = &db->properties[index];
+        void* data = get_property_data(db, instance, prop);
+        if (prop->def.type == PTYPE_OBJECT
+            || prop->def.type == PTYPE_OBJECT_ARRAY)
+        {
+            override_cell_t empty = {0};
+            if (prop->cold)
+            {
+                memset(data, 0, prop->size);
+            }
+            else if (memcmp(data, empty.bytes, prop->size))
+            {
+                add_override(db, instance, prop, empty.bytes);
+            }
+            continue;
+        }
+
+        if (prop->cold && holds_blob(prop->def.type))
+        {
+            blob_header_t* header = blob_header(data);
+            if (header)
+            {
+                blob_retain(db, header);
+            }
+        }
+
+        if (prop->def.type == PTYPE_REFERENCE)
+        {
+            link_reference(db, instance->id, index, *(object_id_t*)data);
+        }
+        else if (prop->def.type == PTYPE_REFERENCE_ARRAY)
+        {
+            link_elements(db, instance->id, index, data);
+        }
+    }
+
+    index_object(db, instance);
+
+    if (db->journal)
+    {
+        journal_append(db,
+                       (journal_record_t){
+                           .kind = JOURNAL_INSTANCE,
+                           .id = prototype,
+                           .offset = instance->id.index,
+                       },
+                       0);
+    }
+    return instance->id;
+}
+
+static void get_override_stats(database_o* db, override_stats_t* stats)
+{
+    *stats = (override_stats_t){
+        .instance_count = db->instance_count,
+        .override_count = db->override_count,
+    };
+    if (db->overrides)
+    {
+        stats->bytes += sizeof(override_cell_t)
+                        * array_header(db->overrides)->capacity;
+    }
+    stats->bytes +=
+        2 * sizeof(uint64_t) * db->override_of_property.bucket_count;
+    stats->bytes += 2 * sizeof(uint64_t) * db->instances_of.bucket_count
+                    + sizeof(uint32_t) * db->instance_count;
+}
+
+// Moves the object in slot from to the free slot to, under a new id,
+// recording both in moved_ids and moved_slots. The stored references
+// are left to remap_stored_ids.
+static void
+move_object(database_o* db, uint32_t from, uint32_t to, hash_t* moved_slots)
+{
+    object_t* object = &db->objects[from];
+    object_t* dest = &db->objects[to];
+    object_type_definition_t* type =
+        &db->object_types[object->id.info.type.index];
+
+    object_id_t old = object->id;
+    object_id_t id = old;
+    id.info.slot = to;
+    id.info.generation = dest->id.info.generation + 1;
+    if (!id.info.generation)
+    {
+        id.info.generation = 1; // 0 is for pending ids
+    }
+
+    for (uint32_t i = 0; i < type->property_count; i++)
+    {
+        uint32_t index = type->first_property + i;
+        property_layout_t* prop = &db->properties[index];
+        if (prop->index)
+        {
+            index_remove(db,
+                         prop,
+                         object->id,
+                         get_property_data(db, object, prop));
+        }
+        if (object->page == POOL_PAGE_INSTANCE)
+        {
+            uint64_t key = property_slot_key(object->id, index);
+            uint32_t cell = hash_find(&db->override_of_property, key, 0);
+            if (cell)
+            {
+                remove_override_key(db, key);
+                set_override_key(db, property_slot_key(id, index), cell);
+            }
+        }
+    }
+
+    if (object->page == POOL_PAGE_INSTANCE)
+    {
+        uint32_t* siblings = (uint32_t*)hash_find(
+            &db->instances_of, object->prototype.info.slot, 0);
+        for (uint32_t i = 0; i < array_count(siblings); i++)
+        {
+            siblings[i] = siblings[i] == from ? to : siblings[i];
+        }
+    }
+    uint64_t instances = hash_find(&db->instances_of, from, 0);
+    if (instances)
+    {
+        hash_remove(&db->instances_of, from);
+        hash_set(db->alloc, &db->instances_of, to, instances);
+        for (uint32_t i = 0; i < array_count((uint32_t*)instances); i++)
+        {
+            db->objects[((uint32_t*)instances)[i]].prototype = id;
+        }
+    }
+
+    unmark_slot_free(db, to);
+    *dest = *object;
+    dest->id = id;
+    object->data = 0;
+    object->id.info.type = (object_type_t){0};
+    mark_slot_free(db, from);
+    type->row_slots[dest->row] = to;
+
+    index_object(db, dest);
+    hash_set(db->alloc, &db->moved_ids, old.index, id.index);
+    hash_set(db->alloc, moved_slots, from, to);
+}
+
+static bool remap_stored_id(const database_o* db, object_id_t* id)
+{
+    uint64_t to = id->index ? hash_find(&db->moved_ids, id->index, 0) : 0;
+    if (to)
+    {
+        id->index = to;
+    }
+    return to != 0;
+}
+
+// Rewrites the ids held by the properties of object that moved_ids
+// remaps. Without snapshots to preserve, the payloads and arrays shared
+// with other objects are written in place, since every sharer needs the
+// same update.
+static void
+remap_stored_ids(database_o* db, object_t* object, uint64_t version)
+{
+    bool in_place = !db->newest_snapshot;
+    object_type_definition_t* type =
+        &db->object_types[object->id.info.type.index];
+
+    for (uint32_t i = 0; i < type->property_count; i++)
+    {
+        property_layout_t* prop = &db->properties[type->first_property + i];
+        bool changed = false;
+        if (object->page == POOL_PAGE_INSTANCE && !prop->cold
+            && !find_override(db, object, prop))
+        {
+            continue; // remapped with the prototype
+        }
+
+        if (prop->def.type == PTYPE_REFERENCE
+            || prop->def.type == PTYPE_OBJECT)
+        {
+            object_id_t id = *(object_id_t*)get_property_data(db, object, prop);
+            if (remap_stored_id(db, &id))
+            {
+                object_id_t* data =
+                    in_place ? get_property_data(db, object, prop)
+                             : get_property_data_mut(db, object, prop);
+                *data = id;
+                changed = true;
+            }
+        }
+        else if (is_array(prop->def.type))
+        {
+            blob_t* blob = get_property_data(db, object, prop);
+            uint64_t count = blob->size / sizeof(object_id_t);
+            object_id_t* ids = (object_id_t*)blob_bytes(db, blob);
+            for (uint64_t e = 0; e < count; e++)
+            {
+                object_id_t id = ids[e];
+                if (!remap_stored_id(db, &id))
+                {
+                    continue;
+                }
+                if (!changed && !in_place)
+                {
+                    blob = get_property_data_mut(db, object, prop);
+                    ids = array_items_mut(db, blob, count);
+                }
+                ids[e] = id;
+                changed = true;
+            }
+        }
+
+        if (changed)
+        {
+            type->row_versions[object->row] = version;
+            if (prop->row_versions)
+            {
+                prop->row_versions[object->row] = version;
+            }
+        }
+    }
+}
+
+// Pages of the slot table handed back by trim_slots, a multiple of any
+// page size.
+#define SLOT_RELEASE_SIZE Kibi(64)
+
+// Drops the free slots at the end of the table, and hands the pages it
+// no longer uses back to the system. tail_generation keeps the
+// generations of the dropped slots from being reused.
+static void trim_slots(database_o* db)
+{
+    uint32_t count = array_count(db->objects);
+    while (count > 1 && !db->objects[count - 1].id.info.type.index)
+    {
+        count--;
+        unmark_slot_free(db, count);
+        uint16_t generation = db->objects[count].id.info.generation;
+        if (generation > db->tail_generation)
+        {
+            db->tail_generation = generation;
+        }
+    }
+    array_header(db->objects)->count = count;
+
+    uint64_t mask = SLOT_RELEASE_SIZE - 1;
+    uint64_t begin = ((uint64_t)(db->objects + count) + mask) & ~mask;
+    uint64_t end =
+        (uint64_t)(db->objects + array_header(db->objects)->capacity) & ~mask;
+    if (begin < end)
+    {
+        platform_virtual_reset((void*)begin, end - begin);
+    }
+}
+
+static uint32_t compact_slots(database_o* db)
+{
+    collect_snapshots(db, false);
+    hash_free(db->alloc, &db->moved_ids);
+
+    hash_t moved_slots = {0}; // old slot -> new slot
+    uint32_t moved = 0;
+    uint32_t last = array_count(db->objects) - 1;
+    for (;;)
+    {
+        while (last && !db->objects[last].id.info.type.index)
+        {
+            last--;
+        }
+        uint32_t to = lowest_free_slot(db);
+        if (!to || to > last)
+        {
+            break;
+        }
+
+        if (!moved)
+        {
+            // Every object of a type may move, sort once at the end.
+            for (uint32_t i = 0; i < array_count(db->properties); i++)
+            {
+                property_layout_t* prop = &db->properties[i];
+                if (prop->index && (prop->def.flags & PROPERTY_INDEX_ORDERED))
+                {
+                    prop->index->deferred = true;
+                }
+            }
+        }
+        move_object(db, last, to, &moved_slots);
+        moved++;
+    }
+
+    if (moved)
+    {
+        // objects moved all over the tables, the next snapshot copies them
+        db->snapshot_base = 0;
+
+        uint64_t version = ++db->version;
+        for (uint32_t t = 1; t < array_count(db->object_types); t++)
+        {
+            object_type_definition_t* type = &db->object_types[t];
+            type->version = version;
+            for (uint32_t row = 0; row < array_count(type->row_slots); row++)
+            {
+                object_t* object = &db->objects[type->row_slots[row]];
+                remap_stored_ids(db, object, version);
+            }
+        }
+
+        for (uint32_t i = 0; i < array_count(db->links); i++)
+        {
+            reference_link_t* l = &db->links[i];
+            if (l->source.index)
+            {
+                remap_stored_id(db, &l->source);
+                l->target_slot =
+                    hash_find(&moved_slots, l->target_slot, l->target_slot);
+            }
+        }
+        index_links(db);
+
+        for (uint32_t i = 0; i < array_count(db->properties); i++)
+        {
+            rebuild_ordered_index(db, &db->properties[i]);
+        }
+    }
+    hash_free(db->alloc, &moved_slots);
+    trim_slots(db);
+
+    if (db->journal)
+    {
+        journal_append(db,
+                       (journal_record_t){
+                           .kind = JOURNAL_COMPACT,
+                           .offset = moved,
+                       },
+                       0);
+    }
+    return moved;
+}
+
+static object_id_t remap_id(database_o* db, object_id_t id)
+{
+    remap_stored_id(db, &id);
+    return id;
+}
+
+static void get_slot_stats(database_o* db, slot_stats_t* stats)
+{
+    *stats = (slot_stats_t){
+        .slot_count = array_count(db->objects) - 1,
+        .free_count = db->free_slot_count,
+    };
+}
+
+static uint32_t object_count(database_o* db, object_type_t type)
+{
+    if (!type.index || type.index >= array_count(db->object_types))
+    {
+        return 0;
+    }
+
+    return array_count(db->object_types[type.index].row_slots);
+}
+
+static object_iterator_t begin_iteration(database_o* db, object_type_t type)
+{
+    return (object_iterator_t){.type = type, .row = object_count(db, type)};
+}
+
+static bool next_object(database_o* db, object_iterator_t* it, object_id_t* id)
+{
+    if (!it->row)
+    {
+        return false;
+    }
+
+    it->row--;
+
+    const object_type_definition_t* type = &db->object_types[it->type.index];
+    ASSERT(it->row < array_count(type->row_slots));
+
+    *id = db->objects[type->row_slots[it->row]].id;
+    return true;
+}
+
+static void for_each_object(database_o* db,
+                            object_type_t type,
+                            object_callback_t* callback,
+                            void* user_data)
+{
+    object_iterator_t it = begin_iteration(db, type);
+    object_id_t id;
+    while (next_object(db, &it, &id))
+    {
+        callback(db, id, user_data);
+    }
+}
+
+static uint64_t get_version(database_o* db) { return db->version; }
+
+static uint64_t get_type_version(database_o* db, object_type_t type)
+{
+    if (!type.index || type.index >= array_count(db->object_types))
+    {
+        return 0;
+    }
+
+    return db->object_types[type.index].version;
+}
+
+static uint64_t get_object_version(database_o* db, object_id_t id)
+{
+    object_t* object = get_object(db, id);
+    if (!object)
+    {
+        return 0;
+    }
+
+    return db->object_types[id.info.type.index].row_versions[object->row];
+}
+
+static uint64_t get_property_version(database_o* db,
+                                     object_id_t id,
+                                     property_handle_t property)
+{
+    const property_layout_t* prop = get_property(db, id.info.type, property);
+    object_t* object = get_object(db, id);
+    if (!prop || !prop->row_versions || !object)
+    {
+        return 0;
+    }
+
+    return prop->row_versions[object->row];
+}
+
+static uint32_t changed_since(database_o* db,
+                              object_type_t type,
+                              property_handle_t property,
+                              uint64_t version,
+                              object_id_t* results,
+                              uint32_t max_results)
+{
+    if (!type.index || type.index >= array_count(db->object_types))
+    {
+        return 0;
+    }
+
+    const object_type_definition_t* type_def = &db->object_types[type.index];
+    const uint64_t* versions = type_def->row_versions;
+    if (property.index)
+    {
+        const property_layout_t* prop = get_property(db, type, property);
+        if (!prop || !prop->row_versions)
+        {
+            return 0;
+        }
+        versions = prop->row_versions;
+    }
+
+    if (type_def->version <= version)
+    {
+        return 0;
+    }
+
+    uint32_t found = 0;
+    for (uint32_t row = 0; row < array_count(type_def->row_slots); row++)
+    {
+        if (versions[row] > version)
+        {
+            if (found < max_results)
+            {
+                results[found] = db->objects[type_def->row_slots[row]].id;
+            }
+            found++;
+        }
+    }
+
+    return found;
+}
+
+// Copy of SNAPSHOT_CHUNK elements of a table, or less for the last one,
+// shared by the snapshots acquired while it didn't change. It holds a
+// reference on the blobs of the copied elements.
+typedef struct snapshot_chunk_t
+{
+    uint32_t refcount; // acquire and collect only, on the writing thread
+    uint32_t count;
+    /* array */ blob_header_t** blobs;
+} snapshot_chunk_t;
+
+typedef struct snapshot_table_t
+{
+    uint32_t count;
+    uint32_t element_size;
+    snapshot_chunk_t** chunks;
+} snapshot_table_t;
+
+// What a snapshot needs to find the values of an object type at the
+// version it was acquired.
+typedef struct snapshot_type_t
+{
+    uint32_t flags;
+    uint32_t cold_bytes;
+    snapshot_table_t row_slots;
+    snapshot_table_t cold;
+} snapshot_type_t;
+
+// Everything a snapshot reads is either copied here or never written to
+// until it is released : payloads aren't copied, the database stops
+// writing them in place instead, see payload_in_snapshot.
+struct database_snapshot_o
+{
+    database_o* db;
+    uint64_t version;
+    _Atomic uint32_t released; // by release_snapshot, from any thread
+
+    snapshot_table_t objects;
+    uint32_t property_count;
+    property_layout_t* properties;
+    snapshot_table_t* columns; // by property, for columnar types
+    uint32_t type_count;
+    snapshot_type_t* types;
+    snapshot_table_t overrides;
+    snapshot_table_t override_keys; // buckets of override_of_property
+    snapshot_table_t override_values;
+};
+
+static const void* snapshot_element(const snapshot_table_t* table,
+                                    uint32_t index)
+{
+    const snapshot_chunk_t* chunk = table->chunks[index / SNAPSHOT_CHUNK];
+    return (const uint8_t*)(chunk + 1)
+           + (uint64_t)(index % SNAPSHOT_CHUNK) * table->element_size;
+}
+
+// Fills table with the count elements at data : the chunks of base that
+// changed doesn't flag are shared, the others are copied.
+static void snapshot_table(database_o* db,
+                           snapshot_table_t* table,
+                           const snapshot_table_t* base,
+                           /* array */ uint64_t* changed,
+                           const void* data,
+                           uint32_t count,
+                           uint32_t element_size)
+{
+    uint32_t chunk_count = (count + SNAPSHOT_CHUNK - 1) / SNAPSHOT_CHUNK;
+    *table = (snapshot_table_t){.count = count, .element_size = element_size};
+    if (!chunk_count)
+    {
+        return;
+    }
+
+    table->chunks = mem_alloc(db->alloc, sizeof(void*) * chunk_count);
+    for (uint32_t c = 0; c < chunk_count; c++)
+    {
+        uint32_t first = c * SNAPSHOT_CHUNK;
+        uint32_t n = count - first < SNAPSHOT_CHUNK ? count - first
+                                                    : SNAPSHOT_CHUNK;
+        snapshot_chunk_t* chunk =
+            base && base->element_size == element_size
+                    && base->count > first && !chunk_changed(changed, c)
+                ? base->chunks[c]
+                : 0;
+        if (chunk && chunk->count == n)
+        {
+            chunk->refcount++;
+            table->chunks[c] = chunk;
+            continue;
+        }
+
+        chunk = mem_alloc(db->alloc,
+                          sizeof(*chunk) + (uint64_t)n * element_size);
+        *chunk = (snapshot_chunk_t){.refcount = 1, .count = n};
+        memcpy(chunk + 1,
+               (const uint8_t*)data + (uint64_t)first * element_size,
+               (uint64_t)n * element_size);
+        table->chunks[c] = chunk;
+    }
+}
+
+// Takes a reference on the blob at offset in the elements of the chunks
+// snapshot_table just copied, the only ones referenced once.
+static void snapshot_table_blobs(database_o* db,
+                                 snapshot_table_t* table,
+                                 uint32_t offset,
+                                 const uint32_t* properties)
+{
+    for (uint32_t i = 0; i < table->count; i++)
+    {
+        snapshot_chunk_t* chunk = table->chunks[i / SNAPSHOT_CHUNK];
+        if (chunk->refcount > 1)
+        {
+            i += chunk->count - 1;
+            continue;
+        }
+
+        if (properties && !holds_blob(db->properties[properties[i]].def.type))
+        {
+            continue;
+        }
+
+        blob_header_t* header =
+            blob_header((blob_t*)((uint8_t*)snapshot_element(table, i)
+                                  + offset));
+        if (header)
+        {
+            blob_retain(db, header);
+            array_push(db->alloc, chunk->blobs, header);
+        }
+    }
+}
+
+static void free_snapshot_table(database_o* db, snapshot_table_t* table)
+{
+    uint32_t chunk_count = (table->count + SNAPSHOT_CHUNK - 1) / SNAPSHOT_CHUNK;
+    for (uint32_t c = 0; c < chunk_count; c++)
+    {
+        snapshot_chunk_t* chunk = table->chunks[c];
+        if (--chunk->refcount)
+        {
+            continue;
+        }
+
+        for (uint32_t i = 0; i < array_count(chunk->blobs); i++)
+        {
+            blob_release(db, chunk->blobs[i]);
+        }
+        if (chunk->blobs)
+        {
+            array_free(db->alloc, chunk->blobs);
+        }
+        mem_free(db->alloc,
+                 chunk,
+                 sizeof(*chunk) + (uint64_t)chunk->count * table->element_size);
+    }
+    if (chunk_count)
+    {
+        mem_free(db->alloc, table->chunks, sizeof(void*) * chunk_count);
+    }
+}
+
+static void free_snapshot(database_o* db, database_snapshot_o* snapshot)
+{
+    free_snapshot_table(db, &snapshot->objects);
+    free_snapshot_table(db, &snapshot->overrides);
+    free_snapshot_table(db, &snapshot->override_keys);
+    free_snapshot_table(db, &snapshot->override_values);
+    for (uint32_t t = 1; t < snapshot->type_count; t++)
+    {
+        free_snapshot_table(db, &snapshot->types[t].row_slots);
+        free_snapshot_table(db, &snapshot->types[t].cold);
+    }
+    for (uint32_t i = 1; i < snapshot->property_count; i++)
+    {
+        free_snapshot_table(db, &snapshot->columns[i]);
+    }
+
+    mem_free(db->alloc,
+             snapshot->properties,
+             sizeof(property_layout_t) * snapshot->property_count);
+    mem_free(db->alloc,
+             snapshot->columns,
+             sizeof(snapshot_table_t) * snapshot->property_count);
+    mem_free(db->alloc,
+             snapshot->types,
+             sizeof(snapshot_type_t) * snapshot->type_count);
+    mem_free(db->alloc, snapshot, sizeof(*snapshot));
+}
+
+// Frees the released snapshots, or all of them, and the payloads that
+// only they could read. The newest one is kept for the next to share its
+// chunks, unless all are freed.
+static void collect_snapshots(database_o* db, bool all)
+{
+    atomic_store_explicit(&db->released_snapshots, 0, memory_order_relaxed);
+
+    uint64_t oldest = UINT64_MAX;
+    uint64_t newest = 0;
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < array_count(db->snapshots); i++)
+    {
+        database_snapshot_o* snapshot = db->snapshots[i];
+        bool released =
+            atomic_load_explicit(&snapshot->released, memory_order_acquire);
+        if (all || (released && snapshot != db->snapshot_base))
+        {
+            free_snapshot(db, snapshot);
+            continue;
+        }
+
+        if (!released)
+        {
+            oldest = snapshot->version < oldest ? snapshot->version : oldest;
+            newest = snapshot->version > newest ? snapshot->version : newest;
+        }
+        db->snapshots[kept++] = snapshot;
+    }
+    if (db->snapshots)
+    {
+        array_header(db->snapshots)->count = kept;
+    }
+    db->newest_snapshot = newest;
+
+    kept = 0;
+    for (uint32_t i = 0; i < array_count(db->retired); i++)
+    {
+        retired_payload_t retired = db->retired[i];
+        if (oldest <= retired.needed_until)
+        {
+            db->retired[kept++] = retired;
+        }
+        else
+        {
+            drop_payload(db,
+                         &db->object_types[retired.type],
+                         retired.data,
+                         retired.page);
+        }
+    }
+    if (db->retired)
+    {
+        array_header(db->retired)->count = kept;
+    }
+
+    if (all)
+    {
+        db->snapshot_base = 0;
+        uint64_t** bits[] = {
+            &db->changed_slots,
+            &db->changed_cells,
+            &db->changed_buckets,
+        };
+        for (uint32_t i = 0; i < STATIC_ARRAY_COUNT(bits); i++)
+        {
+            if (*bits[i])
+            {
+                array_free(db->alloc, *bits[i]);
+            }
+            *bits[i] = 0;
+        }
+        for (uint32_t t = 1; t < array_count(db->object_types); t++)
+        {
+            object_type_definition_t* type = &db->object_types[t];
+            if (type->changed_rows)
+            {
+                array_free(db->alloc, type->changed_rows);
+            }
+            type->changed_rows = 0;
+        }
+    }
+}
+
+static void clear_changed(uint64_t* bits)
+{
+    if (bits)
+    {
+        memset(bits, 0, sizeof(uint64_t) * array_count(bits));
+    }
+}
+
+static database_snapshot_o* acquire_snapshot(database_o* db)
+{
+    const database_snapshot_o* base = db->snapshot_base;
+    database_snapshot_o* snapshot = mem_alloc(db->alloc, sizeof(*snapshot));
+    *snapshot = (database_snapshot_o){
+        .db = db,
+        .version = db->version,
+        .property_count = array_count(db->properties),
+        .type_count = array_count(db->object_types),
+    };
+    snapshot_table(db,
+                   &snapshot->objects,
+                   base ? &base->objects : 0,
+                   db->changed_slots,
+                   db->objects,
+                   array_count(db->objects),
+                   sizeof(object_t));
+    snapshot->properties =
+        mem_alloc(db->alloc,
+                  sizeof(property_layout_t) * snapshot->property_count);
+    memcpy(snapshot->properties,
+           db->properties,
+           sizeof(property_layout_t) * snapshot->property_count);
+    snapshot->columns =
+        mem_alloc(db->alloc,
+                  sizeof(snapshot_table_t) * snapshot->property_count);
+    memset(snapshot->columns,
+           0,
+           sizeof(snapshot_table_t) * snapshot->property_count);
+    snapshot->types = mem_alloc(db->alloc,
+                                sizeof(snapshot_type_t) * snapshot->type_count);
+    snapshot->types[0] = (snapshot_type_t){0};
+
+    for (uint32_t t = 1; t < snapshot->type_count; t++)
+    {
+        const object_type_definition_t* def = &db->object_types[t];
+        const snapshot_type_t* base_type =
+            base && t < base->type_count ? &base->types[t] : 0;
+        snapshot_type_t* type = &snapshot->types[t];
+        uint32_t rows = array_count(def->row_slots);
+        *type = (snapshot_type_t){
+            .flags = def->flags,
+            .cold_bytes = def->cold_bytes,
+        };
+        snapshot_table(db,
+                       &type->row_slots,
+                       base_type ? &base_type->row_slots : 0,
+                       def->changed_rows,
+                       def->row_slots,
+                       rows,
+                       sizeof(uint32_t));
+        snapshot_table(db,
+                       &type->cold,
+                       base_type ? &base_type->cold : 0,
+                       def->changed_rows,
+                       def->cold,
+                       def->cold_bytes ? rows : 0,
+                       def->cold_bytes);
+
+        bool columnar = def->flags & OBJECT_TYPE_COLUMNAR;
+        for (uint32_t i = 0; i < def->property_count; i++)
+        {
+            uint32_t index = def->first_property + i;
+            const property_layout_t* prop = &db->properties[index];
+            if (columnar)
+            {
+                snapshot_table(db,
+                               &snapshot->columns[index],
+                               base_type ? &base->columns[index] : 0,
+                               def->changed_rows,
+                               prop->column,
+                               rows,
+                               prop->size);
+            }
+            if (!holds_blob(prop->def.type))
+            {
+                continue;
+            }
+            else if (columnar)
+            {
+                snapshot_table_blobs(db, &snapshot->columns[index], 0, 0);
+            }
+            else if (prop->cold)
+            {
+                snapshot_table_blobs(db, &type->cold, prop->offset, 0);
+            }
+        }
+    }
+
+    const hash_t* overrides = &db->override_of_property;
+    snapshot_table(db,
+                   &snapshot->overrides,
+                   base ? &base->overrides : 0,
+                   db->changed_cells,
+                   db->overrides,
+                   array_count(db->overrides),
+                   sizeof(override_cell_t));
+    snapshot_table_blobs(db, &snapshot->overrides, 0, db->override_properties);
+    snapshot_table(db,
+                   &snapshot->override_keys,
+                   base ? &base->override_keys : 0,
+                   db->changed_buckets,
+                   overrides->keys,
+                   overrides->bucket_count,
+                   sizeof(uint64_t));
+    snapshot_table(db,
+                   &snapshot->override_values,
+                   base ? &base->override_values : 0,
+                   db->changed_buckets,
+                   overrides->values,
+                   overrides->bucket_count,
+                   sizeof(uint64_t));
+
+    clear_changed(db->changed_slots);
+    clear_changed(db->changed_cells);
+    clear_changed(db->changed_buckets);
+    for (uint32_t t = 1; t < snapshot->type_count; t++)
+    {
+        clear_changed(db->object_types[t].changed_rows);
+    }
+
+    // the previous base goes, unless a reader still holds it
+    array_push(db->alloc, db->snapshots, snapshot);
+    db->snapshot_base = snapshot;
+    collect_snapshots(db, false);
+    return snapshot;
+}
+
+static void release_snapshot(database_snapshot_o* snapshot)
+{
+    // the snapshot may be freed as soon as it is flagged
+    database_o* db = snapshot->db;
+    atomic_store_explicit(&snapshot->released, 1, memory_order_release);
+    atomic_fetch_add_explicit(&db->released_snapshots, 1, memory_order_relaxed);
+}
+
+static uint64_t get_snapshot_version(const database_snapshot_o* snapshot)
+{
+    return snapshot->version;
+}
+
+static uint32_t get_snapshot_objects(const database_snapshot_o* snapshot,
+                                     object_type_t type,
+                                     uint32_t first,
+                                     object_id_t* results,
+                                     uint32_t max_results)
+{
+    if (!type.index || type.index >= snapshot->type_count)
+    {
+        return 0;
+    }
+
+    const snapshot_table_t* rows = &snapshot->types[type.index].row_slots;
+    for (uint32_t i = 0; i < max_results && first + i < rows->count; i++)
+    {
+        uint32_t slot = *(const uint32_t*)snapshot_element(rows, first + i);
+        results[i] =
+            ((const object_t*)snapshot_element(&snapshot->objects, slot))->id;
+    }
+    return rows->count;
+}
+
+// hash_find on the copy of override_of_property, probing the same way.
+static uint32_t find_snapshot_override(const database_snapshot_o* snapshot,
+                                       uint64_t key)
+{
+    uint32_t bucket_count = snapshot->override_keys.count;
+    for (uint32_t i = 0; i < bucket_count; i++)
+    {
+        uint32_t bucket = (key % bucket_count + i) % bucket_count;
+        uint64_t found =
+            *(const uint64_t*)snapshot_element(&snapshot->override_keys,
+                                               bucket);
+        if (found == key)
+        {
+            return *(const uint64_t*)snapshot_element(
+                &snapshot->override_values,
+                bucket);
+        }
+        else if (!found)
+        {
+            break;
+        }
+    }
+    return 0;
+}
+
+static const void* snapshot_property_data(const database_snapshot_o* snapshot,
+                                          object_id_t id,
+                                          property_handle_t property)
+{
+    if (!id.index || id.info.slot >= snapshot->objects.count
+        || !property.index || property.index >= snapshot->property_count)
+    {
+        return 0;
+    }
+
+    const object_t* object = snapshot_element(&snapshot->objects, id.info.slot);
+    const property_layout_t* prop = &snapshot->properties[property.index];
+    if (object->id.index != id.index
+        || prop->owner.index != id.info.type.index)
+    {
+        return 0;
+    }
+
+    const snapshot_type_t* type = &snapshot->types[prop->owner.index];
+    if (type->flags & OBJECT_TYPE_COLUMNAR)
+    {
+        return snapshot_element(&snapshot->columns[property.index],
+                                object->row);
+    }
+    else if (prop->cold)
+    {
+        return (const uint8_t*)snapshot_element(&type->cold, object->row)
+               + prop->offset;
+    }
+    else if (object->page == POOL_PAGE_INSTANCE)
+    {
+        uint32_t cell =
+            find_snapshot_override(snapshot,
+                                   property_slot_key(id, property.index));
+        return cell ? snapshot_element(&snapshot->overrides, cell - 1)
+                    : snapshot_property_data(snapshot,
+                                             object->prototype,
+                                             property);
+    }
+    return (uint8_t*)object->data + prop->offset;
+}
+
+static bool read_snapshot_h(const database_snapshot_o* snapshot,
+                            object_id_t id,
+                            property_handle_t property,
+                            void* value,
+                            uint32_t size)
+{
+    const void* data = snapshot_property_data(snapshot, id, property);
+    const property_layout_t* prop = &snapshot->properties[property.index];
+    if (!data || holds_blob(prop->def.type) || prop->size != size)
+    {
+        return false;
+    }
+
+    memcpy(value, data, size);
+    return true;
+}
+
+static blob_view_t read_snapshot_blob_h(const database_snapshot_o* snapshot,
+                                        object_id_t id,
+                                        property_handle_t property)
+{
+    const blob_t* blob = snapshot_property_data(snapshot, id, property);
+    if (!blob || !holds_blob(snapshot->properties[property.index].def.type)
+        || !blob->size)
+    {
+        return (blob_view_t){0};
+    }
+    return (blob_view_t){blob_bytes(snapshot->db, blob), blob->size};
+}
+
+static bool
+get_type_layout(database_o* db, object_type_t type, type_layout_info_t* info)
+{
+    if (!type.index || type.index >= array_count(db->object_types))
+    {
+        return false;
+    }
+
+    const object_type_definition_t* def = &db->object_types[type.index];
+    uint32_t used = 0;
+    for (uint32_t i = 0; i < def->property_count; i++)
+    {
+        used += db->properties[def->first_property + i].size;
+    }
+
+    *info = (type_layout_info_t){
+        .hot_bytes = def->bytes,
+        .cold_bytes = def->cold_bytes,
+        .payload_stride = def->pool.element_size,
+        .padding_bytes = def->bytes + def->cold_bytes - used,
+    };
+    return true;
+}
+
+static bool get_property_layout(database_o* db,
+                                object_type_t type,
+                                property_handle_t property,
+                                property_layout_info_t* info)
+{
+    const property_layout_t* prop = get_property(db, type, property);
+    if (!prop)
+    {
+        return false;
+    }
+
+    *info = (property_layout_info_t){
+        .offset = prop->offset,
+        .size = prop->size,
+        .type = prop->def.type,
+        .alignment = prop->alignment,
+        .cold = prop->cold,
+    };
+    return true;
+}
+
+static const void* get_column(database_o* db,
+                              object_type_t type,
+                              property_handle_t property,
+                              uint32_t* count)
+{
+    const property_layout_t* prop = get_property(db, type, property);
+    if (!prop || !(db->object_types[type.index].flags & OBJECT_TYPE_COLUMNAR))
+    {
+        *count = 0;
+        return 0;
+    }
+
+    *count = array_count(db->object_types[type.index].row_slots);
+    return prop->column;
+}
+
+static const void* get_payload(database_o* db, object_id_t id)
+{
+    const object_t* object = get_object(db, id);
+    return object && object->page != POOL_PAGE_INSTANCE ? object->data : 0;
+}
+
+static void emit(mem_allocator_i* alloc, char** text, const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int size = vsnprintf(0, 0, fmt, args);
+    va_end(args);
+
+    uint32_t at = array_count(*text);
+    array_reserve(alloc, *text, at + size + 1);
+    va_start(args, fmt);
+    vsnprintf(*text + at, size + 1, fmt, args);
+    va_end(args);
+    array_header(*text)->count += size;
+}
+
+#define DO_ACCESSOR_TYPE_CASE(upper, lower, type)                              \
+    case PTYPE_##upper:                                                        \
+        *enum_name = "PTYPE_" #upper;                                          \
+        *c_type = #type;                                                       \
+        *suffix = #lower;                                                      \
+        break;
+
+// C names of a property type, for the generated accessors.
+static void accessor_type_names(uint32_t type,
+                                const char** enum_name,
+                                const char** c_type,
+                                const char** suffix)
+{
+    *c_type = "object_id_t";
+    *suffix = "reference";
+    switch (type)
+    {
+        FOR_ALL_BASE_PROPERTY_TYPES(DO_ACCESSOR_TYPE_CASE)
+    case PTYPE_BLOB:
+        *enum_name = "PTYPE_BLOB";
+        *c_type = "blob_view_t";
+        break;
+    case PTYPE_OBJECT:
+        *enum_name = "PTYPE_OBJECT";
+        break;
+    case PTYPE_REFERENCE_ARRAY:
+        *enum_name = "PTYPE_REFERENCE_ARRAY";
+        *c_type = "object_array_view_t";
+        break;
+    case PTYPE_OBJECT_ARRAY:
+        *enum_name = "PTYPE_OBJECT_ARRAY";
+        *c_type = "object_array_view_t";
+        break;
+    case PTYPE_STRING:
+        *enum_name = "PTYPE_STRING";
+        *c_type = "string_id_t";
+        *suffix = "string";
+        break;
+    default:
+        *enum_name = "PTYPE_REFERENCE";
+        break;
+    }
+}
+
+static bool is_identifier(const char* name)
+{
+    if (!name[0] || (name[0] >= '0' && name[0] <= '9'))
+    {
+        return false;
+    }
+    for (const char* c = name; *c; c++)
+    {
+        if (!(*c == '_' || (*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z')
+              || (*c >= '0' && *c <= '9')))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Emits "head(params...)" with one parameter per line when it doesn't
+// fit in 80 columns, and opens the body.
+static void emit_function(mem_allocator_i* alloc,
+                          char** text,
+                          const char* head,
+                          const char** params,
+                          uint32_t param_count)
+{
+    uint32_t length = strlen(head) + 1;
+    for (uint32_t i = 0; i < param_count; i++)
+    {
+        length += strlen(params[i]) + 2;
+    }
+
+    emit(alloc, text, "%s(", head);
+    for (uint32_t i = 0; i < param_count; i++)
+    {
+        if (!i)
+        {
+            emit(alloc, text, "%s", params[i]);
+        }
+        else if (length <= 80)
+        {
+            emit(alloc, text, ", %s", params[i]);
+        }
+        else
+        {
+            emit(alloc, text, ",\n%*s%s", (int)strlen(head) + 1, "", params[i]);
+        }
+    }
+    emit(alloc, text, ")\n{\n");
+}
+
+static void emit_accessors(mem_allocator_i* alloc,
+                           char** text,
+                           const char* p,
+                           const database_o* db,
+                           object_type_t type)
+{
+    const object_type_definition_t* def = &db->object_types[type.index];
+    bool columnar = def->flags & OBJECT_TYPE_COLUMNAR;
+    char head[256];
+    char accessors[128];
+    snprintf(accessors, sizeof(accessors), "const %s_accessors_t* a", p);
+
+    emit(alloc,
+         text,
+         "// Generated by database_api.generate_accessors, do not edit.\n"
+         "#pragma once\n\n"
+         "#include \"data_model.h\"\n\n"
+         "#include <string.h>\n\n"
+         "typedef struct %s_accessors_t\n{\n"
+         "    database_api* api;\n"
+         "    database_o* db;\n"
+         "    object_type_t type;\n",
+         p);
+    for (uint32_t i = 0; i < def->property_count; i++)
+    {
+        emit(alloc,
+             text,
+             "    property_handle_t %s;\n",
+             db->properties[def->first_property + i].def.name);
+    }
+    emit(alloc, text, "} %s_accessors_t;\n\n", p);
+
+    emit(alloc,
+         text,
+         "// Resolves the property handles of type, returns false if its\n"
+         "// layout isn't the one the accessors were generated for.\n");
+    snprintf(head, sizeof(head), "static inline bool %s_register", p);
+    char register_accessors[128];
+    snprintf(register_accessors,
+             sizeof(register_accessors),
+             "%s_accessors_t* a",
+             p);
+    emit_function(alloc,
+                  text,
+                  head,
+                  (const char*[]){
+                      register_accessors,
+                      "database_api* api",
+                      "database_o* db",
+                      "object_type_t type",
+                  },
+                  4);
+    emit(alloc,
+         text,
+         "    static const struct\n    {\n"
+         "        const char* name;\n"
+         "        uint32_t type;\n"
+         "        uint32_t offset;\n"
+         "        uint32_t size;\n"
+         "        bool cold;\n"
+         "    } expected[] = {\n");
+    for (uint32_t i = 0; i < def->property_count; i++)
+    {
+        const property_layout_t* prop =
+            &db->properties[def->first_property + i];
+        const char *enum_name, *c_type, *suffix;
+        accessor_type_names(prop->def.type, &enum_name, &c_type, &suffix);
+        emit(alloc,
+             text,
+             "        {\"%s\", %s, %u, %u, %d},\n",
+             prop->def.name,
+             enum_name,
+             prop->offset,
+             prop->size,
+             prop->cold);
+    }
+    emit(alloc, text, "    };\n    property_handle_t* handles[] = {\n");
+    for (uint32_t i = 0; i < def->property_count; i++)
+    {
+        emit(alloc,
+             text,
+             "        &a->%s,\n",
+             db->properties[def->first_property + i].def.name);
+    }
+    emit(alloc,
+         text,
+         "    };\n\n"
+         "    *a = (%s_accessors_t){.api = api, .db = db, .type = type};\n"
+         "    type_layout_info_t layout;\n"
+         "    if (!api->get_type_layout(db, type, &layout)\n"
+         "        || layout.hot_bytes != %u || layout.cold_bytes != %u)\n"
+         "    {\n        return false;\n    }\n"
+         "    for (uint32_t i = 0; i < %u; i++)\n    {\n"
+         "        property_layout_info_t info;\n"
+         "        *handles[i] = api->find_property(db, type, "
+         "expected[i].name);\n"
+         "        if (!api->get_property_layout(db, type, *handles[i], "
+         "&info)\n"
+         "            || info.type != expected[i].type\n"
+         "            || info.offset != expected[i].offset\n"
+         "            || info.size != expected[i].size\n"
+         "            || info.cold != expected[i].cold)\n"
+         "        {\n            return false;\n        }\n"
+         "    }\n"
+         "    return true;\n}\n",
+         p,
+         def->bytes,
+         def->cold_bytes,
+         def->property_count);
+
+    if (!columnar)
+    {
+        emit(alloc,
+             text,
+             "\n// Hot properties of id, for the %s_<property> readers, or "
+             "null\n"
+             "// for instances. Valid until the next change to the database.\n",
+             p);
+        snprintf(head, sizeof(head), "static inline const void* %s_payload", p);
+        emit_function(alloc,
+                      text,
+                      head,
+                      (const char*[]){accessors, "object_id_t id"},
+                      2);
+        emit(alloc, text, "    return a->api->get_payload(a->db, id);\n}\n");
+    }
+
+    for (uint32_t i = 0; i < def->property_count; i++)
+    {
+        const property_layout_t* prop =
+            &db->properties[def->first_property + i];
+        const char* name = prop->def.name;
+        const char *enum_name, *c_type, *suffix;
+        accessor_type_names(prop->def.type, &enum_name, &c_type, &suffix);
+
+        bool value = prop->def.type < PTYPE_BLOB
+                     || prop->def.type == PTYPE_REFERENCE
+                     || prop->def.type == PTYPE_STRING;
+        bool inline_read = value && !columnar && !prop->cold;
+        if (inline_read)
+        {
+            emit(alloc,
+                 text,
+                 "\nstatic inline %s %s_%s(const void* payload)\n{\n"
+                 "    %s value;\n"
+                 "    memcpy(&value, (const uint8_t*)payload + %u, "
+                 "sizeof(value));\n"
+                 "    return value;\n}\n",
+                 c_type,
+                 p,
+                 name,
+                 c_type,
+                 prop->offset);
+        }
+
+        emit(alloc, text, "\n");
+        snprintf(head,
+                 sizeof(head),
+                 "static inline %s %s_get_%s",
+                 c_type,
+                 p,
+                 name);
+        emit_function(alloc,
+                      text,
+                      head,
+                      (const char*[]){accessors, "object_id_t id"},
+                      2);
+        if (inline_read)
+        {
+            // instances and dead objects have no payload to read from
+            emit(alloc,
+                 text,
+                 "    const void* payload = a->api->get_payload(a->db, id);\n"
+                 "    if (payload)\n    {\n"
+                 "        return %s_%s(payload);\n    }\n"
+                 "    return a->api->get_%s_h(a->db, id, a->%s);\n}\n",
+                 p,
+                 name,
+                 suffix,
+                 name);
+        }
+        else if (prop->def.type == PTYPE_BLOB)
+        {
+            emit(alloc,
+                 text,
+                 "    return a->api->read_blob_h(a->db, id, a->%s);\n}\n",
+                 name);
+        }
+        else if (prop->def.type == PTYPE_OBJECT)
+        {
+            emit(alloc,
+                 text,
+                 "    return a->api->get_sub_object_h(a->db, id, a->%s);\n}\n",
+                 name);
+        }
+        else if (is_array(prop->def.type))
+        {
+            emit(alloc,
+                 text,
+                 "    return a->api->read_array_h(a->db, id, a->%s);\n}\n",
+                 name);
+        }
+        else
+        {
+            emit(alloc,
+                 text,
+                 "    return a->api->get_%s_h(a->db, id, a->%s);\n}\n",
+                 suffix,
+                 name);
+        }
+
+        if (prop->def.type == PTYPE_OBJECT || is_array(prop->def.type))
+        {
+            continue; // sub-objects are never set, arrays are appended to
+        }
+
+        emit(alloc, text, "\n");
+        char value_param[64];
+        snprintf(value_param, sizeof(value_param), "%s value", c_type);
+        snprintf(head,
+                 sizeof(head),
+                 "static inline %s %s_set_%s",
+                 prop->def.type == PTYPE_REFERENCE ? "void" : "bool",
+                 p,
+                 name);
+        if (prop->def.type == PTYPE_BLOB)
+        {
+            emit_function(alloc,
+                          text,
+                          head,
+                          (const char*[]){
+                              accessors,
+                              "object_id_t id",
+                              "const void* data",
+                              "uint64_t size",
+                          },
+                          4);
+            emit(alloc,
+                 text,
+                 "    return a->api->set_blob_h(a->db, id, a->%s, data, "
+                 "size);\n}\n",
+                 name);
+            continue;
+        }
+
+        emit_function(alloc,
+                      text,
+                      head,
+                      (const char*[]){accessors, "object_id_t id", value_param},
+                      3);
+        if (prop->def.type == PTYPE_REFERENCE)
+        {
+            emit(alloc,
+                 text,
+                 "    a->api->set_reference_h(a->db, id, a->%s, value);\n}\n",
+                 name);
+        }
+        else
+        {
+            emit(alloc,
+                 text,
+                 "    return a->api->set_%s_h(a->db, id, a->%s, value);\n}\n",
+                 suffix,
+                 name);
+        }
+    }
+}
+
+static bool generate_accessors(mem_allocator_i* alloc,
+                               const char* prefix,
+                               uint32_t property_count,
+                               property_definition_t* properties,
+                               uint32_t flags,
+                               const char* path)
+{
+    if (!is_identifier(prefix))
+    {
+        return false;
+    }
+    for (uint32_t i = 0; i < property_count; i++)
+    {
+        if (!is_identifier(properties[i].name))
+        {
+            log_error("Property '%s' isn't a C identifier", properties[i].name);
+            return false;
+        }
+    }
+
+    // laid out by the same code as the types registered at runtime
+    database_o* db = create(alloc);
+    object_type_t type =
+        add_object_type_ex(db, property_count, properties, flags);
+
+    char* text = 0;
+    emit_accessors(alloc, &text, prefix, db, type);
+    destroy(db);
+
+    platform_file_o* file = platform_create_file(path);
+    bool written = file
+                   && platform_write_file(file, text, array_count(text))
+                          == array_count(text);
+    if (file)
+    {
+        platform_close_file(file);
+    }
+    array_free(alloc, text);
+    return written;
+}
+
+// On disk format of save_to_file. Everything the database points to is
+// written as offsets from the start of the file, so that a mapped file
+// can be used in place : loading only copies the small bookkeeping
+// arrays and rebuilds the hash tables. Payloads, columns and blobs stay
+// in the file until they are written to or resized.
+//
+// NOTE(octave) : the raw structs are written as is, files are only
+// meant to be read back by the same build on the same architecture.
+#define DATABASE_FILE_MAGIC 0x31424449554f /* "OUIDB1" */
+#define DATABASE_FILE_VERSION 6
+
+typedef struct file_header_t
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t type_count; // without the null type
+    uint32_t property_count; // without the null property
+    uint32_t slot_count;
+    uint32_t link_count;
+    uint32_t first_free_link;
+    uint32_t tail_generation;
+    uint32_t override_count;
+    uint64_t db_version;
+    uint64_t types_offset;
+    uint64_t properties_offset;
+    uint64_t slots_offset; // instances keep their prototype id
+    uint64_t links_offset;
+    uint64_t overrides_offset;
+    uint64_t strings_offset; // texts of the string values, 0 terminated
+    uint64_t strings_size;
+    uint64_t file_size;
+} file_header_t;
+
+typedef struct file_type_t
+{
+    uint32_t flags;
+    uint32_t property_count;
+    uint32_t row_count;
+    uint32_t stride; // distance between two payloads
+    uint32_t cold_bytes;
+    uint32_t padding;
+    uint64_t version;
+    // row order skipping instances, not used for columnar types
+    uint64_t payloads_offset;
+    uint64_t cold_offset;
+    uint64_t rows_offset;
+    uint64_t row_versions_offset;
+} file_type_t;
+
+typedef struct file_property_t
+{
+    property_definition_t def;
+    uint32_t entry_count;
+    uint32_t first_free_entry;
+    uint32_t sorted_count;
+    uint32_t padding;
+    uint64_t column_offset;
+    uint64_t row_versions_offset;
+    uint64_t entries_offset;
+    uint64_t sorted_offset;
+} file_property_t;
+
+// Override cell of an instance.
+typedef struct file_override_t
+{
+    uint32_t slot;
+    uint32_t property;
+    override_cell_t value; // blobs as offsets, as in payloads
+} file_override_t;
+
+#define FILE_WRITER_BUFFER_SIZE Mebi(1)
+
+typedef struct file_writer_t
+{
+    mem_allocator_i* alloc;
+    platform_file_o* file;
+    uint8_t* buffer;
+    uint64_t capacity;
+    uint64_t used;
+    uint64_t offset; // in the file, of the end of the buffered data
+    bool failed;
+} file_writer_t;
+
+static void writer_flush(file_writer_t* w)
+{
+    if (w->used
+        && platform_write_file(w->file, w->buffer, w->used) != w->used)
+    {
+        w->failed = true;
+    }
+    w->used = 0;
+}
+
+static void* writer_reserve(file_writer_t* w, uint64_t size)
+{
+    if (w->used + size > w->capacity)
+    {
+        writer_flush(w);
+    }
+    if (size > w->capacity)
+    {
+        w->buffer = mem_realloc(w->alloc, w->buffer, w->capacity, size);
+        w->capacity = size;
+    }
+
+    void* result = w->buffer + w->used;
+    w->used += size;
+    w->offset += size;
+    return result;
+}
+
+static void writer_write(file_writer_t* w, const void* data, uint64_t size)
+{
+    if (!size)
+    {
+        return;
+    }
+    else if (size > w->capacity)
+    {
+        // big blobs and columns skip the buffer
+        writer_flush(w);
+        if (platform_write_file(w->file, data, size) != size)
+        {
+            w->failed = true;
+        }
+        w->offset += size;
+    }
+    else
+    {
+        memcpy(writer_reserve(w, size), data, size);
+    }
+}
+
+static void writer_align(file_writer_t* w, uint64_t alignment)
+{
+    uint64_t padding = (alignment - w->offset % alignment) % alignment;
+    memset(writer_reserve(w, padding), 0, padding);
+}
+
+static uint32_t blob_property_count(const database_o* db,
+                                    const object_type_definition_t* type)
+{
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < type->property_count; i++)
+    {
+        count += holds_blob(db->properties[type->first_property + i].def.type);
+    }
+    return count;
+}
+
+// Replaces the blob pointers of a payload or cold block copied to the
+// file by the offsets their data was written at.
+static void patch_blobs(const database_o* db,
+                        const object_type_definition_t* type,
+                        uint8_t* block,
+                        bool cold,
+                        const uint64_t* offsets)
+{
+    uint32_t blob = 0;
+    for (uint32_t i = 0; i < type->property_count; i++)
+    {
+        const property_layout_t* prop =
+            &db->properties[type->first_property + i];
+        if (!holds_blob(prop->def.type))
+        {
+            continue;
+        }
+        if (prop->cold == cold)
+        {
+            ((blob_t*)(block + prop->offset))->data = (void*)offsets[blob];
+        }
+        blob++;
+    }
+}
+
+// Adds the override cells of an instance to overrides, with the offsets
+// its blobs were written at.
+static void push_file_overrides(database_o* db,
+                                const object_t* object,
+                                const uint64_t* offsets,
+                                /* array */ file_override_t** overrides)
+{
+    const object_type_definition_t* type =
+        &db->object_types[object->id.info.type.index];
+    uint32_t blob = 0;
+    for (uint32_t i = 0; i < type->property_count; i++)
+    {
+        const property_layout_t* prop =
+            &db->properties[type->first_property + i];
+        override_cell_t* cell =
+            prop->cold ? 0 : find_override(db, object, prop);
+        if (cell)
+        {
+            file_override_t entry = {
+                .slot = object->id.info.slot,
+                .property = type->first_property + i,
+                .value = *cell,
+            };
+            if (holds_blob(prop->def.type))
+            {
+                entry.value.blob.data = (void*)offsets[blob];
+            }
+            file_override_t* pushed = *overrides;
+            array_push(db->alloc, pushed, entry);
+            *overrides = pushed;
+        }
+        blob += holds_blob(prop->def.type);
+    }
+}
+
+// Adds the ids of the string values to ids, for files to store their
+// texts.
+static void collect_string_ids(database_o* db, hash_t* ids)
+{
+    for (uint32_t t = 1; t < array_count(db->object_types); t++)
+    {
+        const object_type_definition_t* type = &db->object_types[t];
+        for (uint32_t i = 0; i < type->property_count; i++)
+        {
+            const property_layout_t* prop =
+                &db->properties[type->first_property + i];
+            if (prop->def.type != PTYPE_STRING)
+            {
+                continue;
+            }
+
+            for (uint32_t row = 0; row < array_count(type->row_slots); row++)
+            {
+                const object_t* object = &db->objects[type->row_slots[row]];
+                const string_id_t* id = get_property_data(db, object, prop);
+                if (id->hash)
+                {
+                    hash_set(db->alloc, ids, id->hash, 1);
+                }
+            }
+        }
+    }
+}
+
+// Returns the size of the file, 0 on failure.
+// Writes a database file image of db to file, from its current position,
+// which must be 0. Returns the size of the image, or 0 on failure.
+static uint64_t
+write_snapshot_to(database_o* db, platform_file_o* file, const char* path)
+{
+    file_writer_t w = {
+        .alloc = db->alloc,
+        .file = file,
+        .buffer = mem_alloc(db->alloc, FILE_WRITER_BUFFER_SIZE),
+        .capacity = FILE_WRITER_BUFFER_SIZE,
+    };
+
+    // patched in once everything else is written
+    memset(writer_reserve(&w, sizeof(file_header_t)),
+           0,
+           sizeof(file_header_t));
+
+    // Blobs first, in type, row then property order, so that the
+    // payloads and columns written below can refer to them by offset.
+    /* array */ uint64_t* blob_offsets = 0;
+    hash_t written = {0}; // shared payloads : data -> offset
+    hash_t strings = {0};
+    collect_string_ids(db, &strings);
+    for (uint32_t t = 1; t < array_count(db->object_types); t++)
+    {
+        const object_type_definition_t* type = &db->object_types[t];
+        for (uint32_t row = 0; row < array_count(type->row_slots); row++)
+        {
+            const object_t* object = &db->objects[type->row_slots[row]];
+            for (uint32_t i = 0; i < type->property_count; i++)
+            {
+                const property_layout_t* prop =
+                    &db->properties[type->first_property + i];
+                if (!holds_blob(prop->def.type))
+                {
+                    continue;
+                }
+
+                const blob_t* blob = get_property_data(db, object, prop);
+                uint64_t offset =
+                    blob->size ? hash_find(&written, (uint64_t)blob->data, 0)
+                               : 0;
+                if (blob->size && !offset)
+                {
+                    writer_align(&w, 8);
+                    offset = w.offset | BLOB_FILE_OFFSET;
+                    writer_write(&w, blob_bytes(db, blob), blob->size);
+                    hash_set(db->alloc, &written, (uint64_t)blob->data, offset);
+                }
+                array_push(db->alloc, blob_offsets, offset);
+            }
+        }
+    }
+
+    uint32_t type_count = array_count(db->object_types) - 1;
+    uint32_t property_count = array_count(db->properties) - 1;
+    file_type_t* file_types =
+        mem_alloc(db->alloc, sizeof(file_type_t) * (type_count + 1));
+    file_property_t* file_properties =
+        mem_alloc(db->alloc, sizeof(file_property_t) * (property_count + 1));
+
+    /* array */ file_override_t* overrides = 0;
+    uint32_t first_blob = 0;
+    for (uint32_t t = 1; t < array_count(db->object_types); t++)
+    {
+        const object_type_definition_t* type = &db->object_types[t];
+        uint32_t row_count = array_count(type->row_slots);
+        uint32_t blob_count = blob_property_count(db, type);
+
+        file_type_t* ft = &file_types[t - 1];
+        *ft = (file_type_t){
+            .flags = type->flags,
+            .property_count = type->property_count,
+            .row_count = row_count,
+            .stride = (type->bytes + 7) & ~7u,
+            .cold_bytes = type->cold_bytes,
+            .version = type->version,
+        };
+
+        if (!(type->flags & OBJECT_TYPE_COLUMNAR))
+        {
+            writer_align(&w, 8);
+            ft->payloads_offset = w.offset;
+            for (uint32_t row = 0; row < row_count; row++)
+            {
+                const object_t* object = &db->objects[type->row_slots[row]];
+                const uint64_t* offsets =
+                    blob_offsets + first_blob + row * blob_count;
+                if (object->page == POOL_PAGE_INSTANCE)
+                {
+                    push_file_overrides(db, object, offsets, &overrides);
+                    continue;
+                }
+
+                uint8_t* payload = writer_reserve(&w, ft->stride);
+                memset(payload, 0, ft->stride);
+                memcpy(payload, object->data, type->bytes);
+                patch_blobs(db, type, payload, false, offsets);
+            }
+        }
+
+        if (type->cold_bytes && row_count)
+        {
+            writer_align(&w, 64);
+            ft->cold_offset = w.offset;
+            for (uint32_t row = 0; row < row_count; row++)
+            {
+                uint8_t* block = writer_reserve(&w, type->cold_bytes);
+                memcpy(block,
+                       (uint8_t*)type->cold + (uint64_t)row * type->cold_bytes,
+                       type->cold_bytes);
+                patch_blobs(db,
+                            type,
+                            block,
+                            true,
+                            blob_offsets + first_blob + row * blob_count);
+            }
+        }
+
+        uint32_t blob_index = 0;
+        for (uint32_t i = 0; i < type->property_count; i++)
+        {
+            const property_layout_t* prop =
+                &db->properties[type->first_property + i];
+            file_property_t* fp =
+                &file_properties[type->first_property + i - 1];
+            *fp = (file_property_t){.def = prop->def};
+
+            if ((type->flags & OBJECT_TYPE_COLUMNAR) && row_count)
+            {
+                writer_align(&w, 64);
+                fp->column_offset = w.offset;
+                if (holds_blob(prop->def.type))
+                {
+                    for (uint32_t row = 0; row < row_count; row++)
+                    {
+                        blob_t* b = writer_reserve(&w, sizeof(blob_t));
+                        b->size = ((blob_t*)prop->column)[row].size;
+                        b->data = (void*)blob_offsets[first_blob
+                                                      + row * blob_count
+                                                      + blob_index];
+                    }
+                }
+                else
+                {
+                    writer_write(&w,
+                                 prop->column,
+                                 (uint64_t)prop->size * row_count);
+                }
+            }
+            blob_index += holds_blob(prop->def.type);
+
+            writer_align(&w, 8);
+            if (prop->row_versions)
+            {
+                fp->row_versions_offset = w.offset;
+                writer_write(&w,
+                             prop->row_versions,
+                             sizeof(uint64_t) * row_count);
+            }
+            if (prop->index)
+            {
+                fp->entry_count = array_count(prop->index->entries);
+                fp->first_free_entry = prop->index->first_free;
+                fp->entries_offset = w.offset;
+                writer_write(&w,
+                             prop->index->entries,
+                             sizeof(index_entry_t) * fp->entry_count);
+
+                fp->sorted_count = array_count(prop->index->sorted);
+                fp->sorted_offset = w.offset;
+                writer_write(&w,
+                             prop->index->sorted,
+                             sizeof(ordered_entry_t) * fp->sorted_count);
+            }
+        }
+
+        writer_align(&w, 8);
+        ft->row_versions_offset = w.offset;
+        writer_write(&w, type->row_versions, sizeof(uint64_t) * row_count);
+        ft->rows_offset = w.offset;
+        writer_write(&w, type->row_slots, sizeof(uint32_t) * row_count);
+
+        first_blob += row_count * blob_count;
+    }
+
+    file_header_t header = {
+        .magic = DATABASE_FILE_MAGIC,
+        .version = DATABASE_FILE_VERSION,
+        .type_count = type_count,
+        .property_count = property_count,
+        .slot_count = array_count(db->objects),
+        .link_count = array_count(db->links),
+        .first_free_link = db->first_free_link,
+        .tail_generation = db->tail_generation,
+        .override_count = array_count(overrides),
+        .db_version = db->version,
+    };
+
+    writer_align(&w, 8);
+    header.types_offset = w.offset;
+    writer_write(&w, file_types, sizeof(file_type_t) * type_count);
+    header.properties_offset = w.offset;
+    writer_write(&w,
+                 file_properties,
+                 sizeof(file_property_t) * property_count);
+
+    // Slots keep their row, the payload address is derived from it on
+    // load.
+    header.slots_offset = w.offset;
+    writer_write(&w, db->objects, sizeof(object_t) * header.slot_count);
+    header.links_offset = w.offset;
+    writer_write(&w, db->links, sizeof(reference_link_t) * header.link_count);
+    header.overrides_offset = w.offset;
+    writer_write(&w,
+                 overrides,
+                 sizeof(file_override_t) * header.override_count);
+
+    // Ids are hashes of the texts, loading only has to intern these.
+    header.strings_offset = w.offset;
+    for (uint32_t i = 0; i < strings.bucket_count; i++)
+    {
+        uint64_t id = strings.keys[i];
+        if (id && id != UINT64_MAX)
+        {
+            const char* text = string_text((string_id_t){id});
+            writer_write(&w, text, strlen(text) + 1);
+        }
+    }
+    header.strings_size = w.offset - header.strings_offset;
+
+    writer_flush(&w);
+    header.file_size = w.offset;
+    if (platform_write_file_at(file, 0, &header, sizeof(header))
+        != sizeof(header))
+    {
+        w.failed = true;
+    }
+    if (!platform_sync_file(file))
+    {
+        w.failed = true;
+    }
+
+    if (blob_offsets)
+    {
+        array_free(db->alloc, blob_offsets);
+    }
+    if (overrides)
+    {
+        array_free(db->alloc, overrides);
+    }
+    hash_free(db->alloc, &written);
+    hash_free(db->alloc, &strings);
+    mem_free(db->alloc, file_types, sizeof(file_type_t) * (type_count + 1));
+    mem_free(db->alloc,
+             file_properties,
+             sizeof(file_property_t) * (property_count + 1));
+    mem_free(db->alloc, w.buffer, w.capacity);
+
+    if (w.failed)
+    {
+        log_error("Could not save database to '%s'", path);
+    }
+    return w.failed ? 0 : header.file_size;
+}
+
+static uint64_t write_snapshot(database_o* db, const char* path)
+{
+    platform_file_o* file = platform_create_file(path);
+    if (!file)
+    {
+        return 0;
+    }
+
+    uint64_t size = write_snapshot_to(db, file, path);
+    platform_close_file(file);
+    return size;
+}
+
+static bool save_to_file(database_o* db, const char* path)
+{
+    return write_snapshot(db, path) != 0;
+}
+
+static bool journal_apply(database_o* db,
+                          const journal_record_t* record,
+                          const uint8_t* payload)
+{
+    property_handle_t property = {record->property};
+    switch (record->kind)
+    {
+    case JOURNAL_CREATE:
+        return create_object(db, (object_type_t){record->property}).index
+               == record->id.index;
+    case JOURNAL_DESTROY:
+        destroy_object(db, record->id);
+        return true;
+    case JOURNAL_SET:
+    {
+        property_ref_t ref;
+        if (record->property >= array_count(db->properties)
+            || !resolve_property_mut(db,
+                                     record->id,
+                                     db->properties[record->property].def.type,
+                                     (object_type_t){0},
+                                     property,
+                                     &ref)
+            || record->size != ref.prop->size
+            || !is_valid_value(ref.prop, payload))
+        {
+            return false;
+        }
+        write_property(db, &ref, payload);
+        journal_set(db, record->id, property, payload, record->size);
+        return true;
+    }
+    case JOURNAL_BLOB_SIZE:
+        return reallocate_blob_h(db, record->id, property, record->offset);
+    case JOURNAL_BLOB_WRITE:
+        return set_blob_data_h(db,
+                               record->id,
+                               property,
+                               record->offset,
+                               record->size,
+                               payload);
+    case JOURNAL_SUB_OBJECT:
+        return get_sub_object_h(db, record->id, property).index
+               == record->offset;
+    case JOURNAL_BLOB_SET:
+        if (record->property < array_count(db->properties)
+            && db->properties[record->property].def.type
+                   == PTYPE_REFERENCE_ARRAY)
+        {
+            return record->size % sizeof(object_id_t) == 0
+                   && set_references_h(db,
+                                       record->id,
+                                       property,
+                                       (const object_id_t*)payload,
+                                       record->size / sizeof(object_id_t));
+        }
+        return set_blob_h(db, record->id, property, payload, record->size);
+    case JOURNAL_CREATE_BATCH:
+    {
+        uint32_t count = record->offset;
+        object_id_t* ids = mem_alloc(db->alloc, sizeof(object_id_t) * count);
+        bool same = create_objects(db,
+                                   (object_type_t){record->property},
+                                   count,
+                                   ids)
+                        == count
+                    && !memcmp(ids, payload, sizeof(object_id_t) * count);
+        mem_free(db->alloc, ids, sizeof(object_id_t) * count);
+        return same;
+    }
+    case JOURNAL_DESTROY_BATCH:
+        destroy_objects(db, (const object_id_t*)payload, record->offset);
+        return true;
+    case JOURNAL_CLONE:
+        return clone_object_ex(db, record->id, record->property).index
+               == record->offset;
+    case JOURNAL_INSTANCE:
+        return create_instance(db, record->id).index == record->offset;
+    case JOURNAL_ARRAY_APPEND:
+        if (record->size == sizeof(object_id_t))
+        {
+            object_id_t target;
+            memcpy(&target, payload, sizeof(target));
+            return append_reference_h(db, record->id, property, target);
+        }
+        return append_sub_object_h(db, record->id, property).index
+               == record->offset;
+    case JOURNAL_ARRAY_REMOVE:
+        return remove_array_element_h(db, record->id, property, record->offset);
+    case JOURNAL_STRING:
+        return record->size && !payload[record->size - 1]
+               && string_intern_n((const char*)payload, record->size - 1).hash
+                      == record->offset;
+    case JOURNAL_COMPACT:
+        return compact_slots(db) == record->offset;
+    case JOURNAL_SET_BATCH:
+        set_values_h(db,
+                     property,
+                     (const object_id_t*)payload,
+                     record->offset,
+                     payload + sizeof(object_id_t) * record->offset);
+        return true;
+    }
+    return false;
+}
+
+// Walks the committed batches of a journal, applying them to db when it
+// isn't null. Returns the end of the last complete batch, and the
+// database version it leads to in version.
+static uint64_t journal_walk(database_o* db,
+                             const uint8_t* data,
+                             uint64_t size,
+                             uint64_t* version,
+                             uint32_t* batch_count)
+{
+    uint64_t end = sizeof(journal_header_t);
+    uint64_t at = end;
+    while (size - at >= sizeof(journal_record_t))
+    {
+        const journal_record_t* record = (const journal_record_t*)(data + at);
+        uint64_t padded = (record->size + 7) & ~7ull;
+        if (padded < record->size
+            || padded > size - at - sizeof(journal_record_t))
+        {
+            break;
+        }
+        at += sizeof(journal_record_t) + padded;
+
+        if (record->kind != JOURNAL_COMMIT)
+        {
+            continue;
+        }
+
+        uint64_t batch_end = at - sizeof(journal_record_t);
+        if (record->offset != hash_bytes(data + end, batch_end - end))
+        {
+            break;
+        }
+
+        for (uint64_t r = end; db && r < batch_end;)
+        {
+            const journal_record_t* change =
+                (const journal_record_t*)(data + r);
+            r += sizeof(journal_record_t);
+            if (!journal_apply(db, change, data + r))
+            {
+                log_error("Could not apply journal record %u to object %lx",
+                          change->kind,
+                          change->id.index);
+            }
+            r += (change->size + 7) & ~7ull;
+        }
+        if (db && db->version < record->id.index)
+        {
+            db->version = record->id.index;
+        }
+
+        *version = record->id.index;
+        (*batch_count)++;
+        end = at;
+    }
+
+    return end;
+}
+
+static bool journal_read(mem_allocator_i* alloc,
+                         const char* path,
+                         uint8_t** data,
+                         uint64_t* size)
+{
+    platform_file_o* file = platform_open_file(path);
+    if (!file)
+    {
+        return false;
+    }
+
+    *size = platform_get_file_size(file);
+    *data = mem_alloc(alloc, *size);
+    bool ok = platform_read_file(file, *data, *size) == *size
+              && *size >= sizeof(journal_header_t)
+              && ((journal_header_t*)*data)->magic == JOURNAL_MAGIC
+              && ((journal_header_t*)*data)->version == JOURNAL_VERSION;
+    platform_close_file(file);
+
+    if (!ok)
+    {
+        mem_free(alloc, *data, *size);
+    }
+    return ok;
+}
+
+static uint32_t replay_journal(database_o* db, const char* path)
+{
+    ASSERT(!db->journal); // would record the replayed changes again
+
+    uint8_t* data;
+    uint64_t size;
+    if (!journal_read(db->alloc, path, &data, &size))
+    {
+        return 0;
+    }
+
+    uint32_t batch_count = 0;
+    uint64_t base_version = ((journal_header_t*)data)->base_version;
+    if (base_version == db->version)
+    {
+        uint64_t version = base_version;
+        journal_walk(db, data, size, &version, &batch_count);
+    }
+    else
+    {
+        // left behind by a compaction interrupted after the snapshot was
+        // written, the snapshot already holds its changes.
+        log_info("Ignoring journal '%s' of another snapshot", path);
+    }
+
+    mem_free(db->alloc, data, size);
+    return batch_count;
+}
+
+// Changes recorded by the tx_* functions as journal records, applied by
+// commit_transaction. Recording doesn't touch the database, so that any
+// thread can fill its own transaction. Objects created in a transaction
+// get a pending id, with a generation of 0 and the index of the creation
+// as slot, replaced by the real id on commit.
+struct database_transaction_o
+{
+    database_o* db;
+    /* array */ uint8_t* records;
+    uint32_t created;
+};
+
+// Order in which commit_transaction applies the records, grouping the
+// writes by property and by slot.
+typedef struct transaction_entry_t
+{
+    uint32_t destroy; // destructions come last
+    uint32_t property;
+    uint32_t slot;
+    uint32_t sequence; // keeps the order of writes to the same property
+    const journal_record_t* record;
+} transaction_entry_t;
+
+static bool is_pending(object_id_t id)
+{
+    return id.index && !id.info.generation;
+}
+
+static object_id_t
+resolve_pending(object_id_t id, const object_id_t* created, uint32_t count)
+{
+    if (!is_pending(id))
+    {
+        return id;
+    }
+    return id.info.slot < count ? created[id.info.slot] : (object_id_t){0};
+}
+
+static database_transaction_o* begin_transaction(database_o* db)
+{
+    database_transaction_o* tx = mem_alloc(db->alloc, sizeof(*tx));
+    *tx = (database_transaction_o){.db = db};
+    return tx;
+}
+
+static void tx_append(database_transaction_o* tx,
+                      journal_record_t record,
+                      const void* payload)
+{
+    ASSERT(payload || !record.size);
+    uint8_t* dst = record_reserve(tx->db->alloc, &tx->records, record);
+    if (payload)
+    {
+        memcpy(dst, payload, record.size);
+    }
+}
+
+static object_id_t tx_create_object(database_transaction_o* tx,
+                                    object_type_t type)
+{
+    object_id_t id = {.info = {.slot = tx->created++, .type = type}};
+    tx_append(tx,
+              (journal_record_t){
+                  .kind = JOURNAL_CREATE,
+                  .property = type.index,
+                  .id = id,
+              },
+              0);
+    return id;
+}
+
+static void tx_destroy_object(database_transaction_o* tx, object_id_t id)
+{
+    tx_append(tx, (journal_record_t){.kind = JOURNAL_DESTROY, .id = id}, 0);
+}
+
+static void tx_set_h(database_transaction_o* tx,
+                     object_id_t id,
+                     property_handle_t property,
+                     const void* value,
+                     uint32_t size)
+{
+    tx_append(tx,
+              (journal_record_t){
+                  .kind = JOURNAL_SET,
+                  .property = property.index,
+                  .id = id,
+                  .size = size,
+              },
+              value);
+}
+
+static void tx_reallocate_blob_h(database_transaction_o* tx,
+                                 object_id_t id,
+                                 property_handle_t property,
+                                 uint64_t size)
+{
+    tx_append(tx,
+              (journal_record_t){
+                  .kind = JOURNAL_BLOB_SIZE,
+                  .property = property.index,
+                  .id = id,
+                  .offset = size,
+              },
+              0);
+}
+
+static void tx_set_blob_data_h(database_transaction_o* tx,
+                               object_id_t id,
+                               property_handle_t property,
+                               uint64_t offset,
+                               uint64_t size,
+                               const void* data)
+{
+    tx_append(tx,
+              (journal_record_t){
+                  .kind = JOURNAL_BLOB_WRITE,
+                  .property = property.index,
+                  .id = id,
+                  .offset = offset,
+                  .size = size,
+              },
+              data);
+}
+
+static void tx_set_blob_h(database_transaction_o* tx,
+                          object_id_t id,
+                          property_handle_t property,
+                          const void* data,
+                          uint64_t size)
+{
+    tx_append(tx,
+              (journal_record_t){
+                  .kind = JOURNAL_BLOB_SET,
+                  .property = property.index,
+                  .id = id,
+                  .size = size,
+              },
+              data);
+}
+
+static void abort_transaction(database_transaction_o* tx)
+{
+    database_o* db = tx->db;
+    if (tx->records)
+    {
+        array_free(db->alloc, tx->records);
+    }
+    mem_free(db->alloc, tx, sizeof(*tx));
+}
+
+static int compare_transaction_entries(const void* a, const void* b)
+{
+    const transaction_entry_t* x = a;
+    const transaction_entry_t* y = b;
+    uint32_t keys_x[] = {x->destroy, x->property, x->slot, x->sequence};
+    uint32_t keys_y[] = {y->destroy, y->property, y->slot, y->sequence};
+    for (uint32_t i = 0; i < STATIC_ARRAY_COUNT(keys_x); i++)
+    {
+        if (keys_x[i] != keys_y[i])
+        {
+            return keys_x[i] < keys_y[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+// Whether id is alive in the database, or created by the transaction,
+// with the type of its creation in created_types.
+static bool tx_id_ok(database_transaction_o* tx,
+                     const object_type_t* created_types,
+                     object_id_t id)
+{
+    if (is_pending(id))
+    {
+        return id.info.slot < tx->created
+               && created_types[id.info.slot].index == id.info.type.index;
+    }
+    return is_alive(tx->db, id);
+}
+
+static bool tx_target_ok(database_transaction_o* tx,
+                         const object_type_t* created_types,
+                         const property_layout_t* prop,
+                         object_id_t target)
+{
+    return tx_id_ok(tx, created_types, target)
+           && (!prop->def.object_type.index
+               || target.info.type.index == prop->def.object_type.index);
+}
+
+// Checks every record of tx against the database as the records before
+// it leave it, so that commit_transaction can apply them all without
+// failing. Destructions come last and undo nothing the others need.
+static bool transaction_ok(database_transaction_o* tx,
+                           const object_type_t* created_types)
+{
+    database_o* db = tx->db;
+    hash_t sizes = {0}; // blob property_slot_key -> size written + 1
+    bool ok = true;
+    for (uint64_t at = 0; ok && at < array_count(tx->records);)
+    {
+        const journal_record_t* record =
+            (const journal_record_t*)(tx->records + at);
+        const uint8_t* payload = tx->records + at + sizeof(*record);
+        at += sizeof(*record) + ((record->size + 7) & ~7ull);
+
+        if (record->kind == JOURNAL_CREATE)
+        {
+            continue; // created_types holds the valid ones
+        }
+        ok = tx_id_ok(tx, created_types, record->id);
+        if (!ok || record->kind == JOURNAL_DESTROY)
+        {
+            continue;
+        }
+
+        const property_layout_t* prop =
+            get_property(db,
+                         record->id.info.type,
+                         (property_handle_t){record->property});
+        uint16_t type = prop ? prop->def.type : PTYPE_NONE;
+        if (!prop)
+        {
+            ok = false;
+        }
+        else if (record->kind == JOURNAL_SET)
+        {
+            object_id_t target = {0};
+            if (type == PTYPE_REFERENCE && record->size == sizeof(target))
+            {
+                memcpy(&target, payload, sizeof(target));
+            }
+            ok = !holds_blob(type) && type != PTYPE_OBJECT
+                 && record->size == prop->size && is_valid_value(prop, payload)
+                 && (!target.index
+                     || tx_target_ok(tx, created_types, prop, target));
+        }
+        else if (type == PTYPE_REFERENCE_ARRAY
+                 && record->kind == JOURNAL_BLOB_SET)
+        {
+            const object_id_t* ids = (const object_id_t*)payload;
+            uint64_t count = record->size / sizeof(object_id_t);
+            ok = record->size % sizeof(object_id_t) == 0;
+            for (uint64_t i = 0; ok && i < count; i++)
+            {
+                ok = tx_target_ok(tx, created_types, prop, ids[i]);
+            }
+        }
+        else if (type != PTYPE_BLOB)
+        {
+            ok = false;
+        }
+        else
+        {
+            // size of the blob once the records before this one applied
+            uint64_t key = property_slot_key(record->id, record->property)
+                           | (is_pending(record->id) ? 1ull << 63 : 0);
+            uint64_t size = hash_find(&sizes, key, 0);
+            if (size)
+            {
+                size--;
+            }
+            else if (!is_pending(record->id))
+            {
+                const object_t* object = get_object(db, record->id);
+                size = ((const blob_t*)get_property_data(db, object, prop))
+                           ->size;
+            }
+
+            if (record->kind == JOURNAL_BLOB_SIZE)
+            {
+                size = record->offset;
+            }
+            else if (record->kind == JOURNAL_BLOB_SET)
+            {
+                size = record->size;
+            }
+            else
+            {
+                ok = record->kind == JOURNAL_BLOB_WRITE
+                     && record->offset <= size
+                     && record->size <= size - record->offset;
+            }
+            hash_set(db->alloc, &sizes, key, size + 1);
+        }
+    }
+    hash_free(db->alloc, &sizes);
+    return ok;
+}
+
+static bool commit_transaction(database_transaction_o* tx,
+                               object_id_t* created_ids)
+{
+    database_o* db = tx->db;
+
+    object_id_t* created = 0;
+    object_type_t* created_types = 0;
+    if (tx->created)
+    {
+        created = mem_alloc(db->alloc, sizeof(object_id_t) * tx->created);
+        created_types =
+            mem_alloc(db->alloc, sizeof(object_type_t) * tx->created);
+    }
+
+    // Nothing is applied unless every record can be.
+    bool ok = true;
+    for (uint64_t at = 0; ok && at < array_count(tx->records);)
+    {
+        const journal_record_t* record =
+            (const journal_record_t*)(tx->records + at);
+        at += sizeof(*record) + ((record->size + 7) & ~7ull);
+        if (record->kind == JOURNAL_CREATE)
+        {
+            created_types[record->id.info.slot] = record->id.info.type;
+            ok = record->id.info.type.index
+                 && record->id.info.type.index < array_count(db->object_types);
+        }
+    }
+    ok = ok && transaction_ok(tx, created_types);
+    if (!ok)
+    {
+        log_error("Could not commit a transaction with an invalid change");
+    }
+
+    // creations first, so that the other records can use the real ids
+    /* array */ transaction_entry_t* entries = 0;
+    for (uint64_t at = 0; ok && at < array_count(tx->records);)
+    {
+        journal_record_t* record = (journal_record_t*)(tx->records + at);
+        uint8_t* payload = tx->records + at + sizeof(*record);
+        at += sizeof(*record) + ((record->size + 7) & ~7ull);
+
+        if (record->kind == JOURNAL_CREATE)
+        {
+            created[record->id.info.slot] =
+                create_object(db, record->id.info.type);
+            continue;
+        }
+
+        record->id = resolve_pending(record->id, created, tx->created);
+        uint16_t type = record->kind == JOURNAL_DESTROY
+                            ? PTYPE_NONE
+                            : db->properties[record->property].def.type;
+        if ((record->kind == JOURNAL_SET && type == PTYPE_REFERENCE)
+            || (record->kind == JOURNAL_BLOB_SET
+                && type == PTYPE_REFERENCE_ARRAY))
+        {
+            object_id_t* ids = (object_id_t*)payload;
+            for (uint64_t i = 0; i < record->size / sizeof(object_id_t); i++)
+            {
+                ids[i] = resolve_pending(ids[i], created, tx->created);
+            }
+        }
+
+        transaction_entry_t entry = {
+            .destroy = record->kind == JOURNAL_DESTROY,
+            .property = record->property,
+            .slot = record->id.info.slot,
+            .sequence = array_count(entries),
+            .record = record,
+        };
+        array_push(db->alloc, entries, entry);
+    }
+
+    if (entries)
+    {
+        qsort(entries,
+              array_count(entries),
+              sizeof(*entries),
+              compare_transaction_entries);
+    }
+    for (uint32_t i = 0; i < array_count(entries); i++)
+    {
+        // transaction_ok lets no record through that could fail here
+        const journal_record_t* record = entries[i].record;
+        if (!journal_apply(db, record, (const uint8_t*)(record + 1)))
+        {
+            log_error("Could not apply transaction record %u to object %lx",
+                      record->kind,
+                      record->id.index);
+        }
+    }
+
+    if (created)
+    {
+        if (created_ids && ok)
+        {
+            memcpy(created_ids, created, sizeof(object_id_t) * tx->created);
+        }
+        mem_free(db->alloc, created, sizeof(object_id_t) * tx->created);
+        mem_free(db->alloc,
+                 created_types,
+                 sizeof(object_type_t) * tx->created);
+    }
+    if (entries)
+    {
+        array_free(db->alloc, entries);
+    }
+    abort_transaction(tx);
+    return ok;
+}
+
+static bool compact_journal(database_o* db)
+{
+    database_journal_t* journal = db->journal;
+    if (!journal || !journal->file)
+    {
+        return false;
+    }
+
+    // the pending records are part of the snapshot
+    if (journal->pending)
+    {
+        array_header(journal->pending)->count = 0;
+    }
+
+    char tmp_path[sizeof(journal->snapshot_path) + 4];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", journal->snapshot_path);
+
+    uint64_t snapshot_size = write_snapshot(db, tmp_path);
+    if (!snapshot_size
+        || !platform_rename_file(tmp_path, journal->snapshot_path))
+    {
+        return false;
+    }
+
+    platform_close_file(journal->file);
+    journal->file = platform_create_file(journal->journal_path);
+    if (!journal->file)
+    {
+        return false;
+    }
+
+    journal_header_t header = {
+        .magic = JOURNAL_MAGIC,
+        .version = JOURNAL_VERSION,
+        .base_version = db->version,
+    };
+    if (platform_write_file_at(journal->file, 0, &header, sizeof(header))
+            != sizeof(header)
+        || !platform_sync_file(journal->file))
+    {
+        log_error("Could not write journal '%s'", journal->journal_path);
+        return false;
+    }
+
+    journal->file_size = sizeof(header);
+    journal->compact_size = snapshot_size > JOURNAL_MIN_COMPACT_SIZE
+                                ? snapshot_size
+                                : JOURNAL_MIN_COMPACT_SIZE;
+    return true;
+}
+
+static bool replica_append(database_o* db,
+                           const uint8_t* batch,
+                           uint64_t size);
+
+static bool commit_journal(database_o* db)
+{
+    database_journal_t* journal = db->journal;
+    if (!journal)
+    {
+        return false;
+    }
+    if (!array_count(journal->pending))
+    {
+        return true;
+    }
+
+    uint64_t checksum =
+        hash_bytes(journal->pending, array_count(journal->pending));
+    journal_append(db,
+                   (journal_record_t){
+                       .kind = JOURNAL_COMMIT,
+                       .id.index = db->version,
+                       .offset = checksum,
+                   },
+                   0);
+
+    uint64_t size = array_count(journal->pending);
+    bool ok = !db->replica || replica_append(db, journal->pending, size);
+    if (!journal->file)
+    {
+        array_header(journal->pending)->count = 0;
+        if (!db->replica)
+        {
+            close_journal(db); // the replica was dropped
+        }
+        return ok;
+    }
+
+    if (platform_write_file_at(journal->file,
+                               journal->file_size,
+                               journal->pending,
+                               size)
+            != size
+        || !platform_sync_file(journal->file))
+    {
+        log_error("Could not write journal '%s'", journal->journal_path);
+        return false;
+    }
+    journal->file_size += size;
+    array_header(journal->pending)->count = 0;
+
+    if (journal->file_size > journal->compact_size)
+    {
+        return compact_journal(db) && ok;
+    }
+    return ok;
+}
+
+static void close_journal(database_o* db)
+{
+    database_journal_t* journal = db->journal;
+    if (!journal)
+    {
+        return;
+    }
+
+    if (journal->file)
+    {
+        commit_journal(db);
+        platform_close_file(journal->file);
+        journal->file = 0;
+    }
+    if (db->replica)
+    {
+        return; // still recording changes for the replica
+    }
+    if (journal->pending)
+    {
+        array_free(db->alloc, journal->pending);
+    }
+    mem_free(db->alloc, journal, sizeof(*journal));
+    db->journal = 0;
+}
+
+static bool open_journal(database_o* db,
+                         const char* snapshot_path,
+                         const char* journal_path)
+{
+    ASSERT(!db->journal || !db->journal->file);
+    if (strlen(snapshot_path) >= sizeof(db->journal->snapshot_path)
+        || strlen(journal_path) >= sizeof(db->journal->journal_path))
+    {
+        log_error("Journal path too long");
+        return false;
+    }
+
+    // Already recording for a published replica : hand it the changes
+    // made so far, the snapshot written below holds them.
+    database_journal_t* journal = db->journal;
+    if (journal)
+    {
+        commit_journal(db);
+    }
+    else
+    {
+        journal = mem_alloc(db->alloc, sizeof(*journal));
+        *journal = (database_journal_t){0};
+    }
+    strcpy(journal->snapshot_path, snapshot_path);
+    strcpy(journal->journal_path, journal_path);
+
+    journal->file = platform_open_file_rw(journal_path);
+    if (!journal->file)
+    {
+        if (!db->journal)
+        {
+            mem_free(db->alloc, journal, sizeof(*journal));
+        }
+        return false;
+    }
+    db->journal = journal;
+
+    // Keep appending to the journal when db is its snapshot with the
+    // committed batches replayed, otherwise start over from a snapshot
+    // of db.
+    uint8_t* data;
+    uint64_t size;
+    uint64_t snapshot_size = 0;
+    bool append = false;
+    if (journal_read(db->alloc, journal_path, &data, &size))
+    {
+        uint64_t version = ((journal_header_t*)data)->base_version;
+        uint32_t batch_count = 0;
+        journal->file_size =
+            journal_walk(0, data, size, &version, &batch_count);
+        append = version == db->version;
+        mem_free(db->alloc, data, size);
+
+        platform_file_o* snapshot = platform_open_file(snapshot_path);
+        if (snapshot)
+        {
+            snapshot_size = platform_get_file_size(snapshot);
+            platform_close_file(snapshot);
+        }
+        append = append && snapshot_size;
+    }
+
+    if (!append)
+    {
+        if (!compact_journal(db))
+        {
+            close_journal(db);
+            return false;
+        }
+    }
+    else
+    {
+        journal->compact_size = snapshot_size > JOURNAL_MIN_COMPACT_SIZE
+                                    ? snapshot_size
+                                    : JOURNAL_MIN_COMPACT_SIZE;
+    }
+    return true;
+}
+
+static void* array_from_file(mem_allocator_i* alloc,
+                             const uint8_t* data,
+                             uint32_t element_size,
+                             uint32_t count)
+{
+    if (!count)
+    {
+        return 0;
+    }
+
+    void* array = array_reserve_(alloc, 0, element_size, count);
+    memcpy(array, data, (uint64_t)element_size * count);
+    array_header(array)->count = count;
+    return array;
+}
+
+static bool file_range_ok(const file_header_t* header,
+                          uint64_t offset,
+                          uint64_t size)
+{
+    return offset <= header->file_size && size <= header->file_size - offset;
+}
+
+// Tables of the file are read in place, and must be aligned for that.
+static bool file_table_ok(const file_header_t* header,
+                          uint64_t offset,
+                          uint64_t size)
+{
+    return !(offset & 7) && file_range_ok(header, offset, size);
+}
+
+static bool index_entries_ok(const file_header_t* header,
+                             const uint8_t* base,
+                             const file_property_t* fp)
+{
+    if (!file_table_ok(header,
+                       fp->entries_offset,
+                       sizeof(index_entry_t) * fp->entry_count)
+        || !file_table_ok(header,
+                          fp->sorted_offset,
+                          sizeof(ordered_entry_t) * fp->sorted_count)
+        || fp->first_free_entry > fp->entry_count)
+    {
+        return false;
+    }
+
+    const index_entry_t* entries =
+        (const index_entry_t*)(base + fp->entries_offset);
+    for (uint32_t e = 0; e < fp->entry_count; e++)
+    {
+        if (entries[e].next > fp->entry_count
+            || entries[e].prev > fp->entry_count)
+        {
+            return false;
+        }
+        if (entries[e].id.index
+            && (!entries[e].id.info.slot
+                || entries[e].id.info.slot >= header->slot_count))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Prototypes of the instances of a file image must be alive objects of
+// the same type, without cycles. state is zeroed, by slot.
+static bool prototypes_ok(const file_header_t* header,
+                          const object_t* slots,
+                          uint8_t* state)
+{
+    enum
+    {
+        UNSEEN,
+        VISITING,
+        DONE,
+    };
+    for (uint32_t slot = 1; slot < header->slot_count; slot++)
+    {
+        // Walks up the chain, then marks it checked.
+        for (uint32_t pass = 0; pass < 2; pass++)
+        {
+            uint32_t at = slot;
+            while (slots[at].id.info.type.index
+                   && slots[at].page == POOL_PAGE_INSTANCE
+                   && state[at] != DONE)
+            {
+                object_id_t prototype = slots[at].prototype;
+                if (!pass && state[at] == VISITING)
+                {
+                    return false; // cycle
+                }
+                if (!prototype.info.slot
+                    || prototype.info.slot >= header->slot_count
+                    || slots[prototype.info.slot].id.index != prototype.index
+                    || prototype.info.type.index
+                           != slots[at].id.info.type.index)
+                {
+                    return false;
+                }
+                state[at] = pass ? DONE : VISITING;
+                at = prototype.info.slot;
+            }
+        }
+    }
+    return true;
+}
+
+// Checks the tables of a file image against each other and the size of
+// the file, whose header has already been checked, so that
+// building a database on it reads nothing out of bounds.
+static bool image_ok(mem_allocator_i* alloc,
+                     const file_header_t* header,
+                     const uint8_t* base)
+{
+    const file_type_t* file_types =
+        (const file_type_t*)(base + header->types_offset);
+    const file_property_t* file_properties =
+        (const file_property_t*)(base + header->properties_offset);
+    const object_t* slots = (const object_t*)(base + header->slots_offset);
+
+    if (header->type_count > UINT16_MAX)
+    {
+        return false;
+    }
+
+    uint32_t first_property = 0;
+    for (uint32_t t = 0; t < header->type_count; t++)
+    {
+        const file_type_t* ft = &file_types[t];
+        bool columnar = ft->flags & OBJECT_TYPE_COLUMNAR;
+        if (ft->property_count > header->property_count - first_property
+            || !file_table_ok(header,
+                              ft->rows_offset,
+                              sizeof(uint32_t) * ft->row_count))
+        {
+            return false;
+        }
+
+        // Rows and slots must point at each other.
+        const uint32_t* row_slots = (const uint32_t*)(base + ft->rows_offset);
+        uint32_t payload_count = 0;
+        for (uint32_t row = 0; row < ft->row_count; row++)
+        {
+            uint32_t slot = row_slots[row];
+            if (!slot || slot >= header->slot_count
+                || slots[slot].id.info.type.index != t + 1
+                || slots[slot].row != row
+                || (columnar && slots[slot].page == POOL_PAGE_INSTANCE))
+            {
+                return false;
+            }
+            payload_count += slots[slot].page != POOL_PAGE_INSTANCE;
+        }
+
+        uint64_t hot_bytes = 0;
+        uint64_t cold_bytes = 0;
+        for (uint32_t i = 0; i < ft->property_count; i++)
+        {
+            const file_property_t* fp = &file_properties[first_property + i];
+            if (fp->def.type <= PTYPE_NONE || fp->def.type > PTYPE_STRING)
+            {
+                return false;
+            }
+
+            uint64_t size = property_size(&fp->def);
+            if (!columnar && (fp->def.flags & PROPERTY_COLD))
+            {
+                cold_bytes += size;
+            }
+            else
+            {
+                hot_bytes += size;
+            }
+
+            if ((columnar && ft->row_count
+                 && (!fp->column_offset
+                     || !file_table_ok(header,
+                                       fp->column_offset,
+                                       size * ft->row_count)))
+                || !file_table_ok(header,
+                                  fp->row_versions_offset,
+                                  sizeof(uint64_t) * ft->row_count))
+            {
+                return false;
+            }
+
+            if (fp->def.flags & (PROPERTY_INDEX_HASH | PROPERTY_INDEX_ORDERED)
+                && (!property_indexable(&fp->def)
+                    || !index_entries_ok(header, base, fp)))
+            {
+                return false;
+            }
+        }
+        first_property += ft->property_count;
+
+        if (ft->cold_bytes != ((cold_bytes + 7) & ~7ull)
+            || (!columnar
+                && (ft->stride < hot_bytes || (ft->stride & 7)
+                    || !file_table_ok(header,
+                                      ft->payloads_offset,
+                                      (uint64_t)ft->stride * payload_count)))
+            || (ft->cold_offset
+                && !file_table_ok(header,
+                                  ft->cold_offset,
+                                  (uint64_t)ft->cold_bytes * ft->row_count))
+            || (ft->cold_bytes && ft->row_count && !ft->cold_offset)
+            || !file_table_ok(header,
+                              ft->row_versions_offset,
+                              sizeof(uint64_t) * ft->row_count))
+        {
+            return false;
+        }
+    }
+    if (first_property != header->property_count)
+    {
+        return false;
+    }
+
+    for (uint32_t slot = 1; slot < header->slot_count; slot++)
+    {
+        const object_t* object = &slots[slot];
+        uint16_t type = object->id.info.type.index;
+        if (type
+            && (type > header->type_count
+                || object->id.info.slot != slot
+                || object->row >= file_types[type - 1].row_count))
+        {
+            return false;
+        }
+    }
+
+    const reference_link_t* links =
+        (const reference_link_t*)(base + header->links_offset);
+    if (header->first_free_link > header->link_count)
+    {
+        return false;
+    }
+    for (uint32_t i = 0; i < header->link_count; i++)
+    {
+        const reference_link_t* l = &links[i];
+        if (l->next > header->link_count || l->prev > header->link_count)
+        {
+            return false;
+        }
+        if (!l->source.index)
+        {
+            continue; // free link
+        }
+
+        uint32_t type = l->property && l->property <= header->property_count
+                            ? file_properties[l->property - 1].def.type
+                            : PTYPE_NONE;
+        if ((type != PTYPE_REFERENCE && type != PTYPE_REFERENCE_ARRAY)
+            || !l->target_slot || l->target_slot >= header->slot_count
+            || !l->source.info.slot || l->source.info.slot >= header->slot_count
+            || l->element >= header->link_count)
+        {
+            return false;
+        }
+    }
+
+    // Overrides must be of the hot properties of the type of an instance.
+    const file_override_t* overrides =
+        (const file_override_t*)(base + header->overrides_offset);
+    if (!file_table_ok(header,
+                       header->overrides_offset,
+                       sizeof(file_override_t) * header->override_count))
+    {
+        return false;
+    }
+    uint32_t* first_properties =
+        mem_alloc(alloc, sizeof(uint32_t) * (header->type_count + 1));
+    first_properties[0] = 1;
+    for (uint32_t t = 0; t < header->type_count; t++)
+    {
+        first_properties[t + 1] =
+            first_properties[t] + file_types[t].property_count;
+    }
+    bool ok = true;
+    for (uint32_t i = 0; ok && i < header->override_count; i++)
+    {
+        const file_override_t* o = &overrides[i];
+        const object_t* object = &slots[o->slot];
+        uint16_t type = o->slot && o->slot < header->slot_count
+                            ? object->id.info.type.index
+                            : 0;
+        ok = type && object->page == POOL_PAGE_INSTANCE
+             && o->property >= first_properties[type - 1]
+             && o->property < first_properties[type]
+             && !(file_properties[o->property - 1].def.flags & PROPERTY_COLD);
+
+        // Cells are loaded before loaded_blobs_ok, their blobs must not
+        // be taken for allocated ones.
+        uint64_t data = (uint64_t)o->value.blob.data;
+        if (ok && holds_blob(file_properties[o->property - 1].def.type))
+        {
+            ok = o->value.blob.size
+                     ? (data & BLOB_FILE_OFFSET)
+                           && file_range_ok(header,
+                                            data & ~BLOB_FILE_OFFSET,
+                                            o->value.blob.size)
+                     : !data;
+        }
+    }
+    mem_free(alloc,
+             first_properties,
+             sizeof(uint32_t) * (header->type_count + 1));
+
+    uint8_t* state = mem_alloc(alloc, header->slot_count);
+    memset(state, 0, header->slot_count);
+    ok = ok && prototypes_ok(header, slots, state);
+    mem_free(alloc, state, header->slot_count);
+    return ok;
+}
+
+// Blobs of a freshly loaded database must all lie in the file.
+static bool loaded_blobs_ok(database_o* db)
+{
+    for (uint32_t t = 1; t < array_count(db->object_types); t++)
+    {
+        const object_type_definition_t* type = &db->object_types[t];
+        for (uint32_t i = 0; i < type->property_count; i++)
+        {
+            const property_layout_t* prop =
+                &db->properties[type->first_property + i];
+            if (!holds_blob(prop->def.type))
+            {
+                continue;
+            }
+
+            for (uint32_t row = 0; row < array_count(type->row_slots); row++)
+            {
+                const object_t* object = &db->objects[type->row_slots[row]];
+                const blob_t* blob = get_property_data(db, object, prop);
+                uint64_t data = (uint64_t)blob->data;
+                if (blob->size
+                    && (!(data & BLOB_FILE_OFFSET)
+                        || (data & ~BLOB_FILE_OFFSET) > db->file_size
+                        || blob->size
+                               > db->file_size - (data & ~BLOB_FILE_OFFSET)))
+                {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// Builds a database on the file image at base, that it takes ownership
+// of : mapped images are unmapped on destroy, others freed.
+static database_o* load_image(mem_allocator_i* alloc,
+                              uint8_t* base,
+                              uint64_t size,
+                              bool mapped,
+                              const char* path)
+{
+    const file_header_t* header = (const file_header_t*)base;
+    if (header->magic != DATABASE_FILE_MAGIC
+        || header->version != DATABASE_FILE_VERSION
+        || header->file_size != size
+        || !file_table_ok(header,
+                          header->types_offset,
+                          sizeof(file_type_t) * header->type_count)
+        || !file_table_ok(header,
+                          header->properties_offset,
+                          sizeof(file_property_t) * header->property_count)
+        || !file_table_ok(header,
+                          header->slots_offset,
+                          sizeof(object_t) * header->slot_count)
+        || !file_table_ok(header,
+                          header->links_offset,
+                          sizeof(reference_link_t) * header->link_count)
+        || !file_range_ok(header, header->strings_offset, header->strings_size)
+        || (header->strings_size
+            && base[header->strings_offset + header->strings_size - 1])
+        || !header->slot_count
+        || !image_ok(alloc, header, base))
+    {
+        log_error("'%s' is not a valid database file", path);
+        if (mapped)
+        {
+            platform_unmap_file(base, size);
+        }
+        else
+        {
+            mem_free(alloc, base, size);
+        }
+        return 0;
+    }
+
+    const char* strings = (const char*)base + header->strings_offset;
+    for (uint64_t at = 0; at < header->strings_size;)
+    {
+        uint64_t size = strlen(strings + at);
+        string_intern_n(strings + at, size);
+        at += size + 1;
+    }
+
+    database_o* db = create(alloc);
+    db->file_base = base;
+    db->file_size = size;
+    db->file_mapped = mapped;
+    db->version = header->db_version;
+
+    const file_type_t* file_types =
+        (const file_type_t*)(base + header->types_offset);
+    const file_property_t* file_properties =
+        (const file_property_t*)(base + header->properties_offset);
+
+    /* array */ property_definition_t* defs = 0;
+    uint32_t first_property = 0;
+    for (uint32_t t = 0; t < header->type_count; t++)
+    {
+        const file_type_t* ft = &file_types[t];
+
+        array_header_t* defs_header = defs ? array_header(defs) : 0;
+        if (defs_header)
+        {
+            defs_header->count = 0;
+        }
+        for (uint32_t i = 0; i < ft->property_count; i++)
+        {
+            array_push(alloc, defs, file_properties[first_property + i].def);
+        }
+
+        object_type_t type_handle =
+            add_object_type_ex(db, ft->property_count, defs, ft->flags);
+        object_type_definition_t* type =
+            &db->object_types[type_handle.index];
+
+        type->version = ft->version;
+        type->row_slots = array_from_file(alloc,
+                                          base + ft->rows_offset,
+                                          sizeof(uint32_t),
+                                          ft->row_count);
+        type->row_versions = array_from_file(alloc,
+                                             base + ft->row_versions_offset,
+                                             sizeof(uint64_t),
+                                             ft->row_count);
+        if (ft->flags & OBJECT_TYPE_COLUMNAR)
+        {
+            type->row_capacity = ft->row_count;
+        }
+        if (ft->cold_offset)
+        {
+            type->cold = base + ft->cold_offset;
+            type->row_capacity = ft->row_count;
+        }
+
+        for (uint32_t i = 0; i < ft->property_count; i++)
+        {
+            const file_property_t* fp = &file_properties[first_property + i];
+            property_layout_t* prop = &db->properties[type->first_property + i];
+
+            if (fp->column_offset)
+            {
+                prop->column = base + fp->column_offset;
+            }
+            if (fp->row_versions_offset)
+            {
+                prop->row_versions =
+                    array_from_file(alloc,
+                                    base + fp->row_versions_offset,
+                                    sizeof(uint64_t),
+                                    ft->row_count);
+            }
+
+            property_index_t* index = prop->index;
+            if (!index)
+            {
+                continue;
+            }
+
+            index->first_free = fp->first_free_entry;
+            index->entries = array_from_file(alloc,
+                                             base + fp->entries_offset,
+                                             sizeof(index_entry_t),
+                                             fp->entry_count);
+            index->sorted = array_from_file(alloc,
+                                            base + fp->sorted_offset,
+                                            sizeof(ordered_entry_t),
+                                            fp->sorted_count);
+            for (uint32_t e = 0; e < fp->entry_count; e++)
+            {
+                const index_entry_t* entry = &index->entries[e];
+                if (!entry->id.index)
+                {
+                    continue; // free entry
+                }
+                index->live_count++;
+                hash_set(alloc,
+                         &index->entry_of_slot,
+                         entry->id.info.slot,
+                         e + 1);
+                if (!entry->prev)
+                {
+                    hash_set(alloc,
+                             &index->chains,
+                             chain_key(entry->key),
+                             e + 1);
+                }
+            }
+        }
+
+        first_property += ft->property_count;
+    }
+    if (defs)
+    {
+        array_free(alloc, defs);
+    }
+
+    array_free(db->page_alloc, db->objects);
+    db->objects = array_from_file(db->page_alloc,
+                                  base + header->slots_offset,
+                                  sizeof(object_t),
+                                  header->slot_count);
+    db->tail_generation = header->tail_generation;
+    for (uint32_t slot = 1; slot < header->slot_count; slot++)
+    {
+        if (!db->objects[slot].id.info.type.index)
+        {
+            mark_slot_free(db, slot);
+        }
+    }
+
+    // Payloads are stored in row order, without the instances, which
+    // keep their prototype.
+    for (uint32_t t = 0; t < header->type_count; t++)
+    {
+        const file_type_t* ft = &file_types[t];
+        const uint32_t* row_slots = (const uint32_t*)(base + ft->rows_offset);
+        uint64_t payload = 0;
+        for (uint32_t row = 0; row < ft->row_count; row++)
+        {
+            object_t* object = &db->objects[row_slots[row]];
+            if (object->page == POOL_PAGE_INSTANCE)
+            {
+                db->instance_count++;
+                add_instance(db, object);
+                continue;
+            }
+
+            object->data = (ft->flags & OBJECT_TYPE_COLUMNAR)
+                               ? 0
+                               : base + ft->payloads_offset
+                                     + payload++ * ft->stride;
+            object->page = POOL_PAGE_FILE;
+        }
+    }
+
+    db->first_free_link = header->first_free_link;
+    db->links = array_from_file(alloc,
+                                base + header->links_offset,
+                                sizeof(reference_link_t),
+                                header->link_count);
+    index_links(db);
+
+    const file_override_t* overrides =
+        (const file_override_t*)(base + header->overrides_offset);
+    for (uint32_t i = 0; i < header->override_count; i++)
+    {
+        const object_t* object = &db->objects[overrides[i].slot];
+        const property_layout_t* prop =
+            &db->properties[overrides[i].property];
+        if (find_override(db, object, prop))
+        {
+            log_error("'%s' is not a valid database file", path);
+            destroy(db);
+            return 0;
+        }
+        add_override(db, object, prop, overrides[i].value.bytes);
+    }
+
+    if (!loaded_blobs_ok(db))
+    {
+        log_error("'%s' is not a valid database file", path);
+        destroy(db);
+        return 0;
+    }
+    return db;
+}
+
+static database_o*
+load_from_file(mem_allocator_i* alloc, const char* path, uint32_t flags)
+{
+    platform_file_o* file = platform_open_file(path);
+    if (!file)
+    {
+        return 0;
+    }
+
+    uint64_t size = platform_get_file_size(file);
+    if (size < sizeof(file_header_t))
+    {
+        log_error("'%s' is not a database file", path);
+        platform_close_file(file);
+        return 0;
+    }
+
+    uint8_t* base;
+    bool mapped = !(flags & DATABASE_LOAD_READ);
+    if (mapped)
+    {
+        base = platform_map_file(file, size);
+    }
+    else
+    {
+        base = mem_alloc(alloc, size);
+        if (platform_read_file(file, base, size) != size)
+        {
+            mem_free(alloc, base, size);
+            base = 0;
+        }
+    }
+    platform_close_file(file);
+
+    if (!base)
+    {
+        log_error("Could not read database file '%s'", path);
+        return 0;
+    }
+
+    return load_image(alloc, base, size, mapped, path);
+}
+
+// A database living in a file heap is reached from this root. Its
+// arrays, hashes, payloads and blobs all come from the heap, and stay
+// valid across runs as long as the heap is mapped at the same address.
+// When it isn't, relocate_heap moves every pointer stored in it.
+#define DATABASE_HEAP_VERSION 1
+
+typedef struct database_heap_root_t
+{
+    uint32_t version;
+    uint32_t database_size; // sizeof(database_o), for layout changes
+    database_o* db;
+
+    // Texts of the string values as of the last sync_heap, one after
+    // the other : string ids only refer to the process wide interner.
+    char* strings;
+    uint64_t strings_size;
+} database_heap_root_t;
+
+static void* relocated(void* ptr, int64_t delta)
+{
+    return ptr ? (uint8_t*)ptr + delta : 0;
+}
+
+static void relocate_hash(hash_t* hash, int64_t delta, bool pointer_values)
+{
+    hash->keys = relocated(hash->keys, delta);
+    hash->values = relocated(hash->values, delta);
+    for (uint32_t i = 0; pointer_values && i < hash->bucket_count; i++)
+    {
+        uint64_t key = hash->keys[i];
+        if (key && key != UINT64_MAX)
+        {
+            void* value = (void*)hash->values[i];
+            hash->values[i] = (uint64_t)relocated(value, delta);
+        }
     }
-    def.bytes = offset;
-
-    array_push(db->alloc, db->object_types, def);
+}
 
-    ASSERT(array_count(db->object_types) - 1 <= UINT16_MAX);
+static void relocate_blob(blob_t* blob, int64_t delta)
+{
+    if (!((uint64_t)blob->data & BLOB_FILE_OFFSET))
+    {
+        blob->data = relocated(blob->data, delta);
+    }
+}
 
-    return (object_type_t){array_count(db->object_types) - 1};
+// Blobs of the hot payload or cold block of one object.
+static void relocate_blobs(database_o* db,
+                           const object_type_definition_t* type,
+                           uint8_t* block,
+                           bool cold,
+                           int64_t delta)
+{
+    for (uint32_t i = 0; i < type->property_count; i++)
+    {
+        const property_layout_t* prop =
+            &db->properties[type->first_property + i];
+        if (holds_blob(prop->def.type) && prop->cold == cold)
+        {
+            relocate_blob((blob_t*)(block + prop->offset), delta);
+        }
+    }
 }
 
-static object_t* get_object(database_o* db, object_id_t id)
+// Moves the pointers stored in the heap of db by delta, once it is mapped
+// delta bytes away from where it was. Snapshots don't outlive the
+// process, close_heap collects them, so there are none to follow.
+static void relocate_heap(database_o* db, int64_t delta)
 {
-    ASSERT(id.index);
-    ASSERT(id.info.slot < array_count(db->objects));
+    db->properties = relocated(db->properties, delta);
+    db->object_types = relocated(db->object_types, delta);
+    db->objects = relocated(db->objects, delta);
+    db->free_slots = relocated(db->free_slots, delta);
+    db->free_words = relocated(db->free_words, delta);
+    db->links = relocated(db->links, delta);
+    db->overrides = relocated(db->overrides, delta);
+    db->override_properties = relocated(db->override_properties, delta);
+    db->snapshots = relocated(db->snapshots, delta);
+    db->retired = relocated(db->retired, delta);
+    relocate_hash(&db->moved_ids, delta, false);
+    relocate_hash(&db->first_referrer, delta, false);
+    relocate_hash(&db->link_of_reference, delta, false);
+    relocate_hash(&db->links_of_array, delta, true);
+    relocate_hash(&db->override_of_property, delta, false);
+    relocate_hash(&db->instances_of, delta, true);
+    relocate_hash(&db->blob_store, delta, true);
 
-    object_t* object = &db->objects[id.info.slot].object;
-    ASSERT(id.info.slot == object->id.info.slot);
+    for (uint32_t p = 1; p < array_count(db->properties); p++)
+    {
+        property_layout_t* prop = &db->properties[p];
+        prop->column = relocated(prop->column, delta);
+        prop->row_versions = relocated(prop->row_versions, delta);
+        prop->index = relocated(prop->index, delta);
+        if (prop->index)
+        {
+            property_index_t* index = prop->index;
+            relocate_hash(&index->chains, delta, false);
+            relocate_hash(&index->entry_of_slot, delta, false);
+            index->entries = relocated(index->entries, delta);
+            index->sorted = relocated(index->sorted, delta);
+        }
+    }
 
-    if (object->id.info.generation == id.info.generation)
+    for (uint32_t t = 1; t < array_count(db->object_types); t++)
     {
-        if (object->id.info.type.index == id.info.type.index)
+        object_type_definition_t* type = &db->object_types[t];
+        type->cold = relocated(type->cold, delta);
+        type->row_slots = relocated(type->row_slots, delta);
+        type->row_versions = relocated(type->row_versions, delta);
+        type->pool.pages = relocated(type->pool.pages, delta);
+        for (uint32_t i = 0; i < array_count(type->pool.pages); i++)
         {
-            return object;
+            type->pool.pages[i].base =
+                relocated(type->pool.pages[i].base, delta);
         }
-        else
+
+        for (uint32_t row = 0; row < array_count(type->row_slots); row++)
         {
-            log_warning("Found an object of type %u when type %u was requested",
-                        object->id.info.type.index,
-                        id.info.type.index);
+            if (type->cold)
+            {
+                relocate_blobs(db,
+                               type,
+                               (uint8_t*)type->cold
+                                   + (uint64_t)row * type->cold_bytes,
+                               true,
+                               delta);
+            }
+            for (uint32_t i = 0; (type->flags & OBJECT_TYPE_COLUMNAR)
+                                 && i < type->property_count;
+                 i++)
+            {
+                property_layout_t* prop =
+                    &db->properties[type->first_property + i];
+                if (holds_blob(prop->def.type))
+                {
+                    relocate_blob((blob_t*)prop->column + row, delta);
+                }
+            }
         }
     }
-    return 0;
-}
 
-static const property_layout_t*
-get_property_by_name(database_o* db, object_type_t type, const char* prop_name)
-{
-    ASSERT(type.index && type.index < array_count(db->object_types));
-    const object_type_definition_t* type_def = &db->object_types[type.index];
-    for (uint32_t i = 0; i < type_def->property_count; i++)
+    // Shared payloads hold their blobs once for every object using them,
+    // instances hold a prototype id instead of a payload.
+    hash_t shared = {0};
+    for (uint32_t slot = 1; slot < array_count(db->objects); slot++)
     {
-        const property_layout_t* prop =
-            &db->properties[type_def->first_property + i];
+        object_t* object = &db->objects[slot];
+        if (!object->id.info.type.index || !object->data
+            || object->page == POOL_PAGE_INSTANCE)
+        {
+            continue;
+        }
 
-        if (!strncmp(prop->def.name, prop_name, sizeof(prop->def.name)))
+        object->data = relocated(object->data, delta);
+        if (object->page == POOL_PAGE_SHARED)
         {
-            return prop;
+            if (hash_find(&shared, (uint64_t)object->data, 0))
+            {
+                continue;
+            }
+            hash_set(db->alloc, &shared, (uint64_t)object->data, 1);
         }
+        relocate_blobs(db,
+                       &db->object_types[object->id.info.type.index],
+                       object->data,
+                       false,
+                       delta);
     }
+    hash_free(db->alloc, &shared);
 
-    return 0;
+    for (uint32_t i = 0; i < db->override_of_property.bucket_count; i++)
+    {
+        uint64_t key = db->override_of_property.keys[i];
+        if (key && key != UINT64_MAX
+            && holds_blob(db->properties[key >> 32].def.type))
+        {
+            uint64_t cell = db->override_of_property.values[i] - 1;
+            relocate_blob(&db->overrides[cell].blob, delta);
+        }
+    }
 }
 
-static void* get_property_ptr_full(database_o* db,
-                                   object_id_t id,
-                                   uint16_t property_type,
-                                   object_type_t object_type,
-                                   const char* name)
+static database_o* open_heap(const char* path, uint64_t reserve)
 {
-    const property_layout_t* prop =
-        get_property_by_name(db, id.info.type, name);
-
-    if (!prop //
-        || prop->def.type != property_type
-        || (object_type.index
-            && prop->def.object_type.index != object_type.index))
+    mem_file_heap_o* heap = mem_file_heap_open(path, reserve);
+    if (!heap)
     {
         return 0;
     }
 
-    object_t* object = get_object(db, id);
-    if (object)
+    mem_allocator_i* alloc = mem_file_heap_allocator(heap);
+    database_heap_root_t* root = mem_file_heap_get_root(heap);
+    if (!root)
     {
-        return (uint8_t*)object->data + prop->offset;
+        root = mem_alloc(alloc, sizeof(database_heap_root_t));
+        *root = (database_heap_root_t){
+            .version = DATABASE_HEAP_VERSION,
+            .database_size = sizeof(database_o),
+            .db = create_with(alloc, alloc),
+        };
+        mem_file_heap_set_root(heap, root);
+        root->db->heap = heap;
+        return root->db;
     }
-    else
+    else if (root->version != DATABASE_HEAP_VERSION
+             || root->database_size != sizeof(database_o))
     {
+        log_error("'%s' holds a database of another version", path);
+        mem_file_heap_close(heap);
         return 0;
     }
-}
-
-static void* get_property_ptr(database_o* db,
-                              object_id_t id,
-                              uint32_t property_type,
-                              const char* name)
-{
-    return get_property_ptr_full(db,
-                                 id,
-                                 property_type,
-                                 (object_type_t){0},
-                                 name);
-}
 
-#define DO_DEFINE_GETTER_SETTER(upper, lower, type)                            \
-    static type get_##lower##_or(database_o* db,                               \
-                                 object_id_t object,                           \
-                                 const char* name,                             \
-                                 type fallback)                                \
-    {                                                                          \
-        type* ptr = get_property_ptr(db, object, PTYPE_##upper, name);         \
-        return ptr ? *ptr : fallback;                                          \
-    }                                                                          \
-                                                                               \
-    static type get_##lower(database_o* db,                                    \
-                            object_id_t object,                                \
-                            const char* name)                                  \
-    {                                                                          \
-        type* ptr = get_property_ptr(db, object, PTYPE_##upper, name);         \
-        ASSERT(ptr);                                                           \
-        return *ptr;                                                           \
-    }                                                                          \
-                                                                               \
-    static bool set_##lower(database_o* db,                                    \
-                            object_id_t object,                                \
-                            const char* name,                                  \
-                            type value)                                        \
-    {                                                                          \
-        type* ptr = get_property_ptr(db, object, PTYPE_##upper, name);         \
-        if (!ptr)                                                              \
-        {                                                                      \
-            return false;                                                      \
-        }                                                                      \
-        else                                                                   \
-        {                                                                      \
-            *ptr = value;                                                      \
-            return true;                                                       \
-        }                                                                      \
+    int64_t delta = mem_file_heap_get_relocation(heap);
+    root->db = relocated(root->db, delta);
+    root->strings = relocated(root->strings, delta);
+    for (uint64_t at = 0; at < root->strings_size;)
+    {
+        uint64_t size = strlen(root->strings + at);
+        string_intern_n(root->strings + at, size);
+        at += size + 1;
     }
 
-FOR_ALL_BASE_PROPERTY_TYPES(DO_DEFINE_GETTER_SETTER)
-
-static bool
-reallocate_blob(database_o* db, object_id_t id, const char* name, uint64_t size)
-{
-    blob_t* ptr = get_property_ptr(db, id, PTYPE_BLOB, name);
-
-    if (ptr)
+    // What lives outside the heap belonged to the previous process.
+    database_o* db = root->db;
+    db->alloc = alloc;
+    db->page_alloc = alloc;
+    db->heap = heap;
+    db->journal = 0;
+    db->replica = 0;
+    if (delta)
     {
-        // TODO(octave) : error check memcpy
-        ptr->data = mem_realloc(db->alloc, ptr->data, ptr->size, size);
-        ptr->size = size;
-        return true;
+        relocate_heap(db, delta);
     }
-    else
+    return db;
+}
+
+static bool sync_heap(database_o* db)
+{
+    if (!db->heap)
     {
         return false;
     }
-}
 
-static bool get_blob_data(database_o* db,
-                          object_id_t id,
-                          const char* name,
-                          uint64_t offset,
-                          uint64_t size,
-                          void* data)
-{
-    blob_t* ptr = get_property_ptr(db, id, PTYPE_BLOB, name);
+    database_heap_root_t* root = mem_file_heap_get_root(db->heap);
+    hash_t strings = {0};
+    collect_string_ids(db, &strings);
 
-    if (!ptr || offset + size >= ptr->size)
+    uint64_t size = 0;
+    for (uint32_t i = 0; i < strings.bucket_count; i++)
     {
-        // TODO(octave) : error handling.
-        return false;
+        uint64_t id = strings.keys[i];
+        if (id && id != UINT64_MAX)
+        {
+            size += strlen(string_text((string_id_t){id})) + 1;
+        }
     }
-    else
+    root->strings =
+        mem_realloc(db->alloc, root->strings, root->strings_size, size);
+    root->strings_size = size;
+
+    uint64_t at = 0;
+    for (uint32_t i = 0; i < strings.bucket_count; i++)
     {
-        // TODO(octave) : error check memcpy
-        memcpy(data, (uint8_t*)ptr->data + offset, size);
-        return true;
+        uint64_t id = strings.keys[i];
+        if (id && id != UINT64_MAX)
+        {
+            const char* text = string_text((string_id_t){id});
+            uint64_t length = strlen(text) + 1;
+            memcpy(root->strings + at, text, length);
+            at += length;
+        }
     }
+    hash_free(db->alloc, &strings);
+
+    return mem_file_heap_sync(db->heap);
 }
 
-static bool set_blob_data(database_o* db,
-                          object_id_t id,
-                          const char* name,
-                          uint64_t offset,
-                          uint64_t size,
-                          const void* data)
+// The database stays in the heap, for open_heap to find it again.
+static void close_heap(database_o* db)
+{
+    close_replica(db);
+    close_journal(db);
+    collect_snapshots(db, true);
+
+    mem_file_heap_o* heap = db->heap;
+    sync_heap(db);
+    mem_file_heap_close(heap);
+}
+
+// A published replica is a shared memory segment holding, at offsets
+// aligned to REPLICA_PAGE_SIZE :
+//  - the database file image of db when the segment was created,
+//  - a replica_header_t,
+//  - the ring, where commit_journal appends the batches committed since.
+// Batches are only ever appended, so readers follow them in place without
+// checking for overwrites. Once the ring is full, the segment is closed
+// and a new one is created under the same name.
+#define REPLICA_MAGIC 0x4c50455249554f /* "OUIREPL" */
+#define REPLICA_VERSION 1
+#define REPLICA_PAGE_SIZE Kibi(64) // a multiple of any page size
+
+typedef struct replica_header_t
+{
+    _Atomic uint64_t magic; // stored last
+    uint32_t version;
+    uint32_t padding;
+    uint64_t image_size;
+    uint64_t ring_size;
+
+    // Bytes of batches in the ring, stored once they are written.
+    _Atomic uint64_t written;
+    // Set once the last batch of the segment is written.
+    _Atomic uint32_t closed;
+} replica_header_t;
+
+struct database_replica_t
+{
+    bool publisher;
+    char name[256];
+    uint64_t ring_size;
+
+    // Shared mapping of the header and the ring.
+    replica_header_t* header;
+    uint8_t* ring;
+
+    uint64_t read; // readers : batches applied so far
+};
+
+static uint64_t replica_align(uint64_t size)
 {
-    blob_t* ptr = get_property_ptr(db, id, PTYPE_BLOB, name);
+    return (size + REPLICA_PAGE_SIZE - 1) & ~(REPLICA_PAGE_SIZE - 1);
+}
 
-    if (!ptr || offset + size >= ptr->size)
+static bool replica_create_segment(database_o* db, database_replica_t* replica)
+{
+    platform_file_o* file = platform_create_shared_memory(replica->name);
+    if (!file)
     {
-        // TODO(octave) : error handling.
         return false;
     }
-    else
+
+    uint64_t image_size = write_snapshot_to(db, file, replica->name);
+    uint64_t header_offset = replica_align(image_size);
+    uint64_t mapped_size = REPLICA_PAGE_SIZE + replica->ring_size;
+    replica_header_t* header =
+        image_size
+                && platform_set_file_size(file, header_offset + mapped_size)
+            ? platform_map_shared(file, header_offset, mapped_size, true)
+            : 0;
+    platform_close_file(file);
+    if (!header)
     {
-        // TODO(octave) : error check memcpy
-        memcpy((uint8_t*)ptr->data + offset, data, size);
-        return true;
+        platform_remove_shared_memory(replica->name);
+        return false;
     }
+
+    header->version = REPLICA_VERSION;
+    header->image_size = image_size;
+    header->ring_size = replica->ring_size;
+    atomic_store(&header->magic, REPLICA_MAGIC);
+
+    replica->header = header;
+    replica->ring = (uint8_t*)header + REPLICA_PAGE_SIZE;
+    return true;
 }
 
-static object_id_t
-get_sub_object(database_o* db, object_id_t id, const char* name)
+static void replica_close_segment(database_replica_t* replica)
 {
-    object_id_t* ptr = get_property_ptr(db, id, PTYPE_OBJECT, name);
-
-    if (!ptr)
-    {
-        // TODO(octave) : error handling.
-        return (object_id_t){0};
-    }
-    else
+    if (replica->publisher)
     {
-        return *ptr;
+        atomic_store(&replica->header->closed, true);
     }
+    platform_unmap_file(replica->header,
+                        REPLICA_PAGE_SIZE + replica->ring_size);
+    replica->header = 0;
 }
 
-static object_id_t
-get_reference(database_o* db, object_id_t id, const char* name)
+static bool
+publish_replica(database_o* db, const char* name, uint64_t ring_size)
 {
-    object_id_t* ptr = get_property_ptr(db, id, PTYPE_REFERENCE, name);
+    ASSERT(!db->replica);
+    if (strlen(name) >= sizeof(db->replica->name))
+    {
+        log_error("Replica name too long");
+        return false;
+    }
 
-    if (!ptr)
+    // Changes recorded so far go to the journal file, they are part of
+    // the image.
+    commit_journal(db);
+
+    database_replica_t* replica = mem_alloc(db->alloc, sizeof(*replica));
+    *replica = (database_replica_t){
+        .publisher = true,
+        .ring_size = replica_align(ring_size ? ring_size : 1),
+    };
+    strcpy(replica->name, name);
+    if (!replica_create_segment(db, replica))
     {
-        // TODO(octave) : error handling.
-        return (object_id_t){0};
+        log_error("Could not publish replica '%s'", name);
+        mem_free(db->alloc, replica, sizeof(*replica));
+        return false;
     }
-    else
+
+    db->replica = replica;
+    if (!db->journal)
     {
-        return *ptr;
+        db->journal = mem_alloc(db->alloc, sizeof(*db->journal));
+        *db->journal = (database_journal_t){0};
     }
+    return true;
 }
 
-static void set_reference(database_o* db,
-                          object_id_t id,
-                          const char* name,
-                          object_id_t value)
+static bool replica_append(database_o* db, const uint8_t* batch, uint64_t size)
 {
-    object_id_t* ptr =
-        get_property_ptr_full(db, id, PTYPE_REFERENCE, value.info.type, name);
-
-    if (!ptr)
+    database_replica_t* replica = db->replica;
+    replica_header_t* header = replica->header;
+    uint64_t written = atomic_load_explicit(&header->written,
+                                            memory_order_relaxed);
+    if (size <= replica->ring_size - written)
     {
-        // TODO(octave) : error handling.
+        memcpy(replica->ring + written, batch, size);
+        atomic_store_explicit(&header->written,
+                              written + size,
+                              memory_order_release);
+        return true;
     }
-    else
+
+    // The image of the next segment already holds the batch.
+    replica_close_segment(replica);
+    if (!replica_create_segment(db, replica))
     {
-        *ptr = value;
+        log_error("Could not publish replica '%s'", replica->name);
+        mem_free(db->alloc, replica, sizeof(*replica));
+        db->replica = 0;
+        return false;
     }
+    return true;
 }
 
-static void destroy_object(database_o* db, object_id_t id)
+static void close_replica(database_o* db)
 {
-    object_t* object = get_object(db, id);
-    if (!object)
+    database_replica_t* replica = db->replica;
+    if (!replica)
     {
-        // already deleted.
         return;
     }
 
-    object_type_definition_t* type = &db->object_types[id.info.type.index];
-    for (uint32_t i = 0; i < type->property_count; i++)
+    if (replica->publisher)
     {
-        property_layout_t* prop = &db->properties[type->first_property + i];
-        if (prop->def.type == PTYPE_BLOB)
-        {
-            blob_t* buf = (blob_t*)((uint8_t*)object->data + prop->offset);
-
-            mem_free(db->alloc, buf->data, buf->size);
-        }
-        else if (prop->def.type == PTYPE_OBJECT)
+        // dropped along with its segment when the ring couldn't move
+        commit_journal(db);
+        replica = db->replica;
+    }
+    if (replica)
+    {
+        if (replica->publisher)
         {
-            object_id_t* sub_id =
-                (object_id_t*)((uint8_t*)object->data + prop->offset);
-
-            destroy_object(db, *sub_id);
+            platform_remove_shared_memory(replica->name);
         }
+        replica_close_segment(replica);
+        mem_free(db->alloc, replica, sizeof(*replica));
+        db->replica = 0;
     }
 
-    ASSERT(object->data);
-    mem_free(db->alloc, object->data, type->bytes);
-
-    object->data = 0;
-    object->id.info.type = (object_type_t){0};
-
-    db->objects[id.info.slot].next_free = db->objects[0].next_free;
-    db->objects[0].next_free = id.info.slot;
+    if (db->journal && !db->journal->file)
+    {
+        close_journal(db);
+    }
 }
 
-static object_id_t create_object(database_o* db, object_type_t type)
+static database_o* open_replica(mem_allocator_i* alloc, const char* name)
 {
-    if (type.index == 0 || type.index >= array_count(db->object_types))
+    platform_file_o* file = platform_open_shared_memory(name);
+    if (!file)
     {
-        return (object_id_t){0};
+        return 0;
     }
 
-    uint32_t slot_index = db->objects[0].next_free;
-    if (!slot_index)
+    // The image comes first, the header follows it.
+    file_header_t image_header = {0};
+    uint64_t size = platform_get_file_size(file);
+    platform_read_file(file, &image_header, sizeof(image_header));
+    uint64_t header_offset = replica_align(image_header.file_size);
+    if (image_header.magic != DATABASE_FILE_MAGIC
+        || size < header_offset + REPLICA_PAGE_SIZE)
     {
-        array_push(db->alloc, db->objects, (object_slot_t){0});
-        slot_index = array_count(db->objects) - 1;
+        platform_close_file(file);
+        return 0;
     }
-    db->objects[0].next_free = db->objects[slot_index].next_free;
 
-    object_t* object = &db->objects[slot_index].object;
-    object->id.info.type = type;
-    object->id.info.generation++;
-    object->id.info.slot = slot_index;
+    uint64_t mapped_size = size - header_offset;
+    replica_header_t* header =
+        platform_map_shared(file, header_offset, mapped_size, false);
+    if (!header || atomic_load(&header->magic) != REPLICA_MAGIC
+        || header->version != REPLICA_VERSION
+        || header->image_size != image_header.file_size
+        || header->ring_size != mapped_size - REPLICA_PAGE_SIZE)
+    {
+        if (header)
+        {
+            platform_unmap_file(header, mapped_size);
+        }
+        platform_close_file(file);
+        return 0;
+    }
+
+    // Copy on write : applying the batches leaves the segment alone.
+    uint8_t* base = platform_map_file(file, header->image_size);
+    platform_close_file(file);
+    database_o* db =
+        base ? load_image(alloc, base, header->image_size, true, name) : 0;
+    if (!db)
+    {
+        platform_unmap_file(header, mapped_size);
+        return 0;
+    }
 
-    object->data = mem_alloc(db->alloc, db->object_types[type.index].bytes);
-    memset(object->data, 0, db->object_types[type.index].bytes);
+    db->replica = mem_alloc(alloc, sizeof(*db->replica));
+    *db->replica = (database_replica_t){
+        .ring_size = header->ring_size,
+        .header = header,
+        .ring = (uint8_t*)header + REPLICA_PAGE_SIZE,
+    };
+    strcpy(db->replica->name, name);
+    return db;
+}
 
-    object_type_definition_t* type_def = &db->object_types[type.index];
-    for (uint32_t i = 0; i < type_def->property_count; i++)
+static bool follow_replica(database_o* db, uint32_t* batch_count)
+{
+    database_replica_t* replica = db->replica;
+    *batch_count = 0;
+    if (!replica || replica->publisher)
     {
-        property_layout_t* prop = &db->properties[type_def->first_property + i];
+        return false;
+    }
 
-        if (prop->def.type == PTYPE_OBJECT)
+    // closed first : once it is set, written is final.
+    bool closed = atomic_load(&replica->header->closed);
+    uint64_t written = atomic_load_explicit(&replica->header->written,
+                                            memory_order_acquire);
+    while (written - replica->read >= sizeof(journal_record_t))
+    {
+        const journal_record_t* record =
+            (const journal_record_t*)(replica->ring + replica->read);
+        uint64_t padded = (record->size + 7) & ~7ull;
+        if (padded < record->size
+            || padded > written - replica->read - sizeof(journal_record_t))
         {
-            object_id_t* sub_id =
-                (object_id_t*)((uint8_t*)object->data + prop->offset);
+            log_error("Replica '%s' is corrupted", replica->name);
+            return false;
+        }
+        replica->read += sizeof(journal_record_t) + padded;
 
-            *sub_id = create_object(db, prop->def.object_type);
+        if (record->kind == JOURNAL_COMMIT)
+        {
+            if (db->version < record->id.index)
+            {
+                db->version = record->id.index;
+            }
+            (*batch_count)++;
+        }
+        else if (!journal_apply(db, record, (const uint8_t*)(record + 1)))
+        {
+            log_error("Could not apply replica record %u to object %lx",
+                      record->kind,
+                      record->id.index);
         }
     }
 
-    return object->id;
+    return !closed;
 }
 
+#define DO_ASSIGN_FIND(upper, lower, type)                                     \
+    db->find_##lower = find_##lower;                                           \
+    db->find_##lower##_range = find_##lower##_range;
+
 #define DO_ASSIGN_GETTER_SETTER(upper, lower, type)                            \
     db->set_##lower = set_##lower;                                             \
     db->get_##lower = get_##lower;                                             \
-    db->get_##lower##_or = get_##lower##_or;
+    db->get_##lower##_or = get_##lower##_or;                                   \
+    db->set_##lower##_h = set_##lower##_h;                                     \
+    db->get_##lower##_h = get_##lower##_h;                                     \
+    db->get_##lower##_or_h = get_##lower##_or_h;
 
 static void load(void* api)
 {
     database_api* db = api;
 
+    select_aggregate_kernels();
+
     FOR_ALL_BASE_PROPERTY_TYPES(DO_ASSIGN_GETTER_SETTER)
+    FOR_ALL_BASE_PROPERTY_TYPES(DO_ASSIGN_FIND)
 
     db->create = create;
     db->destroy = destroy;
     db->add_object_type = add_object_type;
+    db->add_object_type_ex = add_object_type_ex;
     db->create_object = create_object;
     db->destroy_object = destroy_object;
+    db->create_objects = create_objects;
+    db->destroy_objects = destroy_objects;
+    db->set_values_h = set_values_h;
+    db->clone_object = clone_object;
+    db->clone_object_cow = clone_object_cow;
+    db->create_instance = create_instance;
+    db->read_array_h = read_array_h;
+    db->append_reference_h = append_reference_h;
+    db->append_sub_object_h = append_sub_object_h;
+    db->remove_array_element_h = remove_array_element_h;
+    db->get_string_h = get_string_h;
+    db->set_string_h = set_string_h;
+    db->find_string = find_string;
+    db->get_override_stats = get_override_stats;
+    db->compact_slots = compact_slots;
+    db->remap_id = remap_id;
+    db->get_slot_stats = get_slot_stats;
+    db->acquire_snapshot = acquire_snapshot;
+    db->release_snapshot = release_snapshot;
+    db->get_snapshot_version = get_snapshot_version;
+    db->get_snapshot_objects = get_snapshot_objects;
+    db->read_snapshot_h = read_snapshot_h;
+    db->read_snapshot_blob_h = read_snapshot_blob_h;
+    db->begin_transaction = begin_transaction;
+    db->tx_create_object = tx_create_object;
+    db->tx_destroy_object = tx_destroy_object;
+    db->tx_set_h = tx_set_h;
+    db->tx_reallocate_blob_h = tx_reallocate_blob_h;
+    db->tx_set_blob_data_h = tx_set_blob_data_h;
+    db->tx_set_blob_h = tx_set_blob_h;
+    db->commit_transaction = commit_transaction;
+    db->abort_transaction = abort_transaction;
+    db->get_payload = get_payload;
+    db->generate_accessors = generate_accessors;
     db->get_sub_object = get_sub_object;
     db->get_reference = get_reference;
     db->set_reference = set_reference;
     db->reallocate_blob = reallocate_blob;
     db->get_blob_data = get_blob_data;
     db->set_blob_data = set_blob_data;
+
+    db->find_property = find_property;
+    db->get_sub_object_h = get_sub_object_h;
+    db->get_reference_h = get_reference_h;
+    db->set_reference_h = set_reference_h;
+    db->reallocate_blob_h = reallocate_blob_h;
+    db->get_blob_data_h = get_blob_data_h;
+    db->set_blob_data_h = set_blob_data_h;
+    db->read_blob_h = read_blob_h;
+    db->write_blob_h = write_blob_h;
+    db->mark_blob_dirty_h = mark_blob_dirty_h;
+    db->set_blob_h = set_blob_h;
+    db->copy_blob_h = copy_blob_h;
+    db->deduplicate_blobs = deduplicate_blobs;
+    db->get_blob_stats = get_blob_stats;
+
+    db->get_column = get_column;
+    db->get_type_layout = get_type_layout;
+    db->get_property_layout = get_property_layout;
+
+    db->object_count = object_count;
+    db->begin_iteration = begin_iteration;
+    db->next_object = next_object;
+    db->for_each_object = for_each_object;
+
+    db->get_index_stats = get_index_stats;
+    db->aggregate_h = aggregate_h;
+    db->count_in_range_h = count_in_range_h;
+    db->get_referrers = get_referrers;
+
+    db->get_version = get_version;
+    db->get_type_version = get_type_version;
+    db->get_object_version = get_object_version;
+    db->get_property_version = get_property_version;
+    db->changed_since = changed_since;
+
+    db->save_to_file = save_to_file;
+    db->load_from_file = load_from_file;
+    db->open_heap = open_heap;
+    db->sync_heap = sync_heap;
+
+    db->open_journal = open_journal;
+    db->commit_journal = commit_journal;
+    db->compact_journal = compact_journal;
+    db->close_journal = close_journal;
+    db->replay_journal = replay_journal;
+    db->publish_replica = publish_replica;
+    db->close_replica = close_replica;
+    db->open_replica = open_replica;
+    db->follow_replica = follow_replica;
 }
 
 plugin_spec_t PLUGIN_SPEC = {
     .name = "database",
-    .version = {0, 0, 2},
+    .version = {0, 1, 0},
     .load = load,
     .api_size = sizeof(database_api),
 };
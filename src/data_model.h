@@ -1,8 +1,11 @@
 #pragma once
 
 #include "base_types.h"
+#include "string_intern.h"
 
 typedef struct database_o database_o;
+typedef struct database_snapshot_o database_snapshot_o;
+typedef struct database_transaction_o database_transaction_o;
 typedef struct mem_allocator_i mem_allocator_i;
 
 #define FOR_ALL_BASE_PROPERTY_TYPES(X)                                         \
@@ -31,20 +34,67 @@ typedef enum property_type_e
     PTYPE_BLOB,
     PTYPE_OBJECT,
     PTYPE_REFERENCE,
+    // Variable number of references to, or sub-objects of, object_type.
+    // See read_array_h.
+    PTYPE_REFERENCE_ARRAY,
+    PTYPE_OBJECT_ARRAY,
+    // A string_id_t, see string_intern.h. Only hash indexes apply.
+    PTYPE_STRING,
 } property_type_e;
 
+enum
+{
+    // Store each property of the type in its own contiguous column
+    // instead of one payload per object. Rows are kept packed, so
+    // destroying an object moves the last row into its place.
+    OBJECT_TYPE_COLUMNAR = 1 << 0,
+};
+
+enum
+{
+    // load_from_file : read the file into memory instead of mapping it.
+    DATABASE_LOAD_READ = 1 << 0,
+};
+
 typedef struct object_type_t
 {
     uint16_t index;
 } object_type_t;
 
+enum
+{
+    // Maintain a hash index for find_* equality lookups.
+    PROPERTY_INDEX_HASH = 1 << 0,
+    // Maintain a sorted index for find_*_range lookups. Updates cost
+    // O(n) memmoves, lookups O(log n).
+    PROPERTY_INDEX_ORDERED = 1 << 1,
+    // PTYPE_REFERENCE only : reset the reference to a null id when the
+    // referenced object is destroyed, instead of leaving it dangling.
+    PROPERTY_NULL_ON_DESTROY = 1 << 2,
+    // Keep a version per object for this property, see
+    // get_property_version.
+    PROPERTY_TRACK_CHANGES = 1 << 3,
+    // Rarely accessed : kept out of the object payload, in a block per
+    // object stored apart, so that it doesn't take room in the cache
+    // lines of the hot properties. Ignored by OBJECT_TYPE_COLUMNAR types.
+    PROPERTY_COLD = 1 << 4,
+};
+
 typedef struct property_definition_t
 {
     char name[32];
     uint16_t type;
     object_type_t object_type;
+    uint32_t flags;
 } property_definition_t;
 
+// Resolved once with database_api.find_property, then passed to the *_h
+// accessors to skip the per-call name lookup. Index 0 is the null handle.
+typedef struct property_handle_t
+{
+    uint32_t index;
+} property_handle_t;
+
 typedef union object_id_t
 {
     uint64_t index;
@@ -61,6 +111,115 @@ typedef union object_id_t
     } info;
 } object_id_t;
 
+// Walks the live objects of a type, last created first. Destroying the
+// object that was just returned is allowed, other changes to objects of
+// that type invalidate the iterator.
+typedef struct object_iterator_t
+{
+    object_type_t type;
+    uint32_t row;
+} object_iterator_t;
+
+typedef void object_callback_t(database_o* db,
+                               object_id_t id,
+                               void* user_data);
+
+// Views into a blob, valid until the blob is resized or its object
+// destroyed.
+typedef struct blob_view_t
+{
+    const void* data;
+    uint64_t size;
+} blob_view_t;
+
+// Elements of an array property, valid until the next change to the
+// database.
+typedef struct object_array_view_t
+{
+    const object_id_t* ids;
+    uint32_t count;
+} object_array_view_t;
+
+typedef struct blob_mut_view_t
+{
+    void* data;
+    uint64_t size;
+} blob_mut_view_t;
+
+typedef struct property_layout_info_t
+{
+    uint32_t type; // PTYPE_*
+    uint32_t offset; // in the payload or the cold block
+    uint32_t size;
+    uint32_t alignment;
+    bool cold;
+} property_layout_info_t;
+
+typedef struct type_layout_info_t
+{
+    uint32_t hot_bytes; // payload of each object
+    uint32_t cold_bytes;
+    uint32_t payload_stride; // distance between pooled payloads
+    uint32_t padding_bytes;
+} type_layout_info_t;
+
+typedef struct blob_store_stats_t
+{
+    uint64_t reference_count; // blob properties holding a payload
+    uint64_t unique_count; // payloads actually stored
+    uint64_t logical_bytes; // sum of the sizes of the blob properties
+    uint64_t stored_bytes; // sum of the sizes of the stored payloads
+    uint64_t reserved_bytes; // allocated for them, arrays keep room to grow
+    uint64_t bytes_saved; // logical_bytes - stored_bytes
+    double dedup_ratio; // logical_bytes / stored_bytes
+} blob_store_stats_t;
+
+typedef struct property_index_stats_t
+{
+    uint32_t entry_count;
+    uint64_t update_count;
+    uint64_t update_nanoseconds;
+    uint64_t bytes;
+} property_index_stats_t;
+
+typedef struct override_stats_t
+{
+    uint32_t instance_count;
+    uint32_t override_count; // properties written to instances
+    uint64_t bytes;
+} override_stats_t;
+
+typedef struct slot_stats_t
+{
+    uint32_t slot_count; // without the null slot
+    uint32_t free_count;
+} slot_stats_t;
+
+typedef struct property_aggregate_t
+{
+    uint32_t count; // live objects of the type
+    double sum;
+    double min; // min, max and mean are 0 when count is 0
+    double max;
+    double mean;
+} property_aggregate_t;
+
+// find_* return the total number of matches and write at most
+// max_results of them. Properties without a matching index are
+// scanned.
+#define DO_DECLARE_FIND(upper, lower, type)                                    \
+    uint32_t (*find_##lower)(database_o * db,                                  \
+                             property_handle_t property,                       \
+                             type value,                                       \
+                             object_id_t * results,                            \
+                             uint32_t max_results);                            \
+    uint32_t (*find_##lower##_range)(database_o * db,                          \
+                                     property_handle_t property,               \
+                                     type min,                                 \
+                                     type max,                                 \
+                                     object_id_t * results,                    \
+                                     uint32_t max_results);
+
 #define DO_DECLARE_GETTER_SETTER(upper, lower, type)                           \
     type (*get_##lower##_or)(database_o * db,                                  \
                              object_id_t object,                               \
@@ -71,7 +230,18 @@ typedef union object_id_t
     bool (*set_##lower)(database_o * db,                                       \
                         object_id_t object,                                    \
                         const char* name,                                      \
-                        type value);
+                        type value);                                           \
+    type (*get_##lower##_or_h)(database_o * db,                                \
+                               object_id_t object,                             \
+                               property_handle_t property,                     \
+                               type fallback);                                 \
+    type (*get_##lower##_h)(database_o * db,                                   \
+                            object_id_t object,                                \
+                            property_handle_t property);                       \
+    bool (*set_##lower##_h)(database_o * db,                                   \
+                            object_id_t object,                                \
+                            property_handle_t property,                        \
+                            type value);
 
 typedef struct database_api
 {
@@ -81,11 +251,154 @@ typedef struct database_api
     object_type_t (*add_object_type)(database_o* db,
                                      uint32_t property_count,
                                      property_definition_t* properties);
+    object_type_t (*add_object_type_ex)(database_o* db,
+                                        uint32_t property_count,
+                                        property_definition_t* properties,
+                                        uint32_t flags);
     object_id_t (*create_object)(database_o* db, object_type_t type);
     void (*destroy_object)(database_o* db, object_id_t id);
 
+    // Batched create_object, destroy_object and setters: validation and
+    // allocations happen once per call, and ordered indexes are rebuilt
+    // once instead of being updated per object when the batch is large.
+    // set_values_h reads count values of the property's size from values
+    // and accepts base types and references. Both create_objects and
+    // set_values_h return how many objects were created or written.
+    uint32_t (*create_objects)(database_o* db,
+                               object_type_t type,
+                               uint32_t count,
+                               object_id_t* ids);
+    void (*destroy_objects)(database_o* db,
+                            const object_id_t* ids,
+                            uint32_t count);
+    uint32_t (*set_values_h)(database_o* db,
+                             property_handle_t property,
+                             const object_id_t* ids,
+                             uint32_t count,
+                             const void* values);
+
+    // Copies an object with its blobs and sub-objects, references are
+    // copied as is. Returns the null id if id isn't alive. The copy on
+    // write variant shares the payload with id until one of them is
+    // written to, which makes snapshots of large objects cheap.
+    object_id_t (*clone_object)(database_o* db, object_id_t id);
+    object_id_t (*clone_object_cow)(database_o* db, object_id_t id);
+
+    // Instances read the hot properties they don't override from their
+    // prototype, so later writes to it reach them, indexes and
+    // references included. Only the hot properties written to an
+    // instance are stored for it, the cold ones are copied. Sub-objects
+    // aren't inherited, and columnar types can't be instantiated.
+    // Instances are saved as such, clones are plain objects, and so do
+    // the instances of a destroyed prototype become. Returns the null id
+    // if prototype isn't alive.
+    object_id_t (*create_instance)(database_o* db, object_id_t prototype);
+    void (*get_override_stats)(database_o* db, override_stats_t* stats);
+
+    // Ids index a table of slots. Freed slots are reused lowest first,
+    // so that live objects gather at the start of the table.
+    // compact_slots moves the objects of the highest slots to the free
+    // ones below them, then drops the free slots left at the end and
+    // hands their memory back. Moved objects get new ids, the stored
+    // references and sub-objects are updated, the old ids are dead.
+    // Returns the number of moved objects, whose new ids remap_id gives
+    // until the next compaction, and returns other ids as is. Changes
+    // that pending transactions record on moved objects fail to commit.
+    uint32_t (*compact_slots)(database_o* db);
+    object_id_t (*remap_id)(database_o* db, object_id_t id);
+    void (*get_slot_stats)(database_o* db, slot_stats_t* stats);
+
+    // Snapshots are read only views of the database as it was when they
+    // were acquired, for worker threads to read while the database keeps
+    // being written. acquire_snapshot must be called from the thread
+    // writing to the database. The snapshot can then be read and released
+    // from any thread, without locking.
+    //
+    // Payloads aren't copied by acquire_snapshot : the first write to an
+    // object older than the newest snapshot gives it a new payload, and
+    // the old one is freed once the snapshots that can read it are
+    // released, by the next write, acquire_snapshot or destroy.
+    //
+    // The slot table, the rows of every type, the columns of columnar
+    // types, the cold properties and the override cells are copied by
+    // chunks of 1024 elements, and only the chunks written since the
+    // previous snapshot are : a snapshot costs time and memory in
+    // proportion to the chunks written since then. The newest keeps its
+    // chunks after being released, for the next one to share. Compacting
+    // slots moves objects all over the tables, the snapshot following it
+    // copies every chunk.
+    database_snapshot_o* (*acquire_snapshot)(database_o* db);
+    void (*release_snapshot)(database_snapshot_o* snapshot);
+    uint64_t (*get_snapshot_version)(const database_snapshot_o* snapshot);
+    // Returns the number of objects of type in the snapshot, and writes
+    // at most max_results of them, starting from the first-th.
+    uint32_t (*get_snapshot_objects)(const database_snapshot_o* snapshot,
+                                     object_type_t type,
+                                     uint32_t first,
+                                     object_id_t* results,
+                                     uint32_t max_results);
+    // Copies the value of any property but blobs and arrays, size must
+    // be the one of the property type.
+    bool (*read_snapshot_h)(const database_snapshot_o* snapshot,
+                            object_id_t id,
+                            property_handle_t property,
+                            void* value,
+                            uint32_t size);
+    // Also reads arrays, as blobs of object_id_t.
+    blob_view_t (*read_snapshot_blob_h)(const database_snapshot_o* snapshot,
+                                        object_id_t id,
+                                        property_handle_t property);
+
+    // Transactions record changes without touching the database, so any
+    // thread can fill its own, and apply them all in commit_transaction,
+    // from the thread writing to the database. Commits are applied
+    // creations first, then writes sorted by property and object, then
+    // destructions. The db allocator, used to record, must be thread
+    // safe for concurrent transactions.
+    //
+    // tx_create_object returns a pending id, only valid in the same
+    // transaction, including as the value of a reference or an element
+    // of the PTYPE_REFERENCE_ARRAY tx_set_blob_h sets, data holding the
+    // ids. The real ids are written to created_ids in creation order if
+    // it isn't null.
+    //
+    // Commits are all or nothing : every record is checked before any is
+    // applied, ids alive or pending, properties of their type, sizes and
+    // blob ranges, and commit_transaction returns false without changing
+    // the database if one is invalid. Both functions free the transaction.
+    database_transaction_o* (*begin_transaction)(database_o* db);
+    object_id_t (*tx_create_object)(database_transaction_o* tx,
+                                    object_type_t type);
+    void (*tx_destroy_object)(database_transaction_o* tx, object_id_t id);
+    // value holds size bytes, the size of the property type.
+    void (*tx_set_h)(database_transaction_o* tx,
+                     object_id_t id,
+                     property_handle_t property,
+                     const void* value,
+                     uint32_t size);
+    void (*tx_reallocate_blob_h)(database_transaction_o* tx,
+                                 object_id_t id,
+                                 property_handle_t property,
+                                 uint64_t size);
+    void (*tx_set_blob_data_h)(database_transaction_o* tx,
+                               object_id_t id,
+                               property_handle_t property,
+                               uint64_t offset,
+                               uint64_t size,
+                               const void* data);
+    void (*tx_set_blob_h)(database_transaction_o* tx,
+                          object_id_t id,
+                          property_handle_t property,
+                          const void* data,
+                          uint64_t size);
+    bool (*commit_transaction)(database_transaction_o* tx,
+                               object_id_t* created_ids);
+    void (*abort_transaction)(database_transaction_o* tx);
+
     FOR_ALL_BASE_PROPERTY_TYPES(DO_DECLARE_GETTER_SETTER)
 
+    // Sub-objects are created on first access, so reading a PTYPE_OBJECT
+    // property of an object can create objects.
     object_id_t (*get_sub_object)(database_o* db,
                                   object_id_t id,
                                   const char* name);
@@ -114,4 +427,269 @@ typedef struct database_api
                           uint64_t offset,
                           uint64_t size,
                           const void* data);
+
+    // Handle based accessors. The handle must have been found on the
+    // type of the object passed in.
+    property_handle_t (*find_property)(database_o* db,
+                                       object_type_t type,
+                                       const char* name);
+
+    object_id_t (*get_sub_object_h)(database_o* db,
+                                    object_id_t id,
+                                    property_handle_t property);
+
+    void (*set_reference_h)(database_o* db,
+                            object_id_t id,
+                            property_handle_t property,
+                            object_id_t value);
+    object_id_t (*get_reference_h)(database_o* db,
+                                   object_id_t id,
+                                   property_handle_t property);
+
+    // Arrays : appends are amortized O(1), removing an element moves the
+    // last one in its place. Destroying an object removes it from the
+    // reference arrays holding it, and destroys the sub-objects of its
+    // object arrays. Appending a dead object or an object of another
+    // type than the object_type of the property fails.
+    object_array_view_t (*read_array_h)(database_o* db,
+                                        object_id_t id,
+                                        property_handle_t property);
+    bool (*append_reference_h)(database_o* db,
+                               object_id_t id,
+                               property_handle_t property,
+                               object_id_t target);
+    object_id_t (*append_sub_object_h)(database_o* db,
+                                       object_id_t id,
+                                       property_handle_t property);
+    // Destroys the sub-object of an object array.
+    bool (*remove_array_element_h)(database_o* db,
+                                   object_id_t id,
+                                   property_handle_t property,
+                                   uint32_t index);
+
+    // value must be interned, or null. It can also be written with
+    // tx_set_h and set_values_h, and read with read_snapshot_h.
+    string_id_t (*get_string_h)(database_o* db,
+                                object_id_t id,
+                                property_handle_t property);
+    bool (*set_string_h)(database_o* db,
+                         object_id_t id,
+                         property_handle_t property,
+                         string_id_t value);
+
+    bool (*reallocate_blob_h)(database_o* db,
+                              object_id_t id,
+                              property_handle_t property,
+                              uint64_t size);
+    bool (*get_blob_data_h)(database_o* db,
+                            object_id_t id,
+                            property_handle_t property,
+                            uint64_t offset,
+                            uint64_t size,
+                            void* data);
+    bool (*set_blob_data_h)(database_o* db,
+                            object_id_t id,
+                            property_handle_t property,
+                            uint64_t offset,
+                            uint64_t size,
+                            const void* data);
+
+    // Borrow the bytes of a blob without copying them. Writes through a
+    // mutable view must be followed by mark_blob_dirty_h for the range
+    // written, which updates the versions and the journal. Views of
+    // missing objects or properties are empty.
+    blob_view_t (*read_blob_h)(database_o* db,
+                               object_id_t id,
+                               property_handle_t property);
+    blob_mut_view_t (*write_blob_h)(database_o* db,
+                                    object_id_t id,
+                                    property_handle_t property);
+    bool (*mark_blob_dirty_h)(database_o* db,
+                              object_id_t id,
+                              property_handle_t property,
+                              uint64_t offset,
+                              uint64_t size);
+
+    // Blob payloads are reference counted and copied on write. set_blob_h
+    // replaces the whole content and shares the payload of any blob set
+    // to the same bytes. copy_blob_h shares the payload of src in O(1).
+    // Blobs written piecewise are shared once deduplicate_blobs hashed
+    // them, it returns the number of payloads merged. Blobs still in a
+    // file loaded with load_from_file aren't counted in the stats.
+    bool (*set_blob_h)(database_o* db,
+                       object_id_t id,
+                       property_handle_t property,
+                       const void* data,
+                       uint64_t size);
+    bool (*copy_blob_h)(database_o* db,
+                        object_id_t dst,
+                        property_handle_t dst_property,
+                        object_id_t src,
+                        property_handle_t src_property);
+    uint32_t (*deduplicate_blobs)(database_o* db);
+    void (*get_blob_stats)(database_o* db, blob_store_stats_t* stats);
+
+    // Properties are laid out by decreasing alignment, so that none is
+    // misaligned and no padding is needed. Returns false for unknown
+    // types and properties.
+    bool (*get_type_layout)(database_o* db,
+                            object_type_t type,
+                            type_layout_info_t* info);
+    bool (*get_property_layout)(database_o* db,
+                                object_type_t type,
+                                property_handle_t property,
+                                property_layout_info_t* info);
+
+    // Returns the column of a property of an OBJECT_TYPE_COLUMNAR type,
+    // holding *count packed values, or 0 for other types. The pointer is
+    // invalidated by creating or destroying objects of that type.
+    const void* (*get_column)(database_o* db,
+                              object_type_t type,
+                              property_handle_t property,
+                              uint32_t* count);
+
+    // Returns the payload holding the hot properties of an object, laid
+    // out as get_property_layout tells, or 0 for dead objects, instances
+    // and columnar types. Valid until the next change to the database.
+    const void* (*get_payload)(database_o* db, object_id_t id);
+
+    // Writes a C header of static inline accessors for a type declared
+    // with properties and flags, as passed to add_object_type_ex. Hot
+    // properties are read at constant offsets from get_payload, the other
+    // reads, the reads of instances and all the writes go through the
+    // handle based functions.
+    // The generated <prefix>_register checks the layout of the type it
+    // is given against the one the header was generated for.
+    bool (*generate_accessors)(mem_allocator_i* alloc,
+                               const char* prefix,
+                               uint32_t property_count,
+                               property_definition_t* properties,
+                               uint32_t flags,
+                               const char* path);
+
+    uint32_t (*object_count)(database_o* db, object_type_t type);
+    object_iterator_t (*begin_iteration)(database_o* db, object_type_t type);
+    bool (*next_object)(database_o* db,
+                        object_iterator_t* it,
+                        object_id_t* id);
+    void (*for_each_object)(database_o* db,
+                            object_type_t type,
+                            object_callback_t* callback,
+                            void* user_data);
+
+    FOR_ALL_BASE_PROPERTY_TYPES(DO_DECLARE_FIND)
+    uint32_t (*find_string)(database_o* db,
+                            property_handle_t property,
+                            string_id_t value,
+                            object_id_t* results,
+                            uint32_t max_results);
+    bool (*get_index_stats)(database_o* db,
+                            property_handle_t property,
+                            property_index_stats_t* stats);
+
+    // Reduce a numeric property (PTYPE_BOOL to PTYPE_FLOAT64) over every
+    // live object of its type, with SIMD kernels picked for the running
+    // CPU. Values are widened to double, so 64 bit integers beyond 2^53
+    // are rounded. aggregate_h returns false for other properties,
+    // count_in_range_h counts the values in [min, max].
+    bool (*aggregate_h)(database_o* db,
+                        property_handle_t property,
+                        property_aggregate_t* result);
+    uint32_t (*count_in_range_h)(database_o* db,
+                                 property_handle_t property,
+                                 double min,
+                                 double max);
+
+    // Lists the objects holding a reference to id, along with the
+    // property holding it when properties isn't null. Returns the total
+    // number of referrers and writes at most max_results of them.
+    uint32_t (*get_referrers)(database_o* db,
+                              object_id_t id,
+                              object_id_t* results,
+                              property_handle_t* properties,
+                              uint32_t max_results);
+
+    // Versions come from a counter bumped by every create, destroy and
+    // write to the database. An object's version is the one of its last
+    // change, 0 is never a valid version.
+    uint64_t (*get_version)(database_o* db);
+    uint64_t (*get_type_version)(database_o* db, object_type_t type);
+    uint64_t (*get_object_version)(database_o* db, object_id_t id);
+    uint64_t (*get_property_version)(database_o* db,
+                                     object_id_t id,
+                                     property_handle_t property);
+
+    // Lists the live objects of type changed after version, or whose
+    // property changed when property isn't null, which requires
+    // PROPERTY_TRACK_CHANGES. Destroyed objects aren't listed, compare
+    // get_type_version to notice them. Returns the total count and
+    // writes at most max_results ids.
+    uint32_t (*changed_since)(database_o* db,
+                              object_type_t type,
+                              property_handle_t property,
+                              uint64_t version,
+                              object_id_t* results,
+                              uint32_t max_results);
+
+    // Writes the whole database to path. The file is laid out so that
+    // load_from_file can map it and use payloads, columns and blobs in
+    // place, they are only copied once written to or resized.
+    bool (*save_to_file)(database_o* db, const char* path);
+    // Returns a new database, to be freed with destroy, or null if path
+    // couldn't be read. The type handles and object ids of the saved
+    // database stay valid.
+    database_o* (*load_from_file)(mem_allocator_i* alloc,
+                                  const char* path,
+                                  uint32_t flags);
+
+    // Persistent databases : open_heap returns the database living in
+    // the file heap at path, see mem_file_heap_open, creating an empty
+    // one along with the file when needed. Everything it allocates comes
+    // from the heap, so sync_heap only has to write the mapped pages
+    // back, and reopening does no parsing unless the heap has to be
+    // mapped at another address, which moves the pointers stored in it.
+    // destroy syncs and closes the heap, the database is kept : delete
+    // the file to drop it. A crash between two syncs can leave the file
+    // torn, use a journal when that matters. Returns null when the file
+    // isn't a database heap or is already open.
+    database_o* (*open_heap)(const char* path, uint64_t reserve);
+    bool (*sync_heap)(database_o* db);
+
+    // Journaling : once open_journal is called, creations, destructions
+    // and writes are recorded and appended to journal_path by
+    // commit_journal, which syncs the file. Once the journal outgrows
+    // the snapshot, it is folded into a new snapshot at snapshot_path.
+    //
+    // To reopen a database, load the snapshot, replay the journal on it
+    // and open the journal again. open_journal writes a new snapshot
+    // when db doesn't match the journal.
+    bool (*open_journal)(database_o* db,
+                         const char* snapshot_path,
+                         const char* journal_path);
+    bool (*commit_journal)(database_o* db);
+    bool (*compact_journal)(database_o* db);
+    // Commits pending changes. Also done by destroy.
+    void (*close_journal)(database_o* db);
+    // Applies the committed changes of the journal at path, returns the
+    // number of batches applied.
+    uint32_t (*replay_journal)(database_o* db, const char* path);
+
+    // Replicas : publish_replica writes db to the shared memory segment
+    // name, where other processes open it with open_replica. From then
+    // on, commit_journal also appends the batches to a ring of ring_size
+    // bytes in the segment, with or without open_journal. Once the ring
+    // is full, the segment is closed and a new one is published under
+    // the same name, starting from the current state of db.
+    bool (*publish_replica)(database_o* db,
+                            const char* name,
+                            uint64_t ring_size);
+    // Also done by destroy. Removes the segment of a published replica.
+    void (*close_replica)(database_o* db);
+    // Returns a database mapping the segment copy on write, to be read
+    // only. follow_replica applies the batches published since the last
+    // call and counts them in batch_count. It returns false once the
+    // segment is closed and fully applied : open the name again to keep
+    // following.
+    database_o* (*open_replica)(mem_allocator_i* alloc, const char* name);
+    bool (*follow_replica)(database_o* db, uint32_t* batch_count);
 } database_api;
@@ -1,5 +1,8 @@
 #include "hash.h"
 #include "assert.h"
+#include "memory.h"
+
+#include <string.h>
 
 #define KEY_NONE 0
 #define KEY_TUMBSTONE UINT64_MAX
@@ -56,8 +59,39 @@ uint64_t hash_string(const char* txt)
     return h;
 }
 
+// 64 bit FNV-1a
+uint64_t hash_bytes(const void* data, uint64_t size)
+{
+    const uint8_t* bytes = data;
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (uint64_t i = 0; i < size; i++)
+    {
+        h ^= bytes[i];
+        h *= 0x100000001b3ull;
+    }
+
+    return h;
+}
+
+// finalizer of MurmurHash3, a bijection on 64 bit integers
+uint64_t hash_mix(uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ull;
+    key ^= key >> 33;
+
+    return key;
+}
+
 uint64_t hash_find(const hash_t* hash, uint64_t key, uint64_t default_value)
 {
+    if (!hash->bucket_count)
+    {
+        return default_value;
+    }
+
     uint32_t bucket = hash_find_bucket(hash, key);
     if (hash->keys[bucket] == key)
     {
@@ -69,6 +103,11 @@ uint64_t hash_find(const hash_t* hash, uint64_t key, uint64_t default_value)
     }
 }
 
+uint32_t hash_bucket(const hash_t* hash, uint64_t key)
+{
+    return hash->bucket_count ? hash_find_bucket(hash, key) : 0;
+}
+
 void hash_insert(const hash_t* hash, uint64_t key, uint64_t value)
 {
     uint32_t bucket = hash_find_free_bucket(hash, key);
@@ -79,6 +118,11 @@ void hash_insert(const hash_t* hash, uint64_t key, uint64_t value)
 
 void hash_remove(const hash_t* hash, uint64_t key)
 {
+    if (!hash->bucket_count)
+    {
+        return;
+    }
+
     uint32_t bucket = hash_find_bucket(hash, key);
 
     if (hash->keys[bucket] == key)
@@ -86,3 +130,77 @@ void hash_remove(const hash_t* hash, uint64_t key)
         hash->keys[bucket] = KEY_TUMBSTONE;
     }
 }
+
+static void hash_rehash(mem_allocator_i* alloc,
+                        hash_t* hash,
+                        uint32_t bucket_count)
+{
+    hash_t grown = {.bucket_count = bucket_count};
+    grown.keys = mem_alloc(alloc, sizeof(uint64_t) * bucket_count);
+    grown.values = mem_alloc(alloc, sizeof(uint64_t) * bucket_count);
+    memset(grown.keys, 0, sizeof(uint64_t) * bucket_count);
+
+    for (uint32_t i = 0; i < hash->bucket_count; i++)
+    {
+        uint64_t key = hash->keys[i];
+        if (key != KEY_NONE && key != KEY_TUMBSTONE)
+        {
+            hash_insert(&grown, key, hash->values[i]);
+            grown.used++;
+        }
+    }
+
+    hash_free(alloc, hash);
+    *hash = grown;
+}
+
+void hash_set(mem_allocator_i* alloc,
+              hash_t* hash,
+              uint64_t key,
+              uint64_t value)
+{
+    // overwriting a key takes no room
+    uint32_t bucket = hash->bucket_count ? hash_find_bucket(hash, key) : 0;
+    if (hash->bucket_count && hash->keys[bucket] == key)
+    {
+        hash->values[bucket] = value;
+        return;
+    }
+
+    if (2 * (hash->used + 1) > hash->bucket_count)
+    {
+        // Sized from the live keys, tombstones are dropped : tables
+        // where keys are removed and added again don't grow.
+        uint32_t live = 0;
+        for (uint32_t i = 0; i < hash->bucket_count; i++)
+        {
+            live += hash->keys[i] != KEY_NONE && hash->keys[i] != KEY_TUMBSTONE;
+        }
+        uint32_t bucket_count = 16;
+        while (bucket_count < 3 * (live + 1))
+        {
+            bucket_count *= 2;
+        }
+        hash_rehash(alloc, hash, bucket_count);
+    }
+
+    bucket = hash_find_free_bucket(hash, key);
+    if (hash->keys[bucket] == KEY_NONE)
+    {
+        hash->used++;
+    }
+
+    hash->keys[bucket] = key;
+    hash->values[bucket] = value;
+}
+
+void hash_free(mem_allocator_i* alloc, hash_t* hash)
+{
+    if (hash->bucket_count)
+    {
+        mem_free(alloc, hash->keys, sizeof(uint64_t) * hash->bucket_count);
+        mem_free(alloc, hash->values, sizeof(uint64_t) * hash->bucket_count);
+    }
+
+    *hash = (hash_t){0};
+}
@@ -2,9 +2,12 @@
 
 #include "base_types.h"
 
+typedef struct mem_allocator_i mem_allocator_i;
+
 typedef struct hash_t
 {
     uint32_t bucket_count;
+    uint32_t used; // growable tables only, counts tombstones
     uint64_t* keys;
     uint64_t* values;
 } hash_t;
@@ -12,6 +15,20 @@ typedef struct hash_t
 uint64_t hash_find(const hash_t* hash, uint64_t key, uint64_t default_value);
 void hash_insert(const hash_t* hash, uint64_t key, uint64_t value);
 void hash_remove(const hash_t* hash, uint64_t key);
+// Bucket holding key, or the empty one its lookup stops at.
+uint32_t hash_bucket(const hash_t* hash, uint64_t key);
+
+// Growable tables : keys and values are allocated from alloc and the
+// table is rehashed to keep it at most half full, tombstones included.
+// Rehashing sizes it from the live keys, so it also shrinks. Start from
+// a zeroed hash_t.
+void hash_set(mem_allocator_i* alloc,
+              hash_t* hash,
+              uint64_t key,
+              uint64_t value);
+void hash_free(mem_allocator_i* alloc, hash_t* hash);
 
 uint64_t hash_combine(uint64_t base, uint64_t n);
 uint64_t hash_string(const char* txt);
+uint64_t hash_bytes(const void* data, uint64_t size);
+uint64_t hash_mix(uint64_t key);
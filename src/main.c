@@ -19,6 +19,8 @@
 #include "plugin_manager.h"
 #include "renderer.h"
 #include "stretchy_buffer.h"
+#include "string_intern.h"
+#include "test_item_accessors.h"
 #include "ui.h"
 #include "util.h"
 
@@ -59,92 +61,2104 @@ static void test_hash()
     ASSERT(!hash_find(&h, 1234567, 0));
     ASSERT(hash_find(&h, 65, 0) == 65);
 
+    // growable tables don't grow from keys removed and set again
+    hash_t grown = {0};
+    hash_set(mem_std_alloc, &grown, 7, 7);
+    for (uint64_t key = 1000; key < 101000; key++)
+    {
+        hash_set(mem_std_alloc, &grown, key, key);
+        hash_set(mem_std_alloc, &grown, key, key + 1);
+        hash_remove(&grown, key);
+    }
+    ASSERT(grown.bucket_count <= 16);
+    ASSERT(hash_find(&grown, 7, 0) == 7);
+    for (uint64_t key = 1; key <= 1000; key++)
+    {
+        hash_set(mem_std_alloc, &grown, key, key);
+    }
+    ASSERT(grown.bucket_count >= 2000 && grown.bucket_count <= 4096);
+    ASSERT(hash_find(&grown, 7, 0) == 7 && hash_find(&grown, 999, 0) == 999);
+    hash_free(mem_std_alloc, &grown);
+
     log_flush();
 }
 
-typedef struct blob_t
+typedef struct blob_t
+{
+    int u;
+    char w[43];
+    float x;
+} blob_t;
+
+static void test_db(database_api* db)
+{
+    database_o* mydb = db->create(mem_std_alloc);
+
+    property_definition_t props[] = {
+        {.name = "active", .type = PTYPE_BOOL},
+        {.name = "x", .type = PTYPE_FLOAT64},
+        {.name = "y", .type = PTYPE_FLOAT64},
+        {.name = "blob", .type = PTYPE_BLOB},
+    };
+    object_type_t typ =
+        db->add_object_type(mydb, STATIC_ARRAY_COUNT(props), props);
+
+    property_definition_t nprops[] = {
+        {.name = "subobject", .type = PTYPE_OBJECT, .object_type = typ},
+        {.name = "reference", .type = PTYPE_REFERENCE, .object_type = typ},
+    };
+    object_type_t ntyp =
+        db->add_object_type(mydb, STATIC_ARRAY_COUNT(nprops), nprops);
+
+    log_debug("typ = %u", typ.index);
+
+    object_id_t nobj = db->create_object(mydb, ntyp);
+    object_id_t obj = db->create_object(mydb, typ);
+    blob_t my_blob = {-12, "123", 3.14f};
+
+    db->reallocate_blob(mydb, obj, "blob", sizeof(blob_t));
+    db->set_blob_data(mydb, obj, "blob", 0, sizeof(blob_t), &my_blob);
+
+    object_id_t obj2 = db->get_sub_object(mydb, nobj, "subobject");
+    db->reallocate_blob(mydb, obj2, "blob", sizeof(blob_t));
+    db->set_blob_data(mydb, obj2, "blob", 0, sizeof(blob_t), &my_blob);
+
+    db->set_float64(mydb, obj, "x", 3.0);
+
+    property_handle_t x_prop = db->find_property(mydb, typ, "x");
+    ASSERT(x_prop.index);
+    ASSERT(!db->find_property(mydb, typ, "z").index);
+    ASSERT(db->get_float64_h(mydb, obj, x_prop) == 3.0);
+    ASSERT(!db->set_float64_h(mydb, nobj, x_prop, 1.0));
+    ASSERT(db->get_float64_or_h(mydb, nobj, x_prop, -1.) == -1.);
+
+    for (uint32_t i = 0; i < 100; i++)
+    {
+        object_id_t id = db->create_object(mydb, typ);
+
+        log_debug("ID : %u %u %u",
+                  id.info.type.index,
+                  id.info.generation,
+                  id.info.slot);
+    }
+    log_debug("obj.x = %g", db->get_float64(mydb, obj, "x"));
+    db->get_blob_data(mydb, obj, "blob", 0, sizeof(blob_t), &my_blob);
+    log_debug("obj.blob = { .u = %d, .w = \"%s\", .x = %f }",
+              my_blob.u,
+              my_blob.w,
+              my_blob.x);
+
+    object_id_t id = db->create_object(mydb, typ);
+    db->set_float64(mydb, id, "x", 53.);
+    log_debug("slot = %u, gen = %u, x = %g",
+              id.info.slot,
+              id.info.generation,
+              db->get_float64(mydb, id, "x"));
+
+    db->destroy_object(mydb, id);
+
+    for (uint32_t i = 0; i < 66000; i++)
+    {
+        object_id_t new_object = db->create_object(mydb, ntyp);
+        ASSERT(new_object.info.type.index == ntyp.index);
+        double xval = db->get_float64_or(mydb, id, "x", -1.);
+        if (xval != -1.)
+        {
+            log_debug("i = %u, slot = %u, gen = %u, x = %g",
+                      i,
+                      new_object.info.slot,
+                      new_object.info.generation,
+                      xval);
+        }
+        db->destroy_object(mydb, new_object);
+    }
+
+    db->destroy(mydb);
+}
+
+static void test_db_columns(database_api* db)
+{
+    database_o* mydb = db->create(mem_std_alloc);
+
+    property_definition_t props[] = {
+        {.name = "x", .type = PTYPE_FLOAT64},
+        {.name = "id", .type = PTYPE_UINT32},
+    };
+    object_type_t typ = db->add_object_type_ex(mydb,
+                                               STATIC_ARRAY_COUNT(props),
+                                               props,
+                                               OBJECT_TYPE_COLUMNAR);
+    property_handle_t x_prop = db->find_property(mydb, typ, "x");
+    property_handle_t id_prop = db->find_property(mydb, typ, "id");
+
+    object_id_t ids[100];
+    for (uint32_t i = 0; i < STATIC_ARRAY_COUNT(ids); i++)
+    {
+        ids[i] = db->create_object(mydb, typ);
+        db->set_float64_h(mydb, ids[i], x_prop, (double)i);
+        db->set_uint32_h(mydb, ids[i], id_prop, i);
+    }
+
+    for (uint32_t i = 0; i < STATIC_ARRAY_COUNT(ids); i += 2)
+    {
+        db->destroy_object(mydb, ids[i]);
+    }
+
+    uint32_t count;
+    const double* xs = db->get_column(mydb, typ, x_prop, &count);
+    ASSERT(count == STATIC_ARRAY_COUNT(ids) / 2);
+
+    double sum = 0.;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        sum += xs[i];
+    }
+    ASSERT(sum == 2500.);
+
+    for (uint32_t i = 1; i < STATIC_ARRAY_COUNT(ids); i += 2)
+    {
+        ASSERT(db->get_float64_h(mydb, ids[i], x_prop) == (double)i);
+        ASSERT(db->get_uint32_h(mydb, ids[i], id_prop) == i);
+    }
+
+    db->destroy(mydb);
+}
+
+static void count_object(database_o* db, object_id_t id, void* user_data)
+{
+    (void)db;
+    (void)id;
+    (*(uint32_t*)user_data)++;
+}
+
+static void test_db_iteration(database_api* db)
+{
+    database_o* mydb = db->create(mem_std_alloc);
+
+    property_definition_t props[] = {
+        {.name = "key", .type = PTYPE_UINT64},
+    };
+    object_type_t a = db->add_object_type(mydb, 1, props);
+    object_type_t b = db->add_object_type(mydb, 1, props);
+
+    for (uint32_t i = 0; i < 10; i++)
+    {
+        db->create_object(mydb, a);
+        db->create_object(mydb, b);
+        db->create_object(mydb, b);
+    }
+    ASSERT(db->object_count(mydb, a) == 10);
+    ASSERT(db->object_count(mydb, b) == 20);
+
+    uint32_t visited = 0;
+    db->for_each_object(mydb, b, count_object, &visited);
+    ASSERT(visited == 20);
+
+    // destroying the current object while iterating is allowed
+    object_iterator_t it = db->begin_iteration(mydb, b);
+    object_id_t id;
+    visited = 0;
+    while (db->next_object(mydb, &it, &id))
+    {
+        ASSERT(id.info.type.index == b.index);
+        db->destroy_object(mydb, id);
+        visited++;
+    }
+    ASSERT(visited == 20);
+    ASSERT(db->object_count(mydb, b) == 0);
+    ASSERT(db->object_count(mydb, a) == 10);
+
+    db->destroy(mydb);
+}
+
+static void test_db_indexes(database_api* db)
+{
+    database_o* mydb = db->create(mem_std_alloc);
+
+    property_definition_t props[] = {
+        {.name = "key", .type = PTYPE_UINT64, .flags = PROPERTY_INDEX_HASH},
+        {.name = "x", .type = PTYPE_FLOAT64, .flags = PROPERTY_INDEX_ORDERED},
+        {.name = "y", .type = PTYPE_INT32},
+    };
+    object_type_t typ =
+        db->add_object_type(mydb, STATIC_ARRAY_COUNT(props), props);
+    property_handle_t key = db->find_property(mydb, typ, "key");
+    property_handle_t x = db->find_property(mydb, typ, "x");
+    property_handle_t y = db->find_property(mydb, typ, "y");
+
+    object_id_t ids[100];
+    for (uint32_t i = 0; i < STATIC_ARRAY_COUNT(ids); i++)
+    {
+        ids[i] = db->create_object(mydb, typ);
+        db->set_uint64_h(mydb, ids[i], key, i % 10);
+        db->set_float64_h(mydb, ids[i], x, (double)i - 50.);
+        db->set_int32_h(mydb, ids[i], y, -(int32_t)i);
+    }
+
+    object_id_t found[16];
+    ASSERT(db->find_uint64(mydb, key, 3, found, 16) == 10);
+    for (uint32_t i = 0; i < 10; i++)
+    {
+        ASSERT(db->get_uint64_h(mydb, found[i], key) == 3);
+    }
+    ASSERT(db->find_float64_range(mydb, x, -10., -0.5, found, 16) == 10);
+    ASSERT(db->get_float64_h(mydb, found[0], x) == -10.);
+    ASSERT(db->find_int32_range(mydb, y, -3, 0, found, 16) == 4);
+
+    db->destroy_object(mydb, ids[3]);
+    db->set_uint64_h(mydb, ids[13], key, 42);
+    ASSERT(db->find_uint64(mydb, key, 3, found, 16) == 8);
+    ASSERT(db->find_uint64(mydb, key, 42, found, 16) == 1);
+    ASSERT(found[0].index == ids[13].index);
+
+    property_index_stats_t stats;
+    ASSERT(db->get_index_stats(mydb, key, &stats) && stats.entry_count == 99);
+    ASSERT(!db->get_index_stats(mydb, y, &stats));
+
+    db->destroy(mydb);
+}
+
+static void test_db_references(database_api* db)
+{
+    database_o* mydb = db->create(mem_std_alloc);
+
+    property_definition_t target_props[] = {
+        {.name = "x", .type = PTYPE_FLOAT64},
+    };
+    object_type_t target_type = db->add_object_type(mydb, 1, target_props);
+
+    property_definition_t props[] = {
+        {.name = "strong", .type = PTYPE_REFERENCE, .object_type = target_type},
+        {.name = "weak",
+         .type = PTYPE_REFERENCE,
+         .object_type = target_type,
+         .flags = PROPERTY_NULL_ON_DESTROY},
+    };
+    object_type_t typ =
+        db->add_object_type(mydb, STATIC_ARRAY_COUNT(props), props);
+    property_handle_t strong = db->find_property(mydb, typ, "strong");
+    property_handle_t weak = db->find_property(mydb, typ, "weak");
+
+    object_id_t target = db->create_object(mydb, target_type);
+    object_id_t other = db->create_object(mydb, target_type);
+    object_id_t sources[10];
+    for (uint32_t i = 0; i < STATIC_ARRAY_COUNT(sources); i++)
+    {
+        sources[i] = db->create_object(mydb, typ);
+        db->set_reference_h(mydb, sources[i], strong, target);
+        db->set_reference_h(mydb, sources[i], weak, target);
+    }
+    db->set_reference_h(mydb, sources[0], strong, other);
+    db->destroy_object(mydb, sources[1]);
+
+    object_id_t referrers[32];
+    property_handle_t referrer_props[32];
+    ASSERT(db->get_referrers(mydb, target, referrers, referrer_props, 32)
+           == 17);
+    ASSERT(db->get_referrers(mydb, other, referrers, referrer_props, 32)
+           == 1);
+    ASSERT(referrers[0].index == sources[0].index);
+    ASSERT(referrer_props[0].index == strong.index);
+
+    db->destroy_object(mydb, target);
+    for (uint32_t i = 2; i < STATIC_ARRAY_COUNT(sources); i++)
+    {
+        ASSERT(!db->get_reference_h(mydb, sources[i], weak).index);
+        ASSERT(db->get_reference_h(mydb, sources[i], strong).index
+               == target.index);
+    }
+
+    // the slot of target is reused, it must not inherit its referrers
+    object_id_t reused = db->create_object(mydb, target_type);
+    ASSERT(reused.info.slot == target.info.slot);
+    ASSERT(!db->get_referrers(mydb, reused, referrers, 0, 32));
+
+    db->destroy(mydb);
+}
+
+static void test_db_versions(database_api* db)
+{
+    database_o* mydb = db->create(mem_std_alloc);
+
+    property_definition_t props[] = {
+        {.name = "x", .type = PTYPE_FLOAT64, .flags = PROPERTY_TRACK_CHANGES},
+        {.name = "y", .type = PTYPE_FLOAT64},
+        {.name = "blob", .type = PTYPE_BLOB},
+    };
+    object_type_t typ =
+        db->add_object_type(mydb, STATIC_ARRAY_COUNT(props), props);
+    property_handle_t x = db->find_property(mydb, typ, "x");
+    property_handle_t y = db->find_property(mydb, typ, "y");
+    property_handle_t blob = db->find_property(mydb, typ, "blob");
+
+    object_id_t ids[10];
+    for (uint32_t i = 0; i < STATIC_ARRAY_COUNT(ids); i++)
+    {
+        ids[i] = db->create_object(mydb, typ);
+    }
+
+    uint64_t v0 = db->get_version(mydb);
+    object_id_t changed[10];
+    ASSERT(!db->changed_since(mydb, typ, (property_handle_t){0}, v0, 0, 0));
+
+    db->set_float64_h(mydb, ids[2], y, 1.);
+    db->set_float64_h(mydb, ids[5], x, 1.);
+    db->reallocate_blob_h(mydb, ids[7], blob, 16);
+    ASSERT(db->get_object_version(mydb, ids[5]) > v0);
+    ASSERT(db->get_property_version(mydb, ids[2], x) <= v0);
+    ASSERT(db->changed_since(mydb, typ, (property_handle_t){0}, v0, changed, 10)
+           == 3);
+    ASSERT(db->changed_since(mydb, typ, x, v0, changed, 10) == 1);
+    ASSERT(changed[0].index == ids[5].index);
+
+    uint64_t v1 = db->get_version(mydb);
+    db->destroy_object(mydb, ids[0]);
+    ASSERT(db->get_type_version(mydb, typ) > v1);
+    ASSERT(!db->changed_since(mydb, typ, (property_handle_t){0}, v1, 0, 0));
+
+    db->destroy(mydb);
+}
+
+static void test_db_blob_views(database_api* db)
+{
+    database_o* mydb = db->create(mem_std_alloc);
+
+    property_definition_t props[] = {
+        {.name = "pixels", .type = PTYPE_BLOB},
+    };
+    object_type_t typ =
+        db->add_object_type(mydb, STATIC_ARRAY_COUNT(props), props);
+    property_handle_t pixels = db->find_property(mydb, typ, "pixels");
+    object_id_t id = db->create_object(mydb, typ);
+
+    ASSERT(!db->read_blob_h(mydb, id, pixels).data);
+    db->reallocate_blob_h(mydb, id, pixels, 16);
+
+    // ranges ending at the end of the blob are valid
+    uint8_t bytes[16] = {1, 2, 3};
+    ASSERT(db->set_blob_data_h(mydb, id, pixels, 0, 16, bytes));
+    ASSERT(db->get_blob_data_h(mydb, id, pixels, 8, 8, bytes));
+    ASSERT(!db->get_blob_data_h(mydb, id, pixels, 8, 9, bytes));
+
+    blob_mut_view_t out = db->write_blob_h(mydb, id, pixels);
+    ASSERT(out.size == 16);
+    uint64_t v0 = db->get_object_version(mydb, id);
+    ((uint8_t*)out.data)[15] = 42;
+    ASSERT(db->mark_blob_dirty_h(mydb, id, pixels, 15, 1));
+    ASSERT(!db->mark_blob_dirty_h(mydb, id, pixels, 15, 2));
+    ASSERT(db->get_object_version(mydb, id) > v0);
+
+    blob_view_t in = db->read_blob_h(mydb, id, pixels);
+    ASSERT(in.data == out.data && in.size == 16);
+    ASSERT(((const uint8_t*)in.data)[2] == 3);
+    ASSERT(((const uint8_t*)in.data)[15] == 42);
+
+    db->destroy(mydb);
+}
+
+static void test_db_blob_store(database_api* db)
+{
+    database_o* mydb = db->create(mem_std_alloc);
+
+    property_definition_t props[] = {
+        {.name = "texture", .type = PTYPE_BLOB},
+    };
+    object_type_t typ =
+        db->add_object_type(mydb, STATIC_ARRAY_COUNT(props), props);
+    property_handle_t texture = db->find_property(mydb, typ, "texture");
+
+    uint8_t pixels[1024];
+    for (uint32_t i = 0; i < sizeof(pixels); i++)
+    {
+        pixels[i] = (uint8_t)i;
+    }
+
+    object_id_t ids[10];
+    for (uint32_t i = 0; i < STATIC_ARRAY_COUNT(ids); i++)
+    {
+        ids[i] = db->create_object(mydb, typ);
+        db->set_blob_h(mydb, ids[i], texture, pixels, sizeof(pixels));
+    }
+
+    blob_store_stats_t stats;
+    db->get_blob_stats(mydb, &stats);
+    ASSERT(stats.reference_count == 10 && stats.unique_count == 1);
+    ASSERT(stats.bytes_saved == 9 * sizeof(pixels));
+    ASSERT(stats.dedup_ratio == 10.);
+
+    // writes copy the shared payload first
+    uint8_t byte = 0xff;
+    ASSERT(db->set_blob_data_h(mydb, ids[0], texture, 5, 1, &byte));
+    ASSERT(((const uint8_t*)db->read_blob_h(mydb, ids[1], texture).data)[5]
+           == 5);
+    db->get_blob_stats(mydb, &stats);
+    ASSERT(stats.unique_count == 2);
+
+    // until written back to the same bytes and deduplicated
+    byte = 5;
+    ASSERT(db->set_blob_data_h(mydb, ids[0], texture, 5, 1, &byte));
+    ASSERT(db->deduplicate_blobs(mydb) == 1);
+    db->get_blob_stats(mydb, &stats);
+    ASSERT(stats.unique_count == 1);
+
+    object_id_t copy = db->create_object(mydb, typ);
+    ASSERT(db->copy_blob_h(mydb, copy, texture, ids[3], texture));
+    ASSERT(db->read_blob_h(mydb, copy, texture).data
+           == db->read_blob_h(mydb, ids[3], texture).data);
+
+    for (uint32_t i = 0; i < STATIC_ARRAY_COUNT(ids); i++)
+    {
+        db->destroy_object(mydb, ids[i]);
+    }
+    db->destroy_object(mydb, copy);
+    db->get_blob_stats(mydb, &stats);
+    ASSERT(!stats.reference_count && !stats.stored_bytes);
+
+    db->destroy(mydb);
+}
+
+static void test_db_sub_objects(database_api* db)
+{
+    database_o* mydb = db->create(mem_std_alloc);
+
+    property_definition_t leaf_props[] = {
+        {.name = "value", .type = PTYPE_FLOAT64},
+    };
+    object_type_t leaf =
+        db->add_object_type(mydb, STATIC_ARRAY_COUNT(leaf_props), leaf_props);
+
+    property_definition_t wide_props[] = {
+        {.name = "a", .type = PTYPE_OBJECT, .object_type = leaf},
+        {.name = "b", .type = PTYPE_OBJECT, .object_type = leaf},
+        {.name = "c", .type = PTYPE_OBJECT, .object_type = leaf},
+    };
+    object_type_t wide =
+        db->add_object_type(mydb, STATIC_ARRAY_COUNT(wide_props), wide_props);
+    property_handle_t b = db->find_property(mydb, wide, "b");
+
+    object_id_t ids[100];
+    for (uint32_t i = 0; i < STATIC_ARRAY_COUNT(ids); i++)
+    {
+        ids[i] = db->create_object(mydb, wide);
+    }
+    ASSERT(db->object_count(mydb, leaf) == 0);
+
+    object_id_t sub = db->get_sub_object_h(mydb, ids[7], b);
+    ASSERT(sub.info.type.index == leaf.index);
+    ASSERT(db->get_sub_object_h(mydb, ids[7], b).index == sub.index);
+    ASSERT(db->object_count(mydb, leaf) == 1);
+
+    for (uint32_t i = 0; i < STATIC_ARRAY_COUNT(ids); i++)
+    {
+        db->destroy_object(mydb, ids[i]);
+    }
+    ASSERT(db->object_count(mydb, leaf) == 0);
+
+    db->destroy(mydb);
+}
+
+static void test_db_layout(database_api* db)
+{
+    database_o* mydb = db->create(mem_std_alloc);
+
+    property_definition_t props[] = {
+        {.name = "visible", .type = PTYPE_BOOL},
+        {.name = "x", .type = PTYPE_FLOAT64},
+        {.name = "flags", .type = PTYPE_UINT16},
+        {.name = "label", .type = PTYPE_BLOB},
+        {.name = "created", .type = PTYPE_INT32, .flags = PROPERTY_COLD},
+        {.name = "comment", .type = PTYPE_BLOB, .flags = PROPERTY_COLD},
+    };
+    object_type_t typ =
+        db->add_object_type(mydb, STATIC_ARRAY_COUNT(props), props);
+
+    type_layout_info_t layout;
+    ASSERT(db->get_type_layout(mydb, typ, &layout));
+    ASSERT(layout.hot_bytes == 8 + 16 + 2 + sizeof(bool));
+    ASSERT(layout.cold_bytes == 24);
+    ASSERT(layout.padding_bytes == 4);
+
+    for (uint32_t i = 0; i < STATIC_ARRAY_COUNT(props); i++)
+    {
+        property_handle_t h = db->find_property(mydb, typ, props[i].name);
+        property_layout_info_t info;
+        ASSERT(db->get_property_layout(mydb, typ, h, &info));
+        ASSERT(info.offset % info.alignment == 0);
+        ASSERT(info.cold == ((props[i].flags & PROPERTY_COLD) != 0));
+    }
+
+    object_id_t ids[40];
+    for (uint32_t i = 0; i < STATIC_ARRAY_COUNT(ids); i++)
+    {
+        ids[i] = db->create_object(mydb, typ);
+        db->set_float64(mydb, ids[i], "x", i);
+        db->set_int32(mydb, ids[i], "created", -(int32_t)i);
+    }
+    db->destroy_object(mydb, ids[3]);
+    ASSERT(db->get_int32(mydb, ids[39], "created") == -39);
+    ASSERT(db->get_float64(mydb, ids[39], "x") == 39.);
+    ASSERT(db->get_int32(mydb, ids[4], "created") == -4);
+
+    db->destroy(mydb);
+}
+
+static void test_db_bulk(database_api* db)
+{
+    database_o* mydb = db->create(mem_std_alloc);
+
+    property_definition_t props[] = {
+        {.name = "x", .type = PTYPE_FLOAT64, .flags = PROPERTY_INDEX_ORDERED},
+        {.name = "key", .type = PTYPE_UINT32, .flags = PROPERTY_INDEX_HASH},
+    };
+    object_type_t typ =
+        db->add_object_type(mydb, STATIC_ARRAY_COUNT(props), props);
+    property_handle_t x = db->find_property(mydb, typ, "x");
+    property_handle_t key = db->find_property(mydb, typ, "key");
+
+    object_id_t ids[1000];
+    double xs[STATIC_ARRAY_COUNT(ids)];
+    uint32_t keys[STATIC_ARRAY_COUNT(ids)];
+    uint32_t count = STATIC_ARRAY_COUNT(ids);
+    ASSERT(db->create_objects(mydb, typ, count, ids) == count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        xs[i] = (double)(count - i);
+        keys[i] = i % 7;
+    }
+    ASSERT(db->set_values_h(mydb, x, ids, count, xs) == count);
+    ASSERT(db->set_values_h(mydb, key, ids, count, keys) == count);
+    ASSERT(db->get_float64_h(mydb, ids[10], x) == count - 10.);
+
+    object_id_t found[8];
+    ASSERT(db->find_float64_range(mydb, x, 1., 5., found, 8) == 5);
+    ASSERT(db->get_float64_h(mydb, found[0], x) == 1.);
+    ASSERT(db->find_uint32(mydb, key, 3, found, 8) == 143);
+
+    db->destroy_objects(mydb, ids, count / 2);
+    ASSERT(db->find_float64_range(mydb, x, 0., 1e9, found, 8) == count / 2);
+    ASSERT(db->set_values_h(mydb, x, ids, count, xs) == count / 2);
+
+    db->destroy(mydb);
+}
+
+static void test_db_clone(database_api* db)
+{
+    database_o* mydb = db->create(mem_std_alloc);
+
+    property_definition_t leaf_props[] = {
+        {.name = "value", .type = PTYPE_FLOAT64},
+    };
+    object_type_t leaf =
+        db->add_object_type(mydb, STATIC_ARRAY_COUNT(leaf_props), leaf_props);
+    property_handle_t value = db->find_property(mydb, leaf, "value");
+
+    property_definition_t item_props[] = {
+        {.name = "key", .type = PTYPE_INT32, .flags = PROPERTY_INDEX_HASH},
+        {.name = "name", .type = PTYPE_BLOB},
+        {.name = "parent", .type = PTYPE_REFERENCE, .object_type = leaf},
+        {.name = "note", .type = PTYPE_BLOB, .flags = PROPERTY_COLD},
+    };
+    object_type_t item =
+        db->add_object_type(mydb, STATIC_ARRAY_COUNT(item_props), item_props);
+    property_handle_t key = db->find_property(mydb, item, "key");
+    property_handle_t name = db->find_property(mydb, item, "name");
+    property_handle_t parent = db->find_property(mydb, item, "parent");
+
+    property_definition_t group_props[] = {
+        {.name = "child", .type = PTYPE_OBJECT, .object_type = leaf},
+    };
+    object_type_t group =
+        db->add_object_type(mydb, STATIC_ARRAY_COUNT(group_props), group_props);
+    property_handle_t child = db->find_property(mydb, group, "child");
+
+    object_id_t target = db->create_object(mydb, leaf);
+    object_id_t original = db->create_object(mydb, item);
+    db->set_int32_h(mydb, original, key, 5);
+    db->set_blob_h(mydb, original, name, "first", 6);
+    db->set_reference_h(mydb, original, parent, target);
+
+    object_id_t copies[2] = {
+        db->clone_object(mydb, original),
+        db->clone_object_cow(mydb, original),
+    };
+    object_id_t found[4];
+    ASSERT(db->find_int32(mydb, key, 5, found, 4) == 3);
+    ASSERT(db->get_referrers(mydb, target, found, 0, 4) == 3);
+
+    char text[6];
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        ASSERT(db->get_reference_h(mydb, copies[i], parent).index
+               == target.index);
+        db->set_blob_data_h(mydb, copies[i], name, 0, 1, "F");
+        ASSERT(db->get_blob_data_h(mydb, original, name, 0, 6, text));
+        ASSERT(!strcmp(text, "first"));
+        db->set_int32_h(mydb, copies[i], key, 6 + i);
+    }
+    ASSERT(db->get_int32_h(mydb, original, key) == 5);
+
+    ASSERT(db->get_blob_data_h(mydb, copies[1], name, 0, 6, text));
+    ASSERT(!strcmp(text, "First"));
+
+    // the last holder of a shared payload owns it
+    object_id_t snapshot = db->clone_object_cow(mydb, original);
+    db->destroy_object(mydb, original);
+    ASSERT(db->get_blob_data_h(mydb, snapshot, name, 0, 6, text));
+    ASSERT(!strcmp(text, "first"));
+    ASSERT(db->get_int32_h(mydb, snapshot, key) == 5);
+    db->destroy_object(mydb, snapshot);
+
+    object_id_t outer = db->create_object(mydb, group);
+    object_id_t inner = db->get_sub_object_h(mydb, outer, child);
+    db->set_float64_h(mydb, inner, value, 2.);
+    object_id_t outer_copy = db->clone_object_cow(mydb, outer);
+    object_id_t inner_copy = db->get_sub_object_h(mydb, outer_copy, child);
+    ASSERT(inner_copy.index != inner.index);
+    ASSERT(db->get_float64_h(mydb, inner_copy, value) == 2.);
+
+    db->destroy(mydb);
+}
+
+static void test_db_snapshots(database_api* db)
+{
+    database_o* mydb = db->create(mem_std_alloc);
+
+    property_definition_t props[] = {
+        {.name = "x", .type = PTYPE_FLOAT64},
+        {.name = "name", .type = PTYPE_BLOB},
+        {.name = "count", .type = PTYPE_UINT32, .flags = PROPERTY_COLD},
+    };
+    object_type_t typ =
+        db->add_object_type(mydb, STATIC_ARRAY_COUNT(props), props);
+    object_type_t col = db->add_object_type_ex(mydb,
+                                               STATIC_ARRAY_COUNT(props),
+                                               props,
+                                               OBJECT_TYPE_COLUMNAR);
+    property_handle_t x = db->find_property(mydb, typ, "x");
+    property_handle_t name = db->find_property(mydb, typ, "name");
+    property_handle_t count = db->find_property(mydb, typ, "count");
+    property_handle_t col_x = db->find_property(mydb, col, "x");
+
+    object_id_t ids[10];
+    for (uint32_t i = 0; i < STATIC_ARRAY_COUNT(ids); i++)
+    {
+        ids[i] = db->create_object(mydb, typ);
+        db->set_float64_h(mydb, ids[i], x, i);
+        db->set_blob_h(mydb, ids[i], name, "old", 4);
+        db->set_uint32_h(mydb, ids[i], count, i);
+    }
+    object_id_t cell = db->create_object(mydb, col);
+    db->set_float64_h(mydb, cell, col_x, 1.);
+
+    database_snapshot_o* before = db->acquire_snapshot(mydb);
+    for (uint32_t i = 0; i < STATIC_ARRAY_COUNT(ids); i += 2)
+    {
+        db->set_float64_h(mydb, ids[i], x, -1.);
+        db->set_blob_data_h(mydb, ids[i], name, 0, 3, "new");
+        db->set_uint32_h(mydb, ids[i], count, 100);
+    }
+    db->destroy_object(mydb, ids[1]);
+    db->set_float64_h(mydb, cell, col_x, 2.);
+    object_id_t created = db->create_object(mydb, typ);
+
+    // later snapshots see the writes, earlier ones don't
+    database_snapshot_o* after = db->acquire_snapshot(mydb);
+    ASSERT(db->get_snapshot_version(after) > db->get_snapshot_version(before));
+
+    object_id_t listed[16];
+    ASSERT(db->get_snapshot_objects(before, typ, 0, listed, 16) == 10);
+    ASSERT(db->get_snapshot_objects(after, typ, 0, listed, 16) == 10);
+
+    for (uint32_t i = 0; i < STATIC_ARRAY_COUNT(ids); i++)
+    {
+        double value;
+        uint32_t n;
+        ASSERT(db->read_snapshot_h(before, ids[i], x, &value, sizeof(value)));
+        ASSERT(value == i);
+        ASSERT(db->read_snapshot_h(before, ids[i], count, &n, sizeof(n)));
+        ASSERT(n == i);
+        blob_view_t text = db->read_snapshot_blob_h(before, ids[i], name);
+        ASSERT(text.size == 4 && !strcmp(text.data, "old"));
+
+        if (i == 1)
+        {
+            ASSERT(!db->read_snapshot_h(after, ids[i], x, &value, 8));
+            continue;
+        }
+        ASSERT(db->read_snapshot_h(after, ids[i], x, &value, sizeof(value)));
+        ASSERT(value == (i % 2 ? i : -1.));
+        text = db->read_snapshot_blob_h(after, ids[i], name);
+        ASSERT(!strcmp(text.data, i % 2 ? "old" : "new"));
+    }
+
+    double value;
+    ASSERT(db->read_snapshot_h(before, cell, col_x, &value, sizeof(value)));
+    ASSERT(value == 1.);
+    ASSERT(!db->read_snapshot_h(before, created, x, &value, sizeof(value)));
+    ASSERT(db->read_snapshot_h(after, created, x, &value, sizeof(value)));
+
+    // old payloads are freed by the next write
+    db->release_snapshot(before);
+    db->set_float64_h(mydb, ids[0], x, -2.);
+    ASSERT(db->read_snapshot_h(after, ids[0], x, &value, sizeof(value)));
+    ASSERT(value == -1.);
+    db->release_snapshot(after);
+
+    // Hot writes following a cold one still leave the payload snapshots
+    // read alone, and snapshots share the chunks left unchanged.
+    object_id_t many[3000];
+    for (uint32_t i = 0; i < STATIC_ARRAY_COUNT(many); i++)
+    {
+        many[i] = db->create_object(mydb, typ);
+        db->set_float64_h(mydb, many[i], x, i);
+    }
+    database_snapshot_o* first = db->acquire_snapshot(mydb);
+    db->set_uint32_h(mydb, many[0], count, 1);
+    db->set_float64_h(mydb, many[0], x, -1.);
+    database_snapshot_o* second = db->acquire_snapshot(mydb);
+    db->destroy_object(mydb, many[0]);
+    db->set_float64_h(mydb, many[2999], x, -1.);
+    ASSERT(db->read_snapshot_h(first, many[0], x, &value, 8) && value == 0.);
+    db->release_snapshot(first);
+    database_snapshot_o* third = db->acquire_snapshot(mydb);
+    for (uint32_t i = 0; i < STATIC_ARRAY_COUNT(many); i++)
+    {
+        ASSERT(db->read_snapshot_h(second, many[i], x, &value, 8));
+        ASSERT(value == (i ? i : -1.));
+        ASSERT(db->read_snapshot_h(third, many[i], x, &value, 8) == (i > 0));
+        ASSERT(!i || value == (i == 2999 ? -1. : i));
+    }
+    db->release_snapshot(second);
+    db->release_snapshot(third);
+
+    db->destroy(mydb);
+}
+
+static void test_db_transactions(database_api* db)
+{
+    database_o* mydb = db->create(mem_std_alloc);
+
+    property_definition_t node_props[] = {
+        {.name = "id", .type = PTYPE_UINT32},
+    };
+    object_type_t node =
+        db->add_object_type(mydb, STATIC_ARRAY_COUNT(node_props), node_props);
+
+    property_definition_t props[] = {
+        {.name = "x", .type = PTYPE_FLOAT64, .flags = PROPERTY_INDEX_ORDERED},
+        {.name = "name", .type = PTYPE_BLOB},
+        {.name = "next", .type = PTYPE_REFERENCE, .object_type = node},
+        {.name = "nodes", .type = PTYPE_REFERENCE_ARRAY, .object_type = node},
+    };
+    object_type_t typ =
+        db->add_object_type(mydb, STATIC_ARRAY_COUNT(props), props);
+    property_handle_t x = db->find_property(mydb, typ, "x");
+    property_handle_t name = db->find_property(mydb, typ, "name");
+    property_handle_t next = db->find_property(mydb, typ, "next");
+    property_handle_t nodes = db->find_property(mydb, typ, "nodes");
+
+    object_id_t existing = db->create_object(mydb, typ);
+    db->set_float64_h(mydb, existing, x, 1.);
+
+    database_transaction_o* tx = db->begin_transaction(mydb);
+    object_id_t pending[4];
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        pending[i] = db->tx_create_object(tx, typ);
+        double value = 10. + i;
+        db->tx_set_h(tx, pending[i], x, &value, sizeof(value));
+    }
+    pending[3] = db->tx_create_object(tx, node);
+    db->tx_set_h(tx, pending[0], next, &pending[3], sizeof(pending[3]));
+    db->tx_set_blob_h(tx, pending[2], nodes, &pending[3], sizeof(pending[3]));
+    db->tx_set_blob_h(tx, pending[1], name, "abc", 4);
+    db->tx_set_blob_data_h(tx, pending[1], name, 0, 1, "A");
+    db->tx_destroy_object(tx, existing);
+    ASSERT(db->get_float64_h(mydb, existing, x) == 1.);
+
+    object_id_t created[4];
+    ASSERT(db->commit_transaction(tx, created));
+    ASSERT(db->get_float64_or_h(mydb, existing, x, -1.) == -1.);
+    ASSERT(db->get_float64_h(mydb, created[2], x) == 12.);
+    ASSERT(db->get_reference_h(mydb, created[0], next).index
+           == created[3].index);
+    object_array_view_t view = db->read_array_h(mydb, created[2], nodes);
+    ASSERT(view.count == 1 && view.ids[0].index == created[3].index);
+    object_id_t referrers[2];
+    ASSERT(db->get_referrers(mydb, created[3], referrers, 0, 2) == 2);
+    char text[4];
+    ASSERT(db->get_blob_data_h(mydb, created[1], name, 0, 4, text));
+    ASSERT(!strcmp(text, "Abc"));
+
+    // a single invalid record fails the whole commit, before any change
+    tx = db->begin_transaction(mydb);
+    object_id_t late = db->tx_create_object(tx, typ);
+    double value = 5.;
+    db->tx_set_h(tx, created[0], x, &value, sizeof(value));
+    db->tx_set_blob_h(tx, late, nodes, &created[3], sizeof(created[3]));
+    db->tx_set_blob_h(tx, created[1], name, "ab", 3);
+    db->tx_set_blob_data_h(tx, created[1], name, 2, 2, "cd");
+    ASSERT(!db->commit_transaction(tx, 0));
+    ASSERT(db->object_count(mydb, typ) == 3);
+    ASSERT(db->get_float64_h(mydb, created[0], x) == 10.);
+    ASSERT(db->get_blob_data_h(mydb, created[1], name, 0, 4, text));
+    ASSERT(!strcmp(text, "Abc"));
+
+    tx = db->begin_transaction(mydb);
+    value = 0.;
+    db->tx_set_h(tx, created[0], x, &value, sizeof(value));
+    db->abort_transaction(tx);
+    ASSERT(db->get_float64_h(mydb, created[0], x) == 10.);
+
+    db->destroy(mydb);
+}
+
+static void test_db_accessors(database_api* db)
+{
+    // Same schema as the one test_item_accessors.h was generated from.
+    property_definition_t props[] = {
+        {.name = "x", .type = PTYPE_FLOAT64},
+        {.name = "flags", .type = PTYPE_UINT16},
+        {.name = "name", .type = PTYPE_BLOB},
+        {.name = "next", .type = PTYPE_REFERENCE},
+        {.name = "count", .type = PTYPE_UINT32, .flags = PROPERTY_COLD},
+    };
+    database_o* mydb = db->create(mem_std_alloc);
+    object_type_t typ =
+        db->add_object_type(mydb, STATIC_ARRAY_COUNT(props), props);
+
+    test_item_accessors_t a;
+    ASSERT(test_item_register(&a, db, mydb, typ));
+
+    object_id_t first = db->create_object(mydb, typ);
+    object_id_t second = db->create_object(mydb, typ);
+    ASSERT(test_item_set_x(&a, first, 2.5));
+    ASSERT(test_item_set_flags(&a, first, 7));
+    ASSERT(test_item_set_count(&a, first, 42));
+    ASSERT(test_item_set_name(&a, first, "abc", 4));
+
+    ASSERT(db->get_float64_h(mydb, first, a.x) == 2.5);
+    ASSERT(test_item_get_flags(&a, first) == 7);
+    ASSERT(test_item_get_count(&a, first) == 42);
+    ASSERT(!strcmp(test_item_get_name(&a, first).data, "abc"));
+
+    db->set_float64_h(mydb, second, a.x, 4.);
+    const void* payload = test_item_payload(&a, second);
+    ASSERT(test_item_x(payload) == 4.);
+    ASSERT(test_item_flags(payload) == 0);
+
+    // The referenced type isn't part of the layout.
+    property_definition_t linked_props[STATIC_ARRAY_COUNT(props)];
+    memcpy(linked_props, props, sizeof(props));
+    linked_props[3].object_type = typ;
+    object_type_t linked = db->add_object_type(
+        mydb, STATIC_ARRAY_COUNT(linked_props), linked_props);
+    test_item_accessors_t linked_a;
+    ASSERT(test_item_register(&linked_a, db, mydb, linked));
+    object_id_t link = db->create_object(mydb, linked);
+    test_item_set_next(&linked_a, link, first);
+    ASSERT(test_item_get_next(&linked_a, link).index == first.index);
+
+    // A different layout is refused.
+    property_definition_t other_props[] = {
+        {.name = "x", .type = PTYPE_FLOAT32},
+        {.name = "flags", .type = PTYPE_UINT16},
+    };
+    object_type_t other = db->add_object_type(
+        mydb, STATIC_ARRAY_COUNT(other_props), other_props);
+    ASSERT(!test_item_register(&a, db, mydb, other));
+    db->destroy(mydb);
+
+    char* path =
+        platform_get_relative_path(mem_scratch_alloc, "test_item_accessors.h");
+    ASSERT(db->generate_accessors(mem_std_alloc,
+                                  "test_item",
+                                  STATIC_ARRAY_COUNT(props),
+                                  props,
+                                  0,
+                                  path));
+    ASSERT(!db->generate_accessors(mem_std_alloc,
+                                   "not an identifier",
+                                   STATIC_ARRAY_COUNT(props),
+                                   props,
+                                   0,
+                                   path));
+}
+
+static void test_db_aggregates(database_api* db)
+{
+    database_o* mydb = db->create(mem_std_alloc);
+
+    property_definition_t props[] = {
+        {.name = "f64", .type = PTYPE_FLOAT64},
+        {.name = "f32", .type = PTYPE_FLOAT32, .flags = PROPERTY_COLD},
+        {.name = "i32", .type = PTYPE_INT32},
+        {.name = "u32", .type = PTYPE_UINT32},
+        {.name = "i16", .type = PTYPE_INT16},
+        {.name = "name", .type = PTYPE_BLOB},
+    };
+    object_type_t types[] = {
+        db->add_object_type(mydb, STATIC_ARRAY_COUNT(props), props),
+        db->add_object_type_ex(mydb,
+                               STATIC_ARRAY_COUNT(props) - 1,
+                               props,
+                               OBJECT_TYPE_COLUMNAR),
+    };
+
+    // Not a multiple of the vector widths, over several gathered blocks.
+    const uint32_t count = 2503;
+    for (uint32_t t = 0; t < STATIC_ARRAY_COUNT(types); t++)
+    {
+        property_handle_t f64 = db->find_property(mydb, types[t], "f64");
+        property_handle_t f32 = db->find_property(mydb, types[t], "f32");
+        property_handle_t i32 = db->find_property(mydb, types[t], "i32");
+        property_handle_t u32 = db->find_property(mydb, types[t], "u32");
+        property_handle_t i16 = db->find_property(mydb, types[t], "i16");
+
+        property_aggregate_t result;
+        ASSERT(db->aggregate_h(mydb, f64, &result));
+        ASSERT(result.count == 0 && result.min == 0. && result.max == 0.);
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            object_id_t id = db->create_object(mydb, types[t]);
+            db->set_float64_h(mydb, id, f64, i * 0.5);
+            db->set_float32_h(mydb, id, f32, -(float)i);
+            db->set_int32_h(mydb, id, i32, (int32_t)i - 1000);
+            db->set_uint32_h(mydb, id, u32, UINT32_MAX - i);
+            db->set_int16_h(mydb, id, i16, (int16_t)(i % 100));
+        }
+
+        ASSERT(db->aggregate_h(mydb, f64, &result));
+        ASSERT(result.count == count);
+        ASSERT(result.sum == 0.5 * count * (count - 1) / 2);
+        ASSERT(result.min == 0. && result.max == (count - 1) * 0.5);
+        ASSERT(result.mean == result.sum / count);
+
+        ASSERT(db->aggregate_h(mydb, f32, &result));
+        ASSERT(result.min == -(double)(count - 1) && result.max == 0.);
+        ASSERT(db->aggregate_h(mydb, i32, &result));
+        ASSERT(result.min == -1000. && result.max == count - 1001.);
+        ASSERT(db->aggregate_h(mydb, u32, &result));
+        ASSERT(result.max == UINT32_MAX);
+        ASSERT(result.min == (double)UINT32_MAX - (count - 1));
+        ASSERT(db->aggregate_h(mydb, i16, &result));
+        ASSERT(result.max == 99.);
+
+        ASSERT(db->count_in_range_h(mydb, f64, 10., 20.) == 21);
+        ASSERT(db->count_in_range_h(mydb, f32, -5., 0.) == 6);
+        ASSERT(db->count_in_range_h(mydb, i32, -1000., -1.) == 1000);
+        ASSERT(db->count_in_range_h(mydb, u32, UINT32_MAX, UINT32_MAX) == 1);
+        ASSERT(db->count_in_range_h(mydb, i16, 0., 0.) == 26);
+    }
+
+    property_aggregate_t result;
+    property_handle_t name = db->find_property(mydb, types[0], "name");
+    ASSERT(!db->aggregate_h(mydb, name, &result));
+    ASSERT(!db->count_in_range_h(mydb, name, 0., 1.));
+
+    db->destroy(mydb);
+}
+
+static void test_db_replica(database_api* db)
+{
+    const char* name = "/oui_test_replica";
+    database_o* mydb = db->create(mem_std_alloc);
+
+    property_definition_t props[] = {
+        {.name = "x", .type = PTYPE_FLOAT64},
+        {.name = "name", .type = PTYPE_BLOB},
+    };
+    object_type_t typ =
+        db->add_object_type(mydb, STATIC_ARRAY_COUNT(props), props);
+    property_handle_t x = db->find_property(mydb, typ, "x");
+    property_handle_t blob = db->find_property(mydb, typ, "name");
+
+    object_id_t ids[10];
+    for (uint32_t i = 0; i < STATIC_ARRAY_COUNT(ids); i++)
+    {
+        ids[i] = db->create_object(mydb, typ);
+        db->set_float64_h(mydb, ids[i], x, i);
+    }
+    ASSERT(db->publish_replica(mydb, name, 1));
+
+    database_o* replica = db->open_replica(mem_std_alloc, name);
+    ASSERT(replica);
+    ASSERT(db->object_count(replica, typ) == STATIC_ARRAY_COUNT(ids));
+    ASSERT(db->get_float64_h(replica, ids[3], x) == 3.);
+
+    uint32_t batch_count;
+    ASSERT(db->follow_replica(replica, &batch_count) && !batch_count);
+    db->set_float64_h(mydb, ids[3], x, -3.);
+    db->set_blob_h(mydb, ids[4], blob, "abc", 4);
+    db->destroy_object(mydb, ids[5]);
+    ASSERT(db->commit_journal(mydb));
+    ASSERT(db->follow_replica(replica, &batch_count) && batch_count == 1);
+    ASSERT(db->get_float64_h(replica, ids[3], x) == -3.);
+    ASSERT(!strcmp(db->read_blob_h(replica, ids[4], blob).data, "abc"));
+    ASSERT(db->object_count(replica, typ) == STATIC_ARRAY_COUNT(ids) - 1);
+    ASSERT(db->get_version(replica) == db->get_version(mydb));
+
+    // Filling the ring moves the replica to a new segment.
+    uint8_t bytes[Kibi(16)] = {0};
+    for (uint32_t i = 0; i < 8; i++)
+    {
+        bytes[0] = i;
+        db->set_blob_h(mydb, ids[6], blob, bytes, sizeof(bytes));
+        ASSERT(db->commit_journal(mydb));
+    }
+    ASSERT(!db->follow_replica(replica, &batch_count) && batch_count);
+    db->destroy(replica);
+
+    replica = db->open_replica(mem_std_alloc, name);
+    ASSERT(replica);
+    ASSERT(((const uint8_t*)db->read_blob_h(replica, ids[6], blob).data)[0]
+           == 7);
+    db->set_float64_h(mydb, ids[7], x, -7.);
+
+    db->close_replica(mydb);
+    ASSERT(!db->follow_replica(replica, &batch_count) && batch_count == 1);
+    ASSERT(db->get_float64_h(replica, ids[7], x) == -7.);
+    ASSERT(!db->open_replica(mem_std_alloc, name));
+    db->destroy(replica);
+
+    db->destroy(mydb);
+}
+
+static void test_db_instances(database_api* db)
+{
+    database_o* mydb = db->create(mem_std_alloc);
+
+    property_definition_t leaf_props[] = {
+        {.name = "value", .type = PTYPE_FLOAT64},
+    };
+    object_type_t leaf =
+        db->add_object_type(mydb, STATIC_ARRAY_COUNT(leaf_props), leaf_props);
+
+    property_definition_t props[] = {
+        {.name = "x", .type = PTYPE_FLOAT64, .flags = PROPERTY_INDEX_HASH},
+        {.name = "y", .type = PTYPE_FLOAT64},
+        {.name = "name", .type = PTYPE_BLOB},
+        {.name = "target", .type = PTYPE_REFERENCE, .object_type = leaf},
+        {.name = "child", .type = PTYPE_OBJECT, .object_type = leaf},
+        {.name = "count", .type = PTYPE_UINT32, .flags = PROPERTY_COLD},
+    };
+    object_type_t typ =
+        db->add_object_type(mydb, STATIC_ARRAY_COUNT(props), props);
+    property_handle_t x = db->find_property(mydb, typ, "x");
+    property_handle_t y = db->find_property(mydb, typ, "y");
+    property_handle_t name = db->find_property(mydb, typ, "name");
+    property_handle_t target = db->find_property(mydb, typ, "target");
+    property_handle_t child = db->find_property(mydb, typ, "child");
+    property_handle_t count = db->find_property(mydb, typ, "count");
+
+    object_id_t leaf_id = db->create_object(mydb, leaf);
+    object_id_t proto = db->create_object(mydb, typ);
+    db->set_float64_h(mydb, proto, x, 1.);
+    db->set_float64_h(mydb, proto, y, 2.);
+    db->set_blob_h(mydb, proto, name, "proto", 6);
+    db->set_reference_h(mydb, proto, target, leaf_id);
+    db->set_uint32_h(mydb, proto, count, 5);
+    object_id_t proto_child = db->get_sub_object_h(mydb, proto, child);
+
+    // reads fall back to the prototype, sub-objects aren't shared
+    object_id_t inst = db->create_instance(mydb, proto);
+    ASSERT(inst.index && !db->get_payload(mydb, inst));
+    ASSERT(db->get_float64_h(mydb, inst, x) == 1.);
+    ASSERT(!strcmp(db->read_blob_h(mydb, inst, name).data, "proto"));
+    ASSERT(db->get_reference_h(mydb, inst, target).index == leaf_id.index);
+    ASSERT(db->get_uint32_h(mydb, inst, count) == 5);
+    object_id_t inst_child = db->get_sub_object_h(mydb, inst, child);
+    ASSERT(inst_child.index && inst_child.index != proto_child.index);
+
+    object_id_t referrers[4];
+    ASSERT(db->get_referrers(mydb, leaf_id, referrers, 0, 4) == 2);
+    object_id_t found[4];
+    ASSERT(db->find_float64(mydb, x, 1., found, 4) == 2);
+
+    // writes go to overrides, writes to the prototype reach the values
+    // instances don't override
+    db->set_float64_h(mydb, inst, x, 10.);
+    db->set_blob_h(mydb, inst, name, "inst", 5);
+    db->set_float64_h(mydb, proto, y, 20.);
+    ASSERT(db->get_float64_h(mydb, proto, x) == 1.);
+    ASSERT(!strcmp(db->read_blob_h(mydb, proto, name).data, "proto"));
+    ASSERT(db->get_float64_h(mydb, inst, y) == 20.);
+    ASSERT(db->find_float64(mydb, x, 10., found, 4) == 1);
+    db->set_float64_h(mydb, proto, x, 3.);
+    ASSERT(db->find_float64(mydb, x, 3., found, 4) == 1);
+    ASSERT(db->find_float64(mydb, x, 1., found, 4) == 0);
+
+    override_stats_t stats;
+    db->get_override_stats(mydb, &stats);
+    ASSERT(stats.instance_count == 1 && stats.override_count == 3);
+
+    object_id_t nested = db->create_instance(mydb, inst);
+    ASSERT(db->get_float64_h(mydb, nested, x) == 10.);
+    ASSERT(db->get_float64_h(mydb, nested, y) == 20.);
+    ASSERT(!strcmp(db->read_blob_h(mydb, nested, name).data, "inst"));
+
+    database_snapshot_o* snapshot = db->acquire_snapshot(mydb);
+    db->set_float64_h(mydb, inst, x, 11.);
+    db->set_blob_h(mydb, inst, name, "late", 5);
+    double value;
+    ASSERT(db->read_snapshot_h(snapshot, inst, x, &value, sizeof(value)));
+    ASSERT(value == 10.);
+    ASSERT(!strcmp(db->read_snapshot_blob_h(snapshot, inst, name).data,
+                   "inst"));
+    db->release_snapshot(snapshot);
+
+    object_id_t clone = db->clone_object_cow(mydb, inst);
+    ASSERT(db->get_payload(mydb, clone));
+    ASSERT(db->get_float64_h(mydb, clone, x) == 11.);
+    ASSERT(db->get_float64_h(mydb, clone, y) == 20.);
+
+    object_type_t col = db->add_object_type_ex(mydb,
+                                               STATIC_ARRAY_COUNT(leaf_props),
+                                               leaf_props,
+                                               OBJECT_TYPE_COLUMNAR);
+    ASSERT(!db->create_instance(mydb, db->create_object(mydb, col)).index);
+
+    // instances are saved with their overrides
+    db->get_override_stats(mydb, &stats);
+    char* path = platform_get_relative_path(mem_scratch_alloc, "test_db.bin");
+    ASSERT(db->save_to_file(mydb, path));
+    database_o* loaded = db->load_from_file(mem_std_alloc, path, 0);
+    ASSERT(loaded && !db->get_payload(loaded, inst));
+    ASSERT(db->get_float64_h(loaded, inst, x) == 11.);
+    ASSERT(db->get_float64_h(loaded, inst, y) == 20.);
+    ASSERT(!strcmp(db->read_blob_h(loaded, inst, name).data, "late"));
+    ASSERT(db->get_sub_object_h(loaded, inst, child).index
+           == inst_child.index);
+    override_stats_t loaded_stats;
+    db->get_override_stats(loaded, &loaded_stats);
+    ASSERT(loaded_stats.instance_count == stats.instance_count
+           && loaded_stats.override_count == stats.override_count);
+    db->set_float64_h(loaded, proto, y, 30.);
+    ASSERT(db->get_float64_h(loaded, nested, y) == 30.);
+    db->destroy(loaded);
+
+    // destroying the prototype makes plain objects of its instances
+    db->destroy_object(mydb, proto);
+    ASSERT(db->get_payload(mydb, inst));
+    ASSERT(db->get_float64_h(mydb, inst, x) == 11.);
+    ASSERT(db->get_float64_h(mydb, inst, y) == 20.);
+    ASSERT(db->get_float64_h(mydb, nested, y) == 20.);
+
+    db->destroy_object(mydb, leaf_id);
+    db->destroy_object(mydb, inst);
+    db->destroy_object(mydb, nested);
+    db->get_override_stats(mydb, &stats);
+    ASSERT(!stats.instance_count && !stats.override_count);
+    ASSERT(db->get_float64_h(mydb, clone, x) == 11.);
+
+    db->destroy(mydb);
+}
+
+static void test_db_arrays(database_api* db)
+{
+    database_o* mydb = db->create(mem_std_alloc);
+
+    property_definition_t leaf_props[] = {
+        {.name = "value", .type = PTYPE_FLOAT64},
+    };
+    object_type_t leaf =
+        db->add_object_type(mydb, STATIC_ARRAY_COUNT(leaf_props), leaf_props);
+
+    property_definition_t props[] = {
+        {.name = "refs", .type = PTYPE_REFERENCE_ARRAY, .object_type = leaf},
+        {.name = "children", .type = PTYPE_OBJECT_ARRAY, .object_type = leaf},
+    };
+    object_type_t typ =
+        db->add_object_type(mydb, STATIC_ARRAY_COUNT(props), props);
+    property_handle_t refs = db->find_property(mydb, typ, "refs");
+    property_handle_t children = db->find_property(mydb, typ, "children");
+
+    object_id_t owner = db->create_object(mydb, typ);
+    object_id_t targets[100];
+    for (uint32_t i = 0; i < STATIC_ARRAY_COUNT(targets); i++)
+    {
+        targets[i] = db->create_object(mydb, leaf);
+        ASSERT(db->append_reference_h(mydb, owner, refs, targets[i]));
+    }
+    ASSERT(!db->append_reference_h(mydb, owner, refs, owner));
+    object_id_t sub = db->append_sub_object_h(mydb, owner, children);
+    db->set_float64_h(mydb, sub, db->find_property(mydb, leaf, "value"), 3.);
+    object_id_t sub2 = db->append_sub_object_h(mydb, owner, children);
+
+    object_array_view_t view = db->read_array_h(mydb, owner, refs);
+    ASSERT(view.count == 100 && view.ids[42].index == targets[42].index);
+    blob_store_stats_t blob_stats;
+    db->get_blob_stats(mydb, &blob_stats);
+    ASSERT(blob_stats.logical_bytes == 102 * sizeof(object_id_t));
+    ASSERT(blob_stats.stored_bytes == blob_stats.logical_bytes);
+    ASSERT(blob_stats.reserved_bytes > blob_stats.stored_bytes);
+    object_id_t referrers[4];
+    ASSERT(db->get_referrers(mydb, targets[7], referrers, 0, 4) == 1);
+
+    // removal swaps the last element in
+    ASSERT(db->remove_array_element_h(mydb, owner, refs, 0));
+    view = db->read_array_h(mydb, owner, refs);
+    ASSERT(view.count == 99 && view.ids[0].index == targets[99].index);
+    ASSERT(!db->get_referrers(mydb, targets[0], referrers, 0, 4));
+
+    // destroyed targets leave the array
+    db->destroy_object(mydb, targets[42]);
+    view = db->read_array_h(mydb, owner, refs);
+    ASSERT(view.count == 98 && view.ids[42].index == targets[98].index);
+
+    database_snapshot_o* snapshot = db->acquire_snapshot(mydb);
+    object_id_t clone = db->clone_object(mydb, owner);
+    ASSERT(db->remove_array_element_h(mydb, owner, children, 0));
+    ASSERT(!db->get_payload(mydb, sub));
+    blob_view_t old = db->read_snapshot_blob_h(snapshot, owner, children);
+    ASSERT(old.size == 2 * sizeof(object_id_t));
+    db->release_snapshot(snapshot);
+
+    // clones share the referenced objects but not the sub-objects
+    view = db->read_array_h(mydb, clone, refs);
+    ASSERT(view.count == 98);
+    ASSERT(db->get_referrers(mydb, targets[7], referrers, 0, 4) == 2);
+    view = db->read_array_h(mydb, clone, children);
+    ASSERT(view.count == 2 && view.ids[0].index != sub.index);
+
+    char* path = platform_get_relative_path(mem_scratch_alloc, "test_db.bin");
+    ASSERT(db->save_to_file(mydb, path));
+    database_o* loaded = db->load_from_file(mem_std_alloc, path, 0);
+    ASSERT(loaded);
+    view = db->read_array_h(loaded, owner, children);
+    ASSERT(view.count == 1 && view.ids[0].index == sub2.index);
+    ASSERT(db->append_reference_h(loaded, owner, refs, targets[0]));
+    ASSERT(db->remove_array_element_h(loaded, owner, refs, 1));
+    db->destroy_object(loaded, targets[99]);
+    view = db->read_array_h(loaded, owner, refs);
+    ASSERT(view.count == 97 && view.ids[1].index == targets[0].index);
+    db->destroy(loaded);
+
+    db->destroy_object(mydb, owner);
+    ASSERT(!db->get_payload(mydb, sub2));
+    ASSERT(db->get_referrers(mydb, targets[7], referrers, 0, 4) == 1);
+
+    db->destroy(mydb);
+}
+
+static void test_db_strings(database_api* db)
+{
+    string_id_t apple = string_intern("apple");
+    ASSERT(apple.hash == string_intern("apple").hash);
+    ASSERT(apple.hash == string_id("apple").hash);
+    ASSERT(string_text(apple) == string_text(string_intern("apple")));
+    ASSERT(!strcmp(string_text(apple), "apple"));
+    ASSERT(!string_intern(0).hash && string_intern("").hash);
+    ASSERT(!string_text(string_id("never interned")));
+
+    database_o* mydb = db->create(mem_std_alloc);
+    property_definition_t props[] = {
+        {.name = "name", .type = PTYPE_STRING, .flags = PROPERTY_INDEX_HASH},
+        {.name = "note", .type = PTYPE_STRING, .flags = PROPERTY_COLD},
+    };
+    object_type_t typ =
+        db->add_object_type(mydb, STATIC_ARRAY_COUNT(props), props);
+    property_handle_t name = db->find_property(mydb, typ, "name");
+    property_handle_t note = db->find_property(mydb, typ, "note");
+    ASSERT(name.index && note.index && name.index != note.index);
+
+    object_id_t ids[100];
+    for (uint32_t i = 0; i < STATIC_ARRAY_COUNT(ids); i++)
+    {
+        char txt[16];
+        snprintf(txt, sizeof(txt), "fruit %u", i % 10);
+        ids[i] = db->create_object(mydb, typ);
+        ASSERT(db->set_string_h(mydb, ids[i], name, string_intern(txt)));
+    }
+    ASSERT(db->set_string_h(mydb, ids[0], note, apple));
+    ASSERT(!db->set_string_h(mydb, ids[0], note, string_id("not interned")));
+
+    string_id_t fruit = string_intern("fruit 3");
+    ASSERT(db->get_string_h(mydb, ids[13], name).hash == fruit.hash);
+    object_id_t found[16];
+    ASSERT(db->find_string(mydb, name, fruit, found, 16) == 10);
+
+    database_snapshot_o* snapshot = db->acquire_snapshot(mydb);
+    db->set_string_h(mydb, ids[13], name, apple);
+    string_id_t old;
+    ASSERT(db->read_snapshot_h(snapshot, ids[13], name, &old, sizeof(old)));
+    ASSERT(old.hash == fruit.hash);
+    db->release_snapshot(snapshot);
+    ASSERT(db->find_string(mydb, name, fruit, found, 16) == 9);
+
+    // files store the texts, ids don't change
+    char* path = platform_get_relative_path(mem_scratch_alloc, "test_db.bin");
+    ASSERT(db->save_to_file(mydb, path));
+    database_o* loaded = db->load_from_file(mem_std_alloc, path, 0);
+    ASSERT(loaded);
+    ASSERT(db->get_string_h(loaded, ids[13], name).hash == apple.hash);
+    ASSERT(db->get_string_h(loaded, ids[0], note).hash == apple.hash);
+    ASSERT(db->find_string(loaded, name, fruit, found, 16) == 9);
+    db->destroy(loaded);
+
+    db->destroy(mydb);
+}
+
+static void test_db_compaction(database_api* db)
 {
-    int u;
-    char w[43];
-    float x;
-} blob_t;
+    database_o* mydb = db->create(mem_std_alloc);
 
-static void test_db(database_api* db)
+    property_definition_t leaf_props[] = {
+        {.name = "key", .type = PTYPE_UINT64, .flags = PROPERTY_INDEX_HASH},
+        {.name = "value",
+         .type = PTYPE_FLOAT64,
+         .flags = PROPERTY_INDEX_ORDERED},
+    };
+    object_type_t leaf =
+        db->add_object_type(mydb, STATIC_ARRAY_COUNT(leaf_props), leaf_props);
+    property_handle_t key = db->find_property(mydb, leaf, "key");
+    property_handle_t value = db->find_property(mydb, leaf, "value");
+
+    property_definition_t props[] = {
+        {.name = "ref", .type = PTYPE_REFERENCE, .object_type = leaf},
+        {.name = "child", .type = PTYPE_OBJECT, .object_type = leaf},
+        {.name = "refs", .type = PTYPE_REFERENCE_ARRAY, .object_type = leaf},
+    };
+    object_type_t typ =
+        db->add_object_type(mydb, STATIC_ARRAY_COUNT(props), props);
+    property_handle_t ref = db->find_property(mydb, typ, "ref");
+    property_handle_t child = db->find_property(mydb, typ, "child");
+    property_handle_t refs = db->find_property(mydb, typ, "refs");
+
+    object_id_t leaves[200];
+    for (uint32_t i = 0; i < STATIC_ARRAY_COUNT(leaves); i++)
+    {
+        leaves[i] = db->create_object(mydb, leaf);
+        db->set_uint64_h(mydb, leaves[i], key, i);
+        db->set_float64_h(mydb, leaves[i], value, i);
+    }
+    object_id_t node = db->create_object(mydb, typ);
+    db->set_reference_h(mydb, node, ref, leaves[151]);
+    object_id_t sub = db->get_sub_object_h(mydb, node, child);
+    db->set_uint64_h(mydb, sub, key, 1000);
+    for (uint32_t i = 100; i < 200; i += 2)
+    {
+        ASSERT(db->append_reference_h(mydb, node, refs, leaves[i]));
+    }
+    object_id_t instance = db->create_instance(mydb, leaves[199]);
+    db->set_float64_h(mydb, instance, value, 1000.);
+
+    for (uint32_t i = 0; i < 150; i++)
+    {
+        if (i % 3)
+        {
+            db->destroy_object(mydb, leaves[i]);
+        }
+    }
+    slot_stats_t stats;
+    db->get_slot_stats(mydb, &stats);
+    ASSERT(stats.slot_count == 203 && stats.free_count == 100);
+
+    // the objects above slot 103 fill its 68 free slots
+    ASSERT(db->compact_slots(mydb) == 68);
+    db->get_slot_stats(mydb, &stats);
+    ASSERT(stats.slot_count == 103 && !stats.free_count);
+
+    for (uint32_t i = 0; i < 200; i++)
+    {
+        object_id_t id = db->remap_id(mydb, leaves[i]);
+        if (i < 150 && i % 3)
+        {
+            continue;
+        }
+        ASSERT((id.index != leaves[i].index) == (leaves[i].info.slot > 103));
+        ASSERT(id.info.slot <= 103 && db->get_uint64_h(mydb, id, key) == i);
+        if (id.index != leaves[i].index)
+        {
+            ASSERT(!db->get_payload(mydb, leaves[i]));
+        }
+    }
+    ASSERT(!db->get_payload(mydb, node) && !db->get_payload(mydb, sub));
+    node = db->remap_id(mydb, node);
+    object_id_t target = db->remap_id(mydb, leaves[151]);
+    ASSERT(db->get_reference_h(mydb, node, ref).index == target.index);
+    ASSERT(db->get_sub_object_h(mydb, node, child).index
+           == db->remap_id(mydb, sub).index);
+    object_id_t found[16];
+    ASSERT(db->get_referrers(mydb, target, found, 0, 16) == 1);
+    ASSERT(found[0].index == node.index);
+
+    object_array_view_t view = db->read_array_h(mydb, node, refs);
+    ASSERT(view.count == 33);
+    for (uint32_t i = 0; i < view.count; i++)
+    {
+        uint64_t k = db->get_uint64_h(mydb, view.ids[i], key);
+        ASSERT(k >= 100 && k % 2 == 0);
+        ASSERT(db->get_referrers(mydb, view.ids[i], found, 0, 16) == 1);
+    }
+
+    ASSERT(db->find_uint64(mydb, key, 180, found, 16) == 1);
+    ASSERT(found[0].index == db->remap_id(mydb, leaves[180]).index);
+    ASSERT(db->find_float64_range(mydb, value, 999., 1001., found, 16) == 1);
+    ASSERT(found[0].index == db->remap_id(mydb, instance).index);
+    ASSERT(db->find_float64_range(mydb, value, 150., 159., found, 16) == 10);
+
+    // freed slots are reused lowest first
+    object_id_t low = db->remap_id(mydb, leaves[3]);
+    db->destroy_object(mydb, low);
+    object_id_t created = db->create_object(mydb, leaf);
+    ASSERT(created.info.slot == low.info.slot);
+    ASSERT(created.info.generation != low.info.generation);
+
+    // trimmed slots keep counting generations
+    object_id_t last = db->create_object(mydb, leaf);
+    db->destroy_object(mydb, last);
+    ASSERT(!db->compact_slots(mydb));
+    db->get_slot_stats(mydb, &stats);
+    ASSERT(stats.slot_count == 103 && last.info.slot == 104);
+    created = db->create_object(mydb, leaf);
+    ASSERT(created.info.slot == last.info.slot);
+    ASSERT(created.info.generation > last.info.generation);
+
+    char* path = platform_get_relative_path(mem_scratch_alloc, "test_db.bin");
+    ASSERT(db->save_to_file(mydb, path));
+    database_o* loaded = db->load_from_file(mem_std_alloc, path, 0);
+    ASSERT(loaded);
+    ASSERT(db->get_reference_h(loaded, node, ref).index == target.index);
+    ASSERT(db->find_uint64(loaded, key, 180, found, 16) == 1);
+    db->get_slot_stats(loaded, &stats);
+    ASSERT(stats.slot_count == created.info.slot && !stats.free_count);
+    db->destroy(loaded);
+
+    db->destroy(mydb);
+}
+
+static void test_db_heap(database_api* db)
 {
-    database_o* mydb = db->create(mem_std_alloc);
+    char* path = platform_get_relative_path(mem_scratch_alloc, "heap.bin");
+    platform_close_file(platform_create_file(path)); // empty, a new heap
 
+    database_o* mydb = db->open_heap(path, Gibi(1));
+    ASSERT(mydb);
+    ASSERT(!db->open_heap(path, 0)); // already open
     property_definition_t props[] = {
-        {.name = "active", .type = PTYPE_BOOL},
-        {.name = "x", .type = PTYPE_FLOAT64},
-        {.name = "y", .type = PTYPE_FLOAT64},
-        {.name = "blob", .type = PTYPE_BLOB},
+        {.name = "value", .type = PTYPE_INT64, .flags = PROPERTY_INDEX_HASH},
+        {.name = "name", .type = PTYPE_STRING},
+        {.name = "data", .type = PTYPE_BLOB},
     };
     object_type_t typ =
         db->add_object_type(mydb, STATIC_ARRAY_COUNT(props), props);
+    property_handle_t value = db->find_property(mydb, typ, "value");
+    property_handle_t name = db->find_property(mydb, typ, "name");
+    property_handle_t data = db->find_property(mydb, typ, "data");
 
-    property_definition_t nprops[] = {
-        {.name = "subobject", .type = PTYPE_OBJECT, .object_type = typ},
-        {.name = "reference", .type = PTYPE_REFERENCE, .object_type = typ},
+    object_id_t ids[10000];
+    for (uint32_t i = 0; i < STATIC_ARRAY_COUNT(ids); i++)
+    {
+        ids[i] = db->create_object(mydb, typ);
+        db->set_int64_h(mydb, ids[i], value, i);
+    }
+    ASSERT(db->set_string_h(mydb, ids[1], name, string_intern("persisted")));
+    ASSERT(db->set_blob_h(mydb, ids[2], data, "abc", 4));
+    db->destroy_object(mydb, ids[3]);
+    db->destroy(mydb);
+
+    // nothing to load, the objects are where they were left
+    mydb = db->open_heap(path, 0);
+    ASSERT(mydb);
+    ASSERT(db->find_property(mydb, typ, "value").index == value.index);
+    ASSERT(db->get_int64_h(mydb, ids[9999], value) == 9999);
+    ASSERT(!db->get_payload(mydb, ids[3]));
+    object_id_t found[4];
+    ASSERT(db->find_int64(mydb, value, 42, found, 4) == 1);
+    ASSERT(found[0].index == ids[42].index);
+    ASSERT(!strcmp(string_text(db->get_string_h(mydb, ids[1], name)),
+                   "persisted"));
+    char text[4];
+    ASSERT(db->get_blob_data_h(mydb, ids[2], data, 0, 4, text));
+    ASSERT(!strcmp(text, "abc"));
+
+    db->set_int64_h(mydb, ids[42], value, -42);
+    object_id_t created = db->create_object(mydb, typ);
+    ASSERT(created.info.slot == ids[3].info.slot);
+    object_id_t cloned = db->clone_object_cow(mydb, ids[2]);
+    ASSERT(db->sync_heap(mydb));
+
+    // a copy can't be mapped where the open heap is, its pointers move
+    char* copy_path =
+        platform_get_relative_path(mem_scratch_alloc, "heap_copy.bin");
+    platform_file_o* file = platform_open_file(path);
+    uint64_t size = platform_get_file_size(file);
+    void* bytes = mem_alloc(mem_std_alloc, size);
+    ASSERT(platform_read_file(file, bytes, size) == size);
+    platform_close_file(file);
+    file = platform_create_file(copy_path);
+    ASSERT(platform_write_file(file, bytes, size) == size);
+    platform_close_file(file);
+    mem_free(mem_std_alloc, bytes, size);
+
+    database_o* copy = db->open_heap(copy_path, 0);
+    ASSERT(copy && copy != mydb);
+    ASSERT(db->get_int64_h(copy, ids[42], value) == -42);
+    ASSERT(db->find_int64(copy, value, 43, found, 4) == 1);
+    ASSERT(db->get_blob_data_h(copy, cloned, data, 0, 4, text));
+    ASSERT(!strcmp(text, "abc"));
+    ASSERT(db->set_blob_h(copy, cloned, data, "xyz", 4));
+    ASSERT(db->get_blob_data_h(copy, ids[2], data, 0, 4, text));
+    ASSERT(!strcmp(text, "abc"));
+    db->destroy(copy);
+    db->destroy(mydb);
+
+    mydb = db->open_heap(path, 0);
+    ASSERT(db->get_int64_h(mydb, ids[42], value) == -42);
+    ASSERT(db->get_payload(mydb, created));
+    ASSERT(db->object_count(mydb, typ) == STATIC_ARRAY_COUNT(ids) + 1);
+    db->destroy(mydb);
+
+    mydb = db->create(mem_std_alloc);
+    ASSERT(!db->sync_heap(mydb));
+    db->destroy(mydb);
+}
+
+static void check_saved_db(database_api* db,
+                           database_o* mydb,
+                           object_type_t node_type,
+                           object_type_t point_type,
+                           object_id_t* nodes,
+                           object_id_t* points)
+{
+    property_handle_t name = db->find_property(mydb, node_type, "name");
+    property_handle_t rank = db->find_property(mydb, node_type, "rank");
+    property_handle_t owner = db->find_property(mydb, point_type, "owner");
+    property_handle_t x = db->find_property(mydb, point_type, "x");
+
+    char text[16];
+    ASSERT(db->get_blob_data_h(mydb, nodes[3], name, 0, 6, text));
+    ASSERT(!memcmp(text, "node 3", 6));
+    ASSERT(db->get_int32_h(mydb, nodes[3], rank) == 30);
+    ASSERT(db->get_float64(mydb, nodes[6], "weight") == 12.);
+    ASSERT(db->get_reference_h(mydb, points[3], owner).index
+           == nodes[3].index);
+    ASSERT(db->get_float32_h(mydb, points[7], x) == 7.f);
+
+    object_id_t found[4];
+    ASSERT(db->find_int32(mydb, rank, 30, found, 4) == 1);
+    ASSERT(found[0].index == nodes[3].index);
+    ASSERT(db->find_int32_range(mydb, rank, 0, 25, found, 4) == 3);
+
+    // writes and resizes move data out of the file
+    ASSERT(db->reallocate_blob_h(mydb, nodes[3], name, 12));
+    ASSERT(db->set_blob_data_h(mydb, nodes[3], name, 0, 8, "renamed"));
+    ASSERT(db->get_blob_data_h(mydb, nodes[3], name, 0, 8, text));
+    ASSERT(!strcmp(text, "renamed"));
+    db->set_int32_h(mydb, nodes[5], rank, 30);
+    ASSERT(db->find_int32(mydb, rank, 30, found, 4) == 2);
+
+    db->destroy_object(mydb, nodes[3]);
+    ASSERT(!db->get_reference_h(mydb, points[3], owner).index);
+    ASSERT(db->get_referrers(mydb, nodes[4], found, 0, 4) == 2);
+
+    for (uint32_t i = 0; i < 20; i++)
+    {
+        object_id_t id = db->create_object(mydb, point_type);
+        db->set_float32_h(mydb, id, x, -1.f);
+    }
+    ASSERT(db->object_count(mydb, point_type) == 36);
+    ASSERT(db->get_float32_h(mydb, points[7], x) == 7.f);
+}
+
+static void test_db_save_load(database_api* db)
+{
+    database_o* mydb = db->create(mem_std_alloc);
+
+    property_definition_t node_props[] = {
+        {.name = "name", .type = PTYPE_BLOB},
+        {.name = "rank",
+         .type = PTYPE_INT32,
+         .flags = PROPERTY_INDEX_HASH | PROPERTY_INDEX_ORDERED},
+        {.name = "weight", .type = PTYPE_FLOAT64, .flags = PROPERTY_COLD},
     };
-    object_type_t ntyp =
-        db->add_object_type(mydb, STATIC_ARRAY_COUNT(nprops), nprops);
+    object_type_t node_type =
+        db->add_object_type(mydb, STATIC_ARRAY_COUNT(node_props), node_props);
+
+    property_definition_t point_props[] = {
+        {.name = "x", .type = PTYPE_FLOAT32},
+        {.name = "y", .type = PTYPE_FLOAT32},
+        {.name = "owner",
+         .type = PTYPE_REFERENCE,
+         .object_type = node_type,
+         .flags = PROPERTY_NULL_ON_DESTROY},
+    };
+    object_type_t point_type =
+        db->add_object_type_ex(mydb,
+                               STATIC_ARRAY_COUNT(point_props),
+                               point_props,
+                               OBJECT_TYPE_COLUMNAR);
+
+    object_id_t nodes[8];
+    object_id_t points[16];
+    for (uint32_t i = 0; i < STATIC_ARRAY_COUNT(nodes); i++)
+    {
+        nodes[i] = db->create_object(mydb, node_type);
+        char text[16];
+        snprintf(text, sizeof(text), "node %u", i);
+        db->reallocate_blob(mydb, nodes[i], "name", strlen(text) + 1);
+        db->set_blob_data(mydb, nodes[i], "name", 0, strlen(text), text);
+        db->set_int32(mydb, nodes[i], "rank", i * 10);
+        db->set_float64(mydb, nodes[i], "weight", i * 2.);
+    }
+    for (uint32_t i = 0; i < STATIC_ARRAY_COUNT(points); i++)
+    {
+        points[i] = db->create_object(mydb, point_type);
+        db->set_float32(mydb, points[i], "x", (float)i);
+        db->set_reference(mydb, points[i], "owner", nodes[i % 7]);
+    }
+    db->destroy_object(mydb, nodes[7]);
 
-    log_debug("typ = %u", typ.index);
+    char* path = platform_get_relative_path(mem_scratch_alloc, "test_db.bin");
+    ASSERT(db->save_to_file(mydb, path));
+    db->destroy(mydb);
 
-    object_id_t nobj = db->create_object(mydb, ntyp);
-    object_id_t obj = db->create_object(mydb, typ);
-    blob_t my_blob = {-12, "123", 3.14f};
+    uint32_t modes[] = {0, DATABASE_LOAD_READ};
+    for (uint32_t m = 0; m < STATIC_ARRAY_COUNT(modes); m++)
+    {
+        mydb = db->load_from_file(mem_std_alloc, path, modes[m]);
+        ASSERT(mydb);
+        ASSERT(db->object_count(mydb, node_type) == 7);
+        check_saved_db(db, mydb, node_type, point_type, nodes, points);
+        db->destroy(mydb);
+    }
 
-    db->reallocate_blob(mydb, obj, "blob", sizeof(blob_t));
-    db->set_blob_data(mydb, obj, "blob", 0, sizeof(blob_t), &my_blob);
+    // a truncated file is rejected, not read out of bounds
+    platform_file_o* file = platform_open_file_rw(path);
+    ASSERT(platform_set_file_size(file, platform_get_file_size(file) / 2));
+    platform_close_file(file);
+    ASSERT(!db->load_from_file(mem_std_alloc, path, DATABASE_LOAD_READ));
+}
 
-    object_id_t obj2 = db->get_sub_object(mydb, nobj, "subobject");
-    db->reallocate_blob(mydb, obj2, "blob", sizeof(blob_t));
-    db->set_blob_data(mydb, obj2, "blob", 0, sizeof(blob_t), &my_blob);
+static void test_db_journal(database_api* db)
+{
+    char* snapshot = platform_get_relative_path(mem_scratch_alloc, "j.bin");
+    char* journal = platform_get_relative_path(mem_scratch_alloc, "j.log");
 
-    db->set_float64(mydb, obj, "x", 3.0);
-    for (uint32_t i = 0; i < 100; i++)
+    database_o* mydb = db->create(mem_std_alloc);
+    property_definition_t props[] = {
+        {.name = "value", .type = PTYPE_INT64},
+        {.name = "data", .type = PTYPE_BLOB},
+    };
+    object_type_t typ =
+        db->add_object_type(mydb, STATIC_ARRAY_COUNT(props), props);
+    property_handle_t value = db->find_property(mydb, typ, "value");
+    property_handle_t data = db->find_property(mydb, typ, "data");
+
+    object_id_t ids[100];
+    for (uint32_t i = 0; i < STATIC_ARRAY_COUNT(ids); i++)
+    {
+        ids[i] = db->create_object(mydb, typ);
+        db->set_int64_h(mydb, ids[i], value, i);
+    }
+
+    ASSERT(db->open_journal(mydb, snapshot, journal));
+
+    // a small edit only appends a few records
+    db->set_int64_h(mydb, ids[10], value, -10);
+    db->reallocate_blob_h(mydb, ids[10], data, 8);
+    db->set_blob_data_h(mydb, ids[10], data, 0, 4, "abc");
+    db->destroy_object(mydb, ids[20]);
+    object_id_t created = db->create_object(mydb, typ);
+    db->set_int64_h(mydb, created, value, 1000);
+    object_id_t batch[3];
+    int64_t batch_values[3] = {5, 6, 7};
+    db->create_objects(mydb, typ, 3, batch);
+    db->set_values_h(mydb, value, batch, 3, batch_values);
+    db->destroy_objects(mydb, batch, 1);
+    object_id_t cloned = db->clone_object_cow(mydb, ids[10]);
+    ASSERT(db->commit_journal(mydb));
+
+    platform_file_o* f = platform_open_file(journal);
+    ASSERT(platform_get_file_size(f) < 512);
+    platform_close_file(f);
+
+    // not committed, lost by a crash
+    db->set_int64_h(mydb, ids[30], value, -30);
+
+    for (uint32_t pass = 0; pass < 2; pass++)
+    {
+        database_o* copy = db->load_from_file(mem_std_alloc, snapshot, 0);
+        ASSERT(copy);
+        ASSERT(db->replay_journal(copy, journal) == 1 - pass);
+
+        char text[4];
+        ASSERT(db->get_int64_h(copy, ids[10], value) == -10);
+        ASSERT(db->get_blob_data_h(copy, ids[10], data, 0, 4, text));
+        ASSERT(!strcmp(text, "abc"));
+        ASSERT(db->get_int64_h(copy, created, value) == 1000);
+        ASSERT(db->get_int64_h(copy, batch[2], value) == 7);
+        ASSERT(db->get_int64_h(copy, cloned, value) == -10);
+        ASSERT(db->get_int64_or_h(copy, batch[0], value, 7) == 7);
+        ASSERT(db->get_int64_or_h(copy, ids[20], value, 7) == 7);
+        ASSERT(db->get_int64_h(copy, ids[30], value) == (pass ? -30 : 30));
+        db->destroy(copy);
+
+        // the snapshot now holds every change, uncommitted ones included
+        ASSERT(db->compact_journal(mydb));
+    }
+
+    // destroy commits, reopening appends to the same journal
+    db->set_int64_h(mydb, ids[40], value, -40);
+    db->destroy(mydb);
+
+    mydb = db->load_from_file(mem_std_alloc, snapshot, 0);
+    ASSERT(db->replay_journal(mydb, journal) == 1);
+    ASSERT(db->open_journal(mydb, snapshot, journal));
+    db->set_int64_h(mydb, ids[50], value, -50);
+    db->destroy(mydb);
+
+    mydb = db->load_from_file(mem_std_alloc, snapshot, 0);
+    ASSERT(db->replay_journal(mydb, journal) == 2);
+    ASSERT(db->get_int64_h(mydb, ids[40], value) == -40);
+    ASSERT(db->get_int64_h(mydb, ids[50], value) == -50);
+    db->destroy(mydb);
+}
+
+// Compares opening a saved database by mapping it against reading the
+// whole file, and the cost of touching every object afterwards.
+static void bench_db_load(database_api* db, uint32_t object_count)
+{
+    database_o* mydb = db->create(mem_std_alloc);
+
+    property_definition_t props[] = {
+        {.name = "value", .type = PTYPE_UINT64},
+        {.name = "data", .type = PTYPE_BLOB},
+    };
+    object_type_t typ =
+        db->add_object_type(mydb, STATIC_ARRAY_COUNT(props), props);
+    property_handle_t value = db->find_property(mydb, typ, "value");
+    property_handle_t data = db->find_property(mydb, typ, "data");
+
+    uint8_t bytes[256] = {0};
+    for (uint32_t i = 0; i < object_count; i++)
     {
         object_id_t id = db->create_object(mydb, typ);
+        db->set_uint64_h(mydb, id, value, i);
+        db->reallocate_blob_h(mydb, id, data, sizeof(bytes));
+        db->set_blob_data_h(mydb, id, data, 0, sizeof(bytes) - 1, bytes);
+    }
 
-        log_debug("ID : %u %u %u",
-                  id.info.type.index,
-                  id.info.generation,
-                  id.info.slot);
+    char* path = platform_get_relative_path(mem_scratch_alloc, "bench_db.bin");
+    uint64_t t0 = platform_get_nanoseconds();
+    db->save_to_file(mydb, path);
+    uint64_t save_ns = platform_get_nanoseconds() - t0;
+    db->destroy(mydb);
+
+    const char* names[] = {"mapped", "read"};
+    uint32_t modes[] = {0, DATABASE_LOAD_READ};
+    for (uint32_t m = 0; m < STATIC_ARRAY_COUNT(modes); m++)
+    {
+        t0 = platform_get_nanoseconds();
+        mydb = db->load_from_file(mem_std_alloc, path, modes[m]);
+        uint64_t load_ns = platform_get_nanoseconds() - t0;
+
+        t0 = platform_get_nanoseconds();
+        uint64_t sum = 0;
+        object_iterator_t it = db->begin_iteration(mydb, typ);
+        object_id_t id;
+        while (db->next_object(mydb, &it, &id))
+        {
+            sum += db->get_uint64_h(mydb, id, value);
+        }
+        uint64_t scan_ns = platform_get_nanoseconds() - t0;
+
+        log_info("%u objects, %s : load %.2f ms, first scan %.2f ms (%lu)",
+                 object_count,
+                 names[m],
+                 load_ns / 1e6,
+                 scan_ns / 1e6,
+                 sum);
+        db->destroy(mydb);
     }
-    log_debug("obj.x = %g", db->get_float64(mydb, obj, "x"));
-    db->get_blob_data(mydb, obj, "blob", 0, sizeof(blob_t), &my_blob);
-    log_debug("obj.blob = { .u = %d, .w = \"%s\", .x = %f }",
-              my_blob.u,
-              my_blob.w,
-              my_blob.x);
 
-    object_id_t id = db->create_object(mydb, typ);
-    db->set_float64(mydb, id, "x", 53.);
-    log_debug("slot = %u, gen = %u, x = %g",
-              id.info.slot,
-              id.info.generation,
-              db->get_float64(mydb, id, "x"));
+    log_info("save %.2f ms", save_ns / 1e6);
+}
 
-    db->destroy_object(mydb, id);
+// Compares aggregate_h against summing get_float64_h over an iteration,
+// for pooled payloads and for a column.
+static void bench_db_aggregates(database_api* db, uint32_t object_count)
+{
+    database_o* mydb = db->create(mem_std_alloc);
 
-    for (uint32_t i = 0; i < 66000; i++)
+    property_definition_t props[] = {
+        {.name = "value", .type = PTYPE_FLOAT64},
+        {.name = "other", .type = PTYPE_UINT64},
+    };
+    const char* names[] = {"payloads", "column"};
+    uint32_t flags[] = {0, OBJECT_TYPE_COLUMNAR};
+    for (uint32_t m = 0; m < STATIC_ARRAY_COUNT(flags); m++)
     {
-        object_id_t new_object = db->create_object(mydb, ntyp);
-        ASSERT(new_object.info.type.index == ntyp.index);
-        double xval = db->get_float64_or(mydb, id, "x", -1.);
-        if (xval != -1.)
+        object_type_t typ = db->add_object_type_ex(
+            mydb, STATIC_ARRAY_COUNT(props), props, flags[m]);
+        property_handle_t value = db->find_property(mydb, typ, "value");
+        for (uint32_t i = 0; i < object_count; i++)
         {
-            log_debug("i = %u, slot = %u, gen = %u, x = %g",
-                      i,
-                      new_object.info.slot,
-                      new_object.info.generation,
-                      xval);
+            object_id_t id = db->create_object(mydb, typ);
+            db->set_float64_h(mydb, id, value, i % 1000);
         }
-        db->destroy_object(mydb, new_object);
+
+        uint64_t t0 = platform_get_nanoseconds();
+        double sum = 0.;
+        object_iterator_t it = db->begin_iteration(mydb, typ);
+        object_id_t id;
+        while (db->next_object(mydb, &it, &id))
+        {
+            sum += db->get_float64_h(mydb, id, value);
+        }
+        uint64_t naive_ns = platform_get_nanoseconds() - t0;
+
+        t0 = platform_get_nanoseconds();
+        property_aggregate_t result;
+        db->aggregate_h(mydb, value, &result);
+        uint64_t aggregate_ns = platform_get_nanoseconds() - t0;
+
+        log_info("%u objects, %s : get_float64_h sum %.2f ms (%g), "
+                 "aggregate_h %.2f ms (%g)",
+                 object_count,
+                 names[m],
+                 naive_ns / 1e6,
+                 sum,
+                 aggregate_ns / 1e6,
+                 result.sum);
+    }
+
+    db->destroy(mydb);
+}
+
+// Throughput of the delta stream of a replica : batches of writes
+// committed to the ring, then applied by a reader in the same process.
+static void bench_db_replica(database_api* db, uint32_t batch_count)
+{
+    const uint32_t batch_size = 1000;
+    database_o* mydb = db->create(mem_std_alloc);
+
+    property_definition_t props[] = {
+        {.name = "value", .type = PTYPE_FLOAT64},
+    };
+    object_type_t typ =
+        db->add_object_type(mydb, STATIC_ARRAY_COUNT(props), props);
+    property_handle_t value = db->find_property(mydb, typ, "value");
+    object_id_t* ids =
+        mem_alloc(mem_std_alloc, sizeof(object_id_t) * batch_size);
+    db->create_objects(mydb, typ, batch_size, ids);
+
+    const char* name = "/oui_bench_replica";
+    db->publish_replica(mydb, name, Mebi(256));
+    database_o* replica = db->open_replica(mem_std_alloc, name);
+
+    uint64_t commit_ns = 0;
+    uint64_t follow_ns = 0;
+    for (uint32_t b = 0; b < batch_count; b++)
+    {
+        for (uint32_t i = 0; i < batch_size; i++)
+        {
+            db->set_float64_h(mydb, ids[i], value, b);
+        }
+
+        uint64_t t0 = platform_get_nanoseconds();
+        db->commit_journal(mydb);
+        uint64_t t1 = platform_get_nanoseconds();
+        uint32_t applied;
+        db->follow_replica(replica, &applied);
+        uint64_t t2 = platform_get_nanoseconds();
+
+        commit_ns += t1 - t0;
+        follow_ns += t2 - t1;
+    }
+
+    double records = (double)batch_count * batch_size;
+    log_info("%u batches of %u writes : commit %.2f ms, follow %.2f ms, "
+             "%.1f M records/s applied (%g)",
+             batch_count,
+             batch_size,
+             commit_ns / 1e6,
+             follow_ns / 1e6,
+             records / follow_ns * 1e3,
+             db->get_float64_h(replica, ids[0], value));
+
+    db->destroy(replica);
+    db->destroy(mydb);
+    mem_free(mem_std_alloc, ids, sizeof(object_id_t) * batch_size);
+}
+
+// Memory and read cost of instances holding one override, against plain
+// objects of the same type.
+static void bench_db_instances(database_api* db, uint32_t object_count)
+{
+    database_o* mydb = db->create(mem_std_alloc);
+
+    property_definition_t props[32] = {0};
+    for (uint32_t i = 0; i < STATIC_ARRAY_COUNT(props); i++)
+    {
+        snprintf(props[i].name, sizeof(props[i].name), "p%u", i);
+        props[i].type = PTYPE_FLOAT64;
+    }
+    object_type_t typ =
+        db->add_object_type(mydb, STATIC_ARRAY_COUNT(props), props);
+    property_handle_t written = db->find_property(mydb, typ, "p0");
+    property_handle_t inherited = db->find_property(mydb, typ, "p1");
+    type_layout_info_t layout;
+    db->get_type_layout(mydb, typ, &layout);
+
+    object_id_t proto = db->create_object(mydb, typ);
+    db->set_float64_h(mydb, proto, inherited, 1.);
+    object_id_t* ids =
+        mem_alloc(mem_std_alloc, sizeof(object_id_t) * object_count * 2);
+    for (uint32_t i = 0; i < object_count; i++)
+    {
+        ids[i] = db->create_object(mydb, typ);
+        db->set_float64_h(mydb, ids[i], inherited, 1.);
+        db->set_float64_h(mydb, ids[i], written, i);
+        ids[object_count + i] = db->create_instance(mydb, proto);
+        db->set_float64_h(mydb, ids[object_count + i], written, i);
+    }
+
+    override_stats_t stats;
+    db->get_override_stats(mydb, &stats);
+    const char* names[] = {"plain objects", "instances"};
+    uint64_t bytes[] = {(uint64_t)layout.payload_stride * object_count,
+                        stats.bytes + layout.payload_stride};
+    for (uint32_t m = 0; m < STATIC_ARRAY_COUNT(names); m++)
+    {
+        const object_id_t* first = ids + m * object_count;
+        uint64_t t0 = platform_get_nanoseconds();
+        double sum = 0.;
+        for (uint32_t i = 0; i < object_count; i++)
+        {
+            sum += db->get_float64_h(mydb, first[i], written);
+        }
+        uint64_t t1 = platform_get_nanoseconds();
+        for (uint32_t i = 0; i < object_count; i++)
+        {
+            sum += db->get_float64_h(mydb, first[i], inherited);
+        }
+        uint64_t t2 = platform_get_nanoseconds();
+
+        log_info("%u %s : %.1f MB, written property %.2f ms, "
+                 "inherited property %.2f ms (%g)",
+                 object_count,
+                 names[m],
+                 bytes[m] / 1e6,
+                 (t1 - t0) / 1e6,
+                 (t2 - t1) / 1e6,
+                 sum);
+    }
+
+    db->destroy(mydb);
+    mem_free(mem_std_alloc, ids, sizeof(object_id_t) * object_count * 2);
+}
+
+// Same data as bench_db_load, in a database living in a file heap : saving
+// is a sync of the mapped pages, opening maps the file again.
+static void bench_db_heap(database_api* db, uint32_t object_count)
+{
+    char* path =
+        platform_get_relative_path(mem_scratch_alloc, "bench_heap.bin");
+    platform_close_file(platform_create_file(path));
+    database_o* mydb = db->open_heap(path, Gibi(4));
+    if (!mydb)
+    {
+        return;
+    }
+
+    property_definition_t props[] = {
+        {.name = "value", .type = PTYPE_UINT64},
+        {.name = "data", .type = PTYPE_BLOB},
+    };
+    object_type_t typ =
+        db->add_object_type(mydb, STATIC_ARRAY_COUNT(props), props);
+    property_handle_t value = db->find_property(mydb, typ, "value");
+    property_handle_t data = db->find_property(mydb, typ, "data");
+
+    uint8_t bytes[256] = {0};
+    for (uint32_t i = 0; i < object_count; i++)
+    {
+        object_id_t id = db->create_object(mydb, typ);
+        db->set_uint64_h(mydb, id, value, i);
+        db->reallocate_blob_h(mydb, id, data, sizeof(bytes));
+        db->set_blob_data_h(mydb, id, data, 0, sizeof(bytes) - 1, bytes);
     }
 
+    uint64_t t0 = platform_get_nanoseconds();
+    db->sync_heap(mydb);
+    uint64_t sync_ns = platform_get_nanoseconds() - t0;
+    db->destroy(mydb);
+
+    t0 = platform_get_nanoseconds();
+    mydb = db->open_heap(path, 0);
+    uint64_t open_ns = platform_get_nanoseconds() - t0;
+
+    t0 = platform_get_nanoseconds();
+    uint64_t sum = 0;
+    object_iterator_t it = db->begin_iteration(mydb, typ);
+    object_id_t id;
+    while (db->next_object(mydb, &it, &id))
+    {
+        sum += db->get_uint64_h(mydb, id, value);
+    }
+    uint64_t scan_ns = platform_get_nanoseconds() - t0;
     db->destroy(mydb);
+
+    log_info("%u objects, heap : sync %.2f ms, open %.2f ms, first scan "
+             "%.2f ms (%lu)",
+             object_count,
+             sync_ns / 1e6,
+             open_ns / 1e6,
+             scan_ns / 1e6,
+             sum);
+}
+
+// Reader tool for a replica published by another process : follows it
+// and logs the changes, until its publisher closes it.
+static int follow_replica_tool(database_api* db, const char* name)
+{
+    database_o* replica = db->open_replica(mem_std_alloc, name);
+    if (!replica)
+    {
+        log_error("No replica published as '%s'", name);
+        log_flush();
+        return 1;
+    }
+
+    while (replica)
+    {
+        uint32_t batch_count;
+        bool open = db->follow_replica(replica, &batch_count);
+        if (batch_count)
+        {
+            log_info("'%s' : %u batches, version %lu",
+                     name,
+                     batch_count,
+                     db->get_version(replica));
+            type_layout_info_t layout;
+            for (object_type_t t = {1};
+                 db->get_type_layout(replica, t, &layout);
+                 t.index++)
+            {
+                log_info("  type %u : %u objects",
+                         t.index,
+                         db->object_count(replica, t));
+            }
+        }
+        log_flush();
+
+        if (!open)
+        {
+            db->destroy(replica);
+            replica = db->open_replica(mem_std_alloc, name);
+        }
+        else
+        {
+            platform_sleep(100000000);
+        }
+    }
+
+    log_info("'%s' was closed", name);
+    log_flush();
+    return 0;
 }
 
 void add_integer(const node_plug_value_t* inputs, node_plug_value_t* outputs)
@@ -466,7 +2480,6 @@ DefineNodeEvaluator(node_draw_quad)
 int main(int argc, const char** argv)
 {
     ASSERT(sizeof(void*) == sizeof(uint64_t));
-    (void)argc;
 
     uint32_t window_width = 640;
     uint32_t window_height = 480;
@@ -479,8 +2492,9 @@ int main(int argc, const char** argv)
 
     plugin_manager_init();
     log_init(mem_vm_alloc);
+    string_intern_init(mem_vm_alloc);
 
-    database_api* db = load_plugin("database", (version_t){0, 0, 2});
+    database_api* db = load_plugin("database", (version_t){0, 1, 0});
     ASSERT(db);
     renderer_api* render_api = load_plugin("renderer", (version_t){0, 0, 1});
     ASSERT(render_api);
@@ -490,8 +2504,47 @@ int main(int argc, const char** argv)
 
     test_hash();
     test_db(db);
+    test_db_columns(db);
+    test_db_iteration(db);
+    test_db_indexes(db);
+    test_db_references(db);
+    test_db_versions(db);
+    test_db_blob_views(db);
+    test_db_blob_store(db);
+    test_db_sub_objects(db);
+    test_db_layout(db);
+    test_db_bulk(db);
+    test_db_clone(db);
+    test_db_snapshots(db);
+    test_db_transactions(db);
+    test_db_accessors(db);
+    test_db_aggregates(db);
+    test_db_replica(db);
+    test_db_instances(db);
+    test_db_arrays(db);
+    test_db_strings(db);
+    test_db_compaction(db);
+    test_db_heap(db);
+    test_db_save_load(db);
+    test_db_journal(db);
     test_eval_graph();
 
+    if (argc > 1 && !strcmp(argv[1], "--bench"))
+    {
+        bench_db_load(db, 1000000);
+        bench_db_aggregates(db, 1000000);
+        bench_db_replica(db, 1000);
+        bench_db_instances(db, 1000000);
+        bench_db_heap(db, 1000000);
+        log_flush();
+        return 0;
+    }
+
+    if (argc > 2 && !strcmp(argv[1], "--replica"))
+    {
+        return follow_replica_tool(db, argv[2]);
+    }
+
     renderer = render_api->create(mem_vm_alloc);
     if (!renderer)
     {
@@ -664,6 +2717,7 @@ int main(int argc, const char** argv)
         log_flush();
     }
 
+    string_intern_terminate();
     log_terminate();
 
     mem_terminate();
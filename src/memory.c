@@ -1,6 +1,7 @@
 #include "memory.h"
 
 #include "assert.h"
+#include "logging.h"
 #include "platform.h"
 #include "plugin_sdk.h"
 #include "util.h"
@@ -94,8 +95,11 @@ static void* vm_realloc(void* impl,
 
     if (ptr)
     {
-        uint64_t copy_size = old_size < new_size ? old_size : new_size;
-        memcpy(new_ptr, ptr, copy_size);
+        if (new_ptr)
+        {
+            uint64_t copy_size = old_size < new_size ? old_size : new_size;
+            memcpy(new_ptr, ptr, copy_size);
+        }
 
         platform_virtual_free(ptr, old_size);
     }
@@ -186,3 +190,324 @@ void* mem_stack_push(mem_stack_o* alloc, uint64_t size)
 
     return result;
 }
+
+#define FILE_HEAP_MAGIC 0x50414548454c4946 /* "FILEHEAP" */
+#define FILE_HEAP_VERSION 1
+#define FILE_HEAP_DEFAULT_RESERVE Gibi(64)
+#define FILE_HEAP_MIN_GROWTH Mebi(4) // the file also at least doubles
+#define FILE_HEAP_ALIGNMENT 16
+// Small blocks are rounded up to a power of two, from
+// FILE_HEAP_ALIGNMENT to FILE_HEAP_LARGE_SIZE, large blocks to a multiple
+// of FILE_HEAP_LARGE_SIZE.
+#define FILE_HEAP_CLASS_COUNT 13
+#define FILE_HEAP_LARGE_SIZE Kibi(64)
+
+// At the start of the file. Offsets are from the start of the file,
+// free lists are threaded through the free blocks.
+typedef struct file_heap_header_t
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t padding;
+    uint64_t base; // address the file was last mapped at
+    uint64_t reserve; // size of the mapping
+    uint64_t top; // first byte never handed out
+    uint64_t root; // 0 for none
+
+    uint64_t free_small[FILE_HEAP_CLASS_COUNT];
+    uint64_t free_large; // see file_heap_large_t
+} file_heap_header_t;
+
+typedef struct file_heap_large_t
+{
+    uint64_t size;
+    uint64_t next;
+} file_heap_large_t;
+
+struct mem_file_heap_o
+{
+    mem_allocator_i alloc;
+    platform_file_o* file;
+    file_heap_header_t* header; // at the start of the mapping
+    uint64_t file_size;
+    int64_t relocation; // see mem_file_heap_get_relocation
+};
+
+static uint8_t* heap_at(const mem_file_heap_o* heap, uint64_t offset)
+{
+    return (uint8_t*)heap->header + offset;
+}
+
+static uint32_t file_heap_class(uint64_t size)
+{
+    uint32_t c = 0;
+    while (((uint64_t)FILE_HEAP_ALIGNMENT << c) < size)
+    {
+        c++;
+    }
+    return c;
+}
+
+static uint64_t file_heap_block_size(uint64_t size)
+{
+    if (size > FILE_HEAP_LARGE_SIZE)
+    {
+        return (size + FILE_HEAP_LARGE_SIZE - 1) & ~(FILE_HEAP_LARGE_SIZE - 1);
+    }
+    return (uint64_t)FILE_HEAP_ALIGNMENT << file_heap_class(size);
+}
+
+static bool file_heap_grow(mem_file_heap_o* heap, uint64_t size)
+{
+    if (size <= heap->file_size)
+    {
+        return true;
+    }
+    else if (size > heap->header->reserve)
+    {
+        log_error("File heap full : %lu bytes needed, %lu reserved",
+                  size,
+                  heap->header->reserve);
+        return false;
+    }
+
+    uint64_t grown = 2 * heap->file_size;
+    grown = grown < size + FILE_HEAP_MIN_GROWTH ? size + FILE_HEAP_MIN_GROWTH
+                                                : grown;
+    grown = grown < heap->header->reserve ? grown : heap->header->reserve;
+    if (!platform_set_file_size(heap->file, grown))
+    {
+        return false;
+    }
+
+    heap->file_size = grown;
+    return true;
+}
+
+// Returns the offset of a block of size bytes, a size returned by
+// file_heap_block_size, or 0 on failure.
+static uint64_t file_heap_alloc(mem_file_heap_o* heap, uint64_t size)
+{
+    file_heap_header_t* header = heap->header;
+    if (size <= FILE_HEAP_LARGE_SIZE)
+    {
+        uint64_t* list = &header->free_small[file_heap_class(size)];
+        uint64_t block = *list;
+        if (block)
+        {
+            *list = *(uint64_t*)heap_at(heap, block);
+            return block;
+        }
+    }
+    else
+    {
+        // first fit, the rest of the block stays free
+        uint64_t* link = &header->free_large;
+        while (*link)
+        {
+            uint64_t block = *link;
+            file_heap_large_t* free = (file_heap_large_t*)heap_at(heap, block);
+            if (free->size < size)
+            {
+                link = &free->next;
+                continue;
+            }
+
+            if (free->size > size)
+            {
+                file_heap_large_t* rest =
+                    (file_heap_large_t*)heap_at(heap, block + size);
+                *rest = (file_heap_large_t){
+                    .size = free->size - size,
+                    .next = free->next,
+                };
+                *link = block + size;
+            }
+            else
+            {
+                *link = free->next;
+            }
+            return block;
+        }
+    }
+
+    if (!file_heap_grow(heap, header->top + size))
+    {
+        return 0;
+    }
+    uint64_t block = header->top;
+    header->top += size;
+    return block;
+}
+
+static void file_heap_free(mem_file_heap_o* heap, uint64_t block, uint64_t size)
+{
+    file_heap_header_t* header = heap->header;
+    if (size <= FILE_HEAP_LARGE_SIZE)
+    {
+        uint64_t* list = &header->free_small[file_heap_class(size)];
+        *(uint64_t*)heap_at(heap, block) = *list;
+        *list = block;
+    }
+    else
+    {
+        *(file_heap_large_t*)heap_at(heap, block) = (file_heap_large_t){
+            .size = size,
+            .next = header->free_large,
+        };
+        header->free_large = block;
+    }
+}
+
+static void* file_heap_realloc(void* impl,
+                               void* ptr,
+                               uint64_t old_size,
+                               uint64_t new_size,
+                               const char* filename,
+                               uint32_t line_number)
+{
+    (void)filename;
+    (void)line_number;
+
+    mem_file_heap_o* heap = impl;
+    uint64_t old_block = ptr ? file_heap_block_size(old_size) : 0;
+    uint64_t new_block = new_size ? file_heap_block_size(new_size) : 0;
+    if (old_block == new_block)
+    {
+        return ptr;
+    }
+
+    void* new_ptr = 0;
+    if (new_block)
+    {
+        uint64_t block = file_heap_alloc(heap, new_block);
+        if (!block)
+        {
+            return 0;
+        }
+
+        new_ptr = heap_at(heap, block);
+        if (ptr)
+        {
+            uint64_t copy_size = old_size < new_size ? old_size : new_size;
+            memcpy(new_ptr, ptr, copy_size);
+        }
+    }
+
+    if (ptr)
+    {
+        file_heap_free(heap, (uint8_t*)ptr - heap_at(heap, 0), old_block);
+    }
+
+    return new_ptr;
+}
+
+mem_file_heap_o* mem_file_heap_open(const char* path, uint64_t reserve)
+{
+    platform_file_o* file = platform_open_file_rw(path);
+    if (!file)
+    {
+        return 0;
+    }
+
+    if (!platform_lock_file(file))
+    {
+        log_error("The heap file '%s' is already open", path);
+        platform_close_file(file);
+        return 0;
+    }
+
+    file_heap_header_t header = {0};
+    uint64_t file_size = platform_get_file_size(file);
+    bool created = !file_size;
+    if (created)
+    {
+        reserve = reserve ? reserve : FILE_HEAP_DEFAULT_RESERVE;
+        header = (file_heap_header_t){
+            .magic = FILE_HEAP_MAGIC,
+            .version = FILE_HEAP_VERSION,
+            .reserve = (reserve + FILE_HEAP_LARGE_SIZE - 1)
+                       & ~(FILE_HEAP_LARGE_SIZE - 1),
+            .top = (sizeof(header) + FILE_HEAP_ALIGNMENT - 1)
+                   & ~(uint64_t)(FILE_HEAP_ALIGNMENT - 1),
+        };
+        file_size = FILE_HEAP_MIN_GROWTH < header.reserve ? FILE_HEAP_MIN_GROWTH
+                                                          : header.reserve;
+    }
+    else if (platform_read_file(file, &header, sizeof(header)) != sizeof(header)
+             || header.magic != FILE_HEAP_MAGIC
+             || header.version != FILE_HEAP_VERSION
+             || header.top > file_size || file_size > header.reserve)
+    {
+        log_error("'%s' is not a heap file", path);
+        platform_close_file(file);
+        return 0;
+    }
+
+    void* base =
+        platform_map_shared_at(file, (void*)header.base, header.reserve);
+    if (!base || (created && !platform_set_file_size(file, file_size)))
+    {
+        if (base)
+        {
+            platform_unmap_file(base, header.reserve);
+        }
+        log_error("Could not open the heap file '%s'", path);
+        platform_close_file(file);
+        return 0;
+    }
+    if (created)
+    {
+        header.base = (uint64_t)base;
+        memcpy(base, &header, sizeof(header));
+    }
+
+    mem_file_heap_o* heap = mem_alloc(mem_std_alloc, sizeof(mem_file_heap_o));
+    *heap = (mem_file_heap_o){
+        .alloc = {.impl = heap, .realloc = file_heap_realloc},
+        .file = file,
+        .header = base,
+        .file_size = file_size,
+        .relocation = (int64_t)((uint64_t)base - header.base),
+    };
+    heap->header->base = (uint64_t)base;
+    return heap;
+}
+
+void mem_file_heap_close(mem_file_heap_o* heap)
+{
+    mem_file_heap_sync(heap);
+    platform_unmap_file(heap->header, heap->header->reserve);
+    platform_close_file(heap->file);
+    mem_free(mem_std_alloc, heap, sizeof(mem_file_heap_o));
+}
+
+bool mem_file_heap_sync(mem_file_heap_o* heap)
+{
+    return platform_sync_mapping(heap->header, heap->file_size);
+}
+
+mem_allocator_i* mem_file_heap_allocator(mem_file_heap_o* heap)
+{
+    return &heap->alloc;
+}
+
+void* mem_file_heap_get_root(mem_file_heap_o* heap)
+{
+    return heap->header->root ? heap_at(heap, heap->header->root) : 0;
+}
+
+void mem_file_heap_set_root(mem_file_heap_o* heap, void* root)
+{
+    heap->header->root = root ? (uint8_t*)root - heap_at(heap, 0) : 0;
+}
+
+uint64_t mem_file_heap_get_size(mem_file_heap_o* heap)
+{
+    return heap->file_size;
+}
+
+int64_t mem_file_heap_get_relocation(mem_file_heap_o* heap)
+{
+    return heap->relocation;
+}
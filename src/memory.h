@@ -29,6 +29,31 @@ uint64_t mem_stack_get_cursor(mem_stack_o* stack);
 void mem_stack_revert(mem_stack_o* stack, uint64_t cursor);
 void* mem_stack_push(mem_stack_o* alloc, uint64_t size);
 
+// Heap living in a file mapped with MAP_SHARED, so that what is
+// allocated from it persists by construction : mem_file_heap_sync
+// writes it back, and opening the file again maps it with no parsing.
+// The file is mapped at the address it was last mapped at when that
+// range is free, elsewhere otherwise : the pointers stored in it then
+// have to be moved by mem_file_heap_get_relocation. The heap's own
+// bookkeeping is kept as offsets from the start of the file. Opening a
+// heap that is already open fails. reserve is the size the file can
+// grow to, it is only used when creating the file, 0 picks a default.
+// Freed blocks are reused for blocks of the same size class, they
+// aren't coalesced.
+typedef struct mem_file_heap_o mem_file_heap_o;
+
+mem_file_heap_o* mem_file_heap_open(const char* path, uint64_t reserve);
+void mem_file_heap_close(mem_file_heap_o* heap); // syncs
+bool mem_file_heap_sync(mem_file_heap_o* heap);
+mem_allocator_i* mem_file_heap_allocator(mem_file_heap_o* heap);
+// Where to find what was stored in the heap when opening it again.
+void* mem_file_heap_get_root(mem_file_heap_o* heap);
+void mem_file_heap_set_root(mem_file_heap_o* heap, void* root);
+uint64_t mem_file_heap_get_size(mem_file_heap_o* heap); // of the file
+// Distance from the address the heap was last mapped at to the current
+// one, to add to the pointers stored in it. 0 unless it had to move.
+int64_t mem_file_heap_get_relocation(mem_file_heap_o* heap);
+
 #define mem_alloc(a, size)                                                     \
     ((a)->realloc((a)->impl, 0, 0, size, __FILE__, __LINE__))
 #define mem_free(a, ptr, size)                                                 \
@@ -53,12 +53,59 @@ bool platform_running_under_debugger();
 
 void* platform_virtual_alloc(uint64_t size);
 void platform_virtual_free(void* ptr, uint64_t size);
-
-platform_file_o* platform_open_file();
+// Hands the pages back to the system, they read as zeros afterwards. ptr
+// and size must be page aligned.
+void platform_virtual_reset(void* ptr, uint64_t size);
+
+platform_file_o* platform_open_file(const char* path);
+platform_file_o* platform_create_file(const char* path); // truncates
+platform_file_o* platform_open_file_rw(const char* path); // creates
+bool platform_rename_file(const char* from, const char* to);
 void platform_close_file(platform_file_o* file);
 
 uint64_t platform_get_file_size(platform_file_o* file);
 uint64_t platform_read_file(platform_file_o* file, void* buffer, uint64_t size);
+uint64_t
+platform_write_file(platform_file_o* file, const void* buffer, uint64_t size);
+uint64_t platform_write_file_at(platform_file_o* file,
+                                uint64_t offset,
+                                const void* buffer,
+                                uint64_t size);
+bool platform_sync_file(platform_file_o* file);
+// Fails when the file is locked through another open of it, in this
+// process or another. Closing the file releases the lock.
+bool platform_lock_file(platform_file_o* file);
+
+// Private, copy on write mapping of the whole file : writes through the
+// mapping never reach the file.
+void* platform_map_file(platform_file_o* file, uint64_t size);
+void platform_unmap_file(void* ptr, uint64_t size);
+bool platform_set_file_size(platform_file_o* file, uint64_t size);
+
+// Named shared memory segments, files that other processes open by name
+// and that stay until removed. Creating a segment removes any previous
+// one of the same name, processes that mapped it keep the old one.
+platform_file_o* platform_create_shared_memory(const char* name);
+platform_file_o* platform_open_shared_memory(const char* name); // read only
+void platform_remove_shared_memory(const char* name);
+
+// Mapping of size bytes from offset, a multiple of the page size, shared
+// with every process mapping the file : their writes are seen through
+// it. Unmapped with platform_unmap_file.
+void* platform_map_shared(platform_file_o* file,
+                          uint64_t offset,
+                          uint64_t size,
+                          bool writable);
+// Writable shared mapping of the file, at address when that range is
+// free and anywhere else otherwise. size can go past the end of the
+// file, the pages past it can't be touched until the file grows.
+void* platform_map_shared_at(platform_file_o* file,
+                             void* address,
+                             uint64_t size);
+// Writes the changes made through a shared mapping back to its file.
+bool platform_sync_mapping(void* ptr, uint64_t size);
+
+void platform_sleep(uint64_t nanoseconds);
 
 uint64_t platform_get_nanoseconds();
 
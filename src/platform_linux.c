@@ -7,6 +7,7 @@
 #include <dlfcn.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <sys/file.h>
 #include <sys/inotify.h>
 #include <sys/mman.h>
 #include <sys/ptrace.h>
@@ -59,6 +60,14 @@ void* platform_virtual_alloc(uint64_t size)
 
 void platform_virtual_free(void* ptr, uint64_t size) { munmap(ptr, size); }
 
+void platform_virtual_reset(void* ptr, uint64_t size)
+{
+    if (madvise(ptr, size, MADV_DONTNEED))
+    {
+        log_error("Call to madvise(%lu) failed : %s", size, strerror(errno));
+    }
+}
+
 uint64_t
 platform_read_binary_file(void* buffer, uint64_t size, const char* path)
 {
@@ -98,6 +107,44 @@ platform_file_o* platform_open_file(const char* path)
     return fd_to_ptr(fd);
 }
 
+platform_file_o* platform_create_file(const char* path)
+{
+    int64_t fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        log_error("Could not create file '%s' : %s", path, strerror(errno));
+        return 0;
+    }
+
+    return fd_to_ptr(fd);
+}
+
+platform_file_o* platform_open_file_rw(const char* path)
+{
+    int64_t fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+    {
+        log_error("Could not open file '%s' : %s", path, strerror(errno));
+        return 0;
+    }
+
+    return fd_to_ptr(fd);
+}
+
+bool platform_rename_file(const char* from, const char* to)
+{
+    if (rename(from, to) != 0)
+    {
+        log_error("Could not rename '%s' to '%s' : %s",
+                  from,
+                  to,
+                  strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
 void platform_close_file(platform_file_o* file)
 {
     int fd = ptr_to_fd(file);
@@ -131,6 +178,193 @@ uint64_t platform_read_file(platform_file_o* file, void* buffer, uint64_t size)
     return bytes_read;
 }
 
+uint64_t
+platform_write_file(platform_file_o* file, const void* buffer, uint64_t size)
+{
+    int fd = ptr_to_fd(file);
+
+    uint64_t written = 0;
+    while (written < size)
+    {
+        ssize_t result =
+            write(fd, (const uint8_t*)buffer + written, size - written);
+        if (result < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            log_error("Call to write failed : %s", strerror(errno));
+            break;
+        }
+        written += result;
+    }
+
+    return written;
+}
+
+uint64_t platform_write_file_at(platform_file_o* file,
+                                uint64_t offset,
+                                const void* buffer,
+                                uint64_t size)
+{
+    int fd = ptr_to_fd(file);
+
+    uint64_t written = 0;
+    while (written < size)
+    {
+        ssize_t result = pwrite(fd,
+                                (const uint8_t*)buffer + written,
+                                size - written,
+                                offset + written);
+        if (result < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            log_error("Call to pwrite failed : %s", strerror(errno));
+            break;
+        }
+        written += result;
+    }
+
+    return written;
+}
+
+bool platform_sync_file(platform_file_o* file)
+{
+    return fsync(ptr_to_fd(file)) == 0;
+}
+
+bool platform_lock_file(platform_file_o* file)
+{
+    return flock(ptr_to_fd(file), LOCK_EX | LOCK_NB) == 0;
+}
+
+void* platform_map_file(platform_file_o* file, uint64_t size)
+{
+    void* result = mmap(0,
+                        size,
+                        PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE,
+                        ptr_to_fd(file),
+                        0);
+
+    if (result == MAP_FAILED)
+    {
+        log_error("Call to mmap(%lu) failed : %s", size, strerror(errno));
+        return 0;
+    }
+
+    return result;
+}
+
+void platform_unmap_file(void* ptr, uint64_t size) { munmap(ptr, size); }
+
+bool platform_set_file_size(platform_file_o* file, uint64_t size)
+{
+    if (ftruncate(ptr_to_fd(file), size) != 0)
+    {
+        log_error("Call to ftruncate(%lu) failed : %s", size, strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+platform_file_o* platform_create_shared_memory(const char* name)
+{
+    shm_unlink(name);
+    int64_t fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0)
+    {
+        log_error("Could not create shared memory '%s' : %s",
+                  name,
+                  strerror(errno));
+        return 0;
+    }
+
+    return fd_to_ptr(fd);
+}
+
+platform_file_o* platform_open_shared_memory(const char* name)
+{
+    int64_t fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+    {
+        return 0;
+    }
+
+    return fd_to_ptr(fd);
+}
+
+void platform_remove_shared_memory(const char* name) { shm_unlink(name); }
+
+void* platform_map_shared(platform_file_o* file,
+                          uint64_t offset,
+                          uint64_t size,
+                          bool writable)
+{
+    void* result = mmap(0,
+                        size,
+                        writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                        MAP_SHARED,
+                        ptr_to_fd(file),
+                        offset);
+
+    if (result == MAP_FAILED)
+    {
+        log_error("Call to mmap(%lu) failed : %s", size, strerror(errno));
+        return 0;
+    }
+
+    return result;
+}
+
+void* platform_map_shared_at(platform_file_o* file,
+                             void* address,
+                             uint64_t size)
+{
+    // without MAP_FIXED, the address is only a hint
+    void* result = mmap(address,
+                        size,
+                        PROT_READ | PROT_WRITE,
+                        MAP_SHARED,
+                        ptr_to_fd(file),
+                        0);
+
+    if (result == MAP_FAILED)
+    {
+        log_error("Call to mmap(%lu) failed : %s", size, strerror(errno));
+        return 0;
+    }
+
+    return result;
+}
+
+bool platform_sync_mapping(void* ptr, uint64_t size)
+{
+    if (msync(ptr, size, MS_SYNC) != 0)
+    {
+        log_error("Call to msync(%lu) failed : %s", size, strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+void platform_sleep(uint64_t nanoseconds)
+{
+    struct timespec duration = {
+        .tv_sec = nanoseconds / 1000000000ull,
+        .tv_nsec = nanoseconds % 1000000000ull,
+    };
+    while (nanosleep(&duration, &duration) != 0 && errno == EINTR)
+    {
+    }
+}
+
 uint64_t platform_get_nanoseconds()
 {
     struct timespec now;
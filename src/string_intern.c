@@ -0,0 +1,123 @@
+#include "string_intern.h"
+#include "hash.h"
+#include "logging.h"
+#include "memory.h"
+#include "util.h"
+
+#include <stdatomic.h>
+#include <string.h>
+
+// Texts are appended to a single reservation, so that the pointers
+// returned by string_text stay valid.
+#define ARENA_SIZE Gibi(1)
+
+static mem_allocator_i* allocator;
+static char* arena;
+static uint64_t arena_used;
+static hash_t text_of_id; // id -> text in the arena
+
+static atomic_flag lock = ATOMIC_FLAG_INIT;
+
+static void lock_interner()
+{
+    while (atomic_flag_test_and_set_explicit(&lock, memory_order_acquire))
+    {
+    }
+}
+
+static void unlock_interner()
+{
+    atomic_flag_clear_explicit(&lock, memory_order_release);
+}
+
+void string_intern_init(mem_allocator_i* alloc)
+{
+    allocator = alloc;
+    arena = mem_alloc(alloc, ARENA_SIZE);
+    arena_used = 0;
+    text_of_id = (hash_t){0};
+}
+
+void string_intern_terminate()
+{
+    hash_free(allocator, &text_of_id);
+    mem_free(allocator, arena, ARENA_SIZE);
+    arena = 0;
+}
+
+string_id_t string_id_n(const char* txt, uint64_t size)
+{
+    if (!txt)
+    {
+        return (string_id_t){0};
+    }
+
+    // hash_t reserves 0 and UINT64_MAX
+    uint64_t h = hash_mix(hash_bytes(txt, size));
+    return (string_id_t){h == 0 || h == UINT64_MAX ? 1 : h};
+}
+
+string_id_t string_id(const char* txt)
+{
+    return string_id_n(txt, txt ? strlen(txt) : 0);
+}
+
+string_id_t string_intern_n(const char* txt, uint64_t size)
+{
+    string_id_t id = string_id_n(txt, size);
+    if (!id.hash)
+    {
+        return id;
+    }
+
+    lock_interner();
+    const char* text = (const char*)hash_find(&text_of_id, id.hash, 0);
+    bool full = !text && arena_used + size + 1 > ARENA_SIZE;
+    if (!text && !full)
+    {
+        char* copy = arena + arena_used;
+        memcpy(copy, txt, size);
+        copy[size] = 0;
+        arena_used += size + 1;
+        hash_set(allocator, &text_of_id, id.hash, (uint64_t)copy);
+        text = copy;
+    }
+    unlock_interner();
+
+    if (full)
+    {
+        log_error("Could not intern '%.*s' : the interner is full",
+                  (int)size,
+                  txt);
+        return (string_id_t){0};
+    }
+    else if (strlen(text) != size || memcmp(text, txt, size))
+    {
+        // Ids must stay hashes of the texts for files to keep them, the
+        // second text can't get another one.
+        log_error("Could not intern '%.*s' : '%s' has the same string id",
+                  (int)size,
+                  txt,
+                  text);
+        return (string_id_t){0};
+    }
+    return id;
+}
+
+string_id_t string_intern(const char* txt)
+{
+    return string_intern_n(txt, txt ? strlen(txt) : 0);
+}
+
+const char* string_text(string_id_t id)
+{
+    if (!id.hash)
+    {
+        return 0;
+    }
+
+    lock_interner();
+    const char* text = (const char*)hash_find(&text_of_id, id.hash, 0);
+    unlock_interner();
+    return text;
+}
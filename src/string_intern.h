@@ -0,0 +1,30 @@
+#pragma once
+
+#include "base_types.h"
+
+typedef struct mem_allocator_i mem_allocator_i;
+
+// Interned strings are referred to by the hash of their text : ids are
+// the same in every process and every run, and two strings are equal
+// iff their ids are. Texts are stored once, and never freed before
+// string_intern_terminate. Every function but init and terminate can be
+// called from any thread.
+typedef struct string_id_t
+{
+    uint64_t hash; // 0 for the null string
+} string_id_t;
+
+void string_intern_init(mem_allocator_i* alloc);
+void string_intern_terminate();
+
+// Returns the id of txt, storing a copy of it the first time. The null
+// pointer has the null id, the empty string doesn't. Returns the null id
+// and logs an error when the interner is full, or when another text
+// already has the id of txt : 64-bit hashes can collide.
+string_id_t string_intern(const char* txt);
+string_id_t string_intern_n(const char* txt, uint64_t size);
+// Returns the id txt would be interned as, without storing it.
+string_id_t string_id(const char* txt);
+string_id_t string_id_n(const char* txt, uint64_t size);
+// Returns the text of id, or null if it wasn't interned.
+const char* string_text(string_id_t id);
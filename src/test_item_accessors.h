@@ -0,0 +1,180 @@
+// Generated by database_api.generate_accessors, do not edit.
+#pragma once
+
+#include "data_model.h"
+
+#include <string.h>
+
+typedef struct test_item_accessors_t
+{
+    database_api* api;
+    database_o* db;
+    object_type_t type;
+    property_handle_t x;
+    property_handle_t flags;
+    property_handle_t name;
+    property_handle_t next;
+    property_handle_t count;
+} test_item_accessors_t;
+
+// Resolves the property handles of type, returns false if its
+// layout isn't the one the accessors were generated for.
+static inline bool test_item_register(test_item_accessors_t* a,
+                                      database_api* api,
+                                      database_o* db,
+                                      object_type_t type)
+{
+    static const struct
+    {
+        const char* name;
+        uint32_t type;
+        uint32_t offset;
+        uint32_t size;
+        bool cold;
+    } expected[] = {
+        {"x", PTYPE_FLOAT64, 0, 8, 0},
+        {"flags", PTYPE_UINT16, 32, 2, 0},
+        {"name", PTYPE_BLOB, 8, 16, 0},
+        {"next", PTYPE_REFERENCE, 24, 8, 0},
+        {"count", PTYPE_UINT32, 0, 4, 1},
+    };
+    property_handle_t* handles[] = {
+        &a->x,
+        &a->flags,
+        &a->name,
+        &a->next,
+        &a->count,
+    };
+
+    *a = (test_item_accessors_t){.api = api, .db = db, .type = type};
+    type_layout_info_t layout;
+    if (!api->get_type_layout(db, type, &layout)
+        || layout.hot_bytes != 34 || layout.cold_bytes != 8)
+    {
+        return false;
+    }
+    for (uint32_t i = 0; i < 5; i++)
+    {
+        property_layout_info_t info;
+        *handles[i] = api->find_property(db, type, expected[i].name);
+        if (!api->get_property_layout(db, type, *handles[i], &info)
+            || info.type != expected[i].type
+            || info.offset != expected[i].offset
+            || info.size != expected[i].size
+            || info.cold != expected[i].cold)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Hot properties of id, for the test_item_<property> readers, or null
+// for instances. Valid until the next change to the database.
+static inline const void* test_item_payload(const test_item_accessors_t* a,
+                                            object_id_t id)
+{
+    return a->api->get_payload(a->db, id);
+}
+
+static inline double test_item_x(const void* payload)
+{
+    double value;
+    memcpy(&value, (const uint8_t*)payload + 0, sizeof(value));
+    return value;
+}
+
+static inline double test_item_get_x(const test_item_accessors_t* a,
+                                     object_id_t id)
+{
+    const void* payload = a->api->get_payload(a->db, id);
+    if (payload)
+    {
+        return test_item_x(payload);
+    }
+    return a->api->get_float64_h(a->db, id, a->x);
+}
+
+static inline bool test_item_set_x(const test_item_accessors_t* a,
+                                   object_id_t id,
+                                   double value)
+{
+    return a->api->set_float64_h(a->db, id, a->x, value);
+}
+
+static inline uint16_t test_item_flags(const void* payload)
+{
+    uint16_t value;
+    memcpy(&value, (const uint8_t*)payload + 32, sizeof(value));
+    return value;
+}
+
+static inline uint16_t test_item_get_flags(const test_item_accessors_t* a,
+                                           object_id_t id)
+{
+    const void* payload = a->api->get_payload(a->db, id);
+    if (payload)
+    {
+        return test_item_flags(payload);
+    }
+    return a->api->get_uint16_h(a->db, id, a->flags);
+}
+
+static inline bool test_item_set_flags(const test_item_accessors_t* a,
+                                       object_id_t id,
+                                       uint16_t value)
+{
+    return a->api->set_uint16_h(a->db, id, a->flags, value);
+}
+
+static inline blob_view_t test_item_get_name(const test_item_accessors_t* a,
+                                             object_id_t id)
+{
+    return a->api->read_blob_h(a->db, id, a->name);
+}
+
+static inline bool test_item_set_name(const test_item_accessors_t* a,
+                                      object_id_t id,
+                                      const void* data,
+                                      uint64_t size)
+{
+    return a->api->set_blob_h(a->db, id, a->name, data, size);
+}
+
+static inline object_id_t test_item_next(const void* payload)
+{
+    object_id_t value;
+    memcpy(&value, (const uint8_t*)payload + 24, sizeof(value));
+    return value;
+}
+
+static inline object_id_t test_item_get_next(const test_item_accessors_t* a,
+                                             object_id_t id)
+{
+    const void* payload = a->api->get_payload(a->db, id);
+    if (payload)
+    {
+        return test_item_next(payload);
+    }
+    return a->api->get_reference_h(a->db, id, a->next);
+}
+
+static inline void test_item_set_next(const test_item_accessors_t* a,
+                                      object_id_t id,
+                                      object_id_t value)
+{
+    a->api->set_reference_h(a->db, id, a->next, value);
+}
+
+static inline uint32_t test_item_get_count(const test_item_accessors_t* a,
+                                           object_id_t id)
+{
+    return a->api->get_uint32_h(a->db, id, a->count);
+}
+
+static inline bool test_item_set_count(const test_item_accessors_t* a,
+                                       object_id_t id,
+                                       uint32_t value)
+{
+    return a->api->set_uint32_h(a->db, id, a->count, value);
+}
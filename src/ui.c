@@ -8,6 +8,7 @@
 #include "plugin_sdk.h"
 #include "renderer.h"
 #include "stretchy_buffer.h"
+#include "string_intern.h"
 #include "util.h"
 
 #include <math.h>
@@ -90,7 +91,8 @@ static void push_id(uint64_t id)
     ui.id_stack[ui.id_stack_height++] = hashed;
 }
 
-static void push_string_id(const char* txt) { push_id(hash_string(txt)); }
+// Hashed only : labels built every frame would fill the interner.
+static void push_string_id(const char* txt) { push_id(string_id(txt).hash); }
 
 static void pop_id()
 {